@@ -0,0 +1,416 @@
+// Loopback benchmark: local SRT callers push synthetic MPEG-TS through
+// in-process gateway pipelines to local librist receivers, and the
+// delivered throughput, loss and latency are reported per stream.
+//
+// Every TS packet carries its sequence number and send time, so loss and
+// end-to-end latency are measured on the receiving side without any
+// external tools. Everything runs on 127.0.0.1.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <srt/srt.h>
+#include <librist/librist.h>
+
+#include "config.h"
+#include "pipeline.h"
+#include "ts_packetizer.h"
+#include "worker_pool.h"
+
+// TS packets per SRT message, the usual 1316-byte live payload
+#define BENCH_TS_PER_MESSAGE 7
+// PID of the synthetic stream
+#define BENCH_PID 0x100
+// Time allowed for the SRT callers to connect to the gateway
+#define BENCH_CONNECT_TIMEOUT_MS 5000
+
+struct Options {
+    int streams = 1;
+    int bitrate_kbps = 8000;     // Per stream
+    int duration_s = 10;
+    int drain_ms = 2000;         // Wait for in-flight packets after sending stops
+    int base_port = 21000;       // SRT listeners from here, RIST receivers 1000 above
+    int workers = 0;
+    int ts_packets_per_datagram = 7;
+    int queue_depth = 1024;
+    double max_loss = -1.0;      // Fail when any stream loses more, percent
+    std::string trace_dir;       // Dump gateway latency traces here when set
+};
+
+using Clock = std::chrono::steady_clock;
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --streams N          streams relayed in parallel (default 1)\n"
+              << "  --bitrate KBPS       bitrate of each stream (default 8000)\n"
+              << "  --duration S         seconds of traffic (default 10)\n"
+              << "  --drain-ms MS        wait for in-flight packets (default 2000)\n"
+              << "  --base-port PORT     first SRT port; RIST uses PORT+1000 (default 21000)\n"
+              << "  --workers N          gateway worker threads, 0 for one per core\n"
+              << "  --ts-per-datagram N  gateway TS packetizer setting (default 7)\n"
+              << "  --queue-depth N      gateway RIST send queue depth (default 1024)\n"
+              << "  --max-loss PCT       exit with 1 if any stream loses more\n"
+              << "  --trace DIR          dump the gateway's per-stage latency traces to DIR\n";
+}
+
+static bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--streams") {
+            options.streams = atoi(value);
+        } else if (arg == "--bitrate") {
+            options.bitrate_kbps = atoi(value);
+        } else if (arg == "--duration") {
+            options.duration_s = atoi(value);
+        } else if (arg == "--drain-ms") {
+            options.drain_ms = atoi(value);
+        } else if (arg == "--base-port") {
+            options.base_port = atoi(value);
+        } else if (arg == "--workers") {
+            options.workers = atoi(value);
+        } else if (arg == "--ts-per-datagram") {
+            options.ts_packets_per_datagram = atoi(value);
+        } else if (arg == "--queue-depth") {
+            options.queue_depth = atoi(value);
+        } else if (arg == "--max-loss") {
+            options.max_loss = atof(value);
+        } else if (arg == "--trace") {
+            options.trace_dir = value;
+        } else {
+            return false;
+        }
+    }
+    return options.streams > 0 && options.bitrate_kbps > 0 && options.duration_s > 0 &&
+           options.queue_depth > 0 && options.ts_packets_per_datagram >= 0;
+}
+
+// One synthetic stream: an SRT caller on the sending side and a librist
+// receiver on the other
+struct Stream {
+    int index = 0;
+    int srt_port = 0;
+    int rist_port = 0;
+
+    SRTSOCKET caller = SRT_INVALID_SOCK;
+    uint64_t sent = 0;              // TS packets handed to SRT
+    uint64_t send_errors = 0;
+
+    struct rist_ctx* receiver = nullptr;
+    struct rist_peer* receiver_peer = nullptr;
+    uint64_t max_seq = 0;           // Bound on plausible sequence numbers
+    std::vector<bool> seen;         // Sequence numbers received
+    uint64_t received = 0;          // Unique TS packets received
+    uint64_t duplicates = 0;
+    uint64_t bytes = 0;
+    std::vector<int64_t> latencies; // Send to receive, ns
+    double jitter_ns = 0.0;         // RFC 3550 interarrival jitter
+    int64_t last_transit = -1;
+};
+
+// Percentile by nearest rank of sorted values, in milliseconds
+static double percentile_ms(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[index > 0 ? index - 1 : 0] / 1e6;
+}
+
+static bool start_receiver(Stream& stream) {
+    struct rist_ctx_options options = {0};
+    if (rist_receiver_create(&stream.receiver, RIST_PROFILE_MAIN, &options) != 0) {
+        std::cerr << "Failed to create RIST receiver" << std::endl;
+        return false;
+    }
+
+    struct rist_peer_config peer_config = {0};
+    char url[128];
+    snprintf(url, sizeof(url), "rist://@127.0.0.1:%d", stream.rist_port);
+    peer_config.address = url;
+    if (rist_peer_create(stream.receiver, &stream.receiver_peer, &peer_config) != 0 ||
+        rist_start(stream.receiver) != 0) {
+        std::cerr << "Failed to start RIST receiver on " << url << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Account for every TS packet of one received datagram
+static void consume(Stream& stream, const uint8_t* data, size_t size) {
+    int64_t now = now_ns();
+    stream.bytes += size;
+    for (size_t offset = 0; offset + TS_PACKET_SIZE <= size; offset += TS_PACKET_SIZE) {
+        const uint8_t* packet = data + offset;
+        if (packet[0] != TS_SYNC_BYTE) {
+            continue;
+        }
+
+        uint64_t seq;
+        int64_t sent_ns;
+        memcpy(&seq, packet + 4, sizeof(seq));
+        memcpy(&sent_ns, packet + 12, sizeof(sent_ns));
+        if (seq > stream.max_seq) {
+            continue;
+        }
+
+        if (seq >= stream.seen.size()) {
+            stream.seen.resize(std::max<size_t>(seq + 1, stream.seen.size() * 2));
+        }
+        if (stream.seen[seq]) {
+            ++stream.duplicates;
+            continue;
+        }
+        stream.seen[seq] = true;
+        ++stream.received;
+
+        int64_t transit = now - sent_ns;
+        stream.latencies.push_back(transit);
+        if (stream.last_transit >= 0) {
+            double d = std::abs(static_cast<double>(transit - stream.last_transit));
+            stream.jitter_ns += (d - stream.jitter_ns) / 16.0;
+        }
+        stream.last_transit = transit;
+    }
+}
+
+static void receive_loop(Stream& stream, const std::atomic<bool>& running) {
+    while (running) {
+        struct rist_data_block* block = nullptr;
+        int ret = rist_receiver_data_read2(stream.receiver, &block, 100);
+        if (ret > 0 && block) {
+            consume(stream, static_cast<const uint8_t*>(block->payload), block->payload_len);
+        }
+        if (block) {
+            rist_receiver_data_block_free2(&block);
+        }
+    }
+}
+
+static bool connect_caller(Stream& stream) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(stream.srt_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // The gateway's listener may not be up yet
+    auto deadline = Clock::now() + std::chrono::milliseconds(BENCH_CONNECT_TIMEOUT_MS);
+    while (Clock::now() < deadline) {
+        stream.caller = srt_create_socket();
+        int transtype = SRTT_LIVE;
+        srt_setsockopt(stream.caller, 0, SRTO_TRANSTYPE, &transtype, sizeof(transtype));
+        if (srt_connect(stream.caller, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            return true;
+        }
+        srt_close(stream.caller);
+        stream.caller = SRT_INVALID_SOCK;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    std::cerr << "Failed to connect to the gateway on port " << stream.srt_port << ": "
+              << srt_getlasterror_str() << std::endl;
+    return false;
+}
+
+// Send paced messages of synthetic TS for the configured duration
+static void send_loop(Stream& stream, const Options& options) {
+    char message[BENCH_TS_PER_MESSAGE * TS_PACKET_SIZE];
+    memset(message, 0xff, sizeof(message));
+    uint8_t cc = 0;
+
+    double messages_per_second = options.bitrate_kbps * 1000.0 / (sizeof(message) * 8.0);
+    auto interval = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / messages_per_second));
+    auto next = Clock::now();
+    auto end = next + std::chrono::seconds(options.duration_s);
+
+    while (next < end) {
+        std::this_thread::sleep_until(next);
+        next += interval;
+
+        int64_t sent_ns = now_ns();
+        for (int i = 0; i < BENCH_TS_PER_MESSAGE; i++) {
+            uint8_t* packet = reinterpret_cast<uint8_t*>(message) + i * TS_PACKET_SIZE;
+            packet[0] = TS_SYNC_BYTE;
+            packet[1] = (BENCH_PID >> 8) & 0x1f;
+            packet[2] = BENCH_PID & 0xff;
+            packet[3] = 0x10 | cc;
+            cc = (cc + 1) & 0x0f;
+            uint64_t seq = stream.sent + i;
+            memcpy(packet + 4, &seq, sizeof(seq));
+            memcpy(packet + 12, &sent_ns, sizeof(sent_ns));
+        }
+
+        if (srt_sendmsg(stream.caller, message, sizeof(message), -1, 1) < 0) {
+            ++stream.send_errors;
+        }
+        stream.sent += BENCH_TS_PER_MESSAGE;
+    }
+}
+
+static Config make_config(const Options& options, const Stream& stream) {
+    Config config;
+    config.mode = InputMode::SRT;
+    config.srt_mode = SRTMode::LISTENER;
+    config.name = "bench" + std::to_string(stream.index + 1);
+    config.listen_port = stream.srt_port;
+    config.rist_dst = "127.0.0.1";
+    config.rist_port = stream.rist_port;
+    config.rist_queue_depth = options.queue_depth;
+    config.ts_packets_per_datagram = options.ts_packets_per_datagram;
+    config.min_bitrate = options.bitrate_kbps;
+    config.max_bitrate = options.bitrate_kbps;
+
+    // Bitrate hints go to a loopback port nobody listens on
+    config.feedback_ip = "127.0.0.1";
+    config.feedback_port = options.base_port + 2000;
+
+    if (!options.trace_dir.empty()) {
+        config.latency_trace = 65536;
+    }
+    return config;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (srt_startup() < 0) {
+        std::cerr << "Failed to initialize SRT" << std::endl;
+        return 1;
+    }
+
+    std::vector<Stream> streams(options.streams);
+    for (int i = 0; i < options.streams; i++) {
+        streams[i].index = i;
+        streams[i].srt_port = options.base_port + i;
+        streams[i].rist_port = options.base_port + 1000 + 2 * i;
+        streams[i].max_seq = 2 * static_cast<uint64_t>(options.bitrate_kbps) * 1000 / 8 /
+                             TS_PACKET_SIZE * options.duration_s + BENCH_TS_PER_MESSAGE;
+        if (!start_receiver(streams[i])) {
+            return 1;
+        }
+    }
+
+    std::atomic<bool> receiving{true};
+    std::vector<std::thread> receivers;
+    for (auto& stream : streams) {
+        receivers.emplace_back(receive_loop, std::ref(stream), std::cref(receiving));
+    }
+
+    // The gateway under test, scheduled as in a multi-stream deployment
+    int stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int status = 0;
+    try {
+        WorkerPool pool(options.workers, stop_fd);
+        std::vector<std::shared_ptr<Pipeline>> pipelines;
+        for (const auto& stream : streams) {
+            Config config = make_config(options, stream);
+            auto pipeline = std::make_shared<Pipeline>(config, config.name);
+            pipeline->init();
+            pool.add(pipeline);
+            pipelines.push_back(pipeline);
+        }
+        std::thread gateway([&pool] { pool.run(); });
+
+        bool connected = true;
+        for (auto& stream : streams) {
+            connected &= connect_caller(stream);
+        }
+
+        if (connected) {
+            std::cout << "Sending " << options.streams << " x " << options.bitrate_kbps
+                      << " kbps for " << options.duration_s << " s" << std::endl;
+            std::vector<std::thread> senders;
+            for (auto& stream : streams) {
+                senders.emplace_back(send_loop, std::ref(stream), std::cref(options));
+            }
+            for (auto& sender : senders) {
+                sender.join();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.drain_ms));
+        } else {
+            status = 1;
+        }
+
+        if (!options.trace_dir.empty()) {
+            for (const auto& pipeline : pipelines) {
+                pipeline->dump_latency_trace(options.trace_dir);
+            }
+        }
+
+        uint64_t one = 1;
+        ssize_t ret = write(stop_fd, &one, sizeof(one));
+        (void)ret;
+        gateway.join();
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        status = 1;
+    }
+
+    receiving = false;
+    for (auto& receiver : receivers) {
+        receiver.join();
+    }
+
+    // Report
+    printf("%-8s %10s %10s %8s %10s %9s %9s %9s %9s\n", "stream", "sent", "received",
+           "loss%", "Mbps", "p50 ms", "p99 ms", "p999 ms", "jitter ms");
+    double total_mbps = 0.0;
+    for (auto& stream : streams) {
+        std::sort(stream.latencies.begin(), stream.latencies.end());
+        double loss = stream.sent > 0
+            ? 100.0 * (stream.sent - std::min(stream.sent, stream.received)) / stream.sent : 0.0;
+        double mbps = stream.bytes * 8.0 / options.duration_s / 1e6;
+        total_mbps += mbps;
+        printf("%-8d %10llu %10llu %8.3f %10.2f %9.2f %9.2f %9.2f %9.3f\n", stream.index + 1,
+               static_cast<unsigned long long>(stream.sent),
+               static_cast<unsigned long long>(stream.received), loss, mbps,
+               percentile_ms(stream.latencies, 0.50), percentile_ms(stream.latencies, 0.99),
+               percentile_ms(stream.latencies, 0.999), stream.jitter_ns / 1e6);
+        if (stream.send_errors > 0 || stream.duplicates > 0) {
+            printf("         %llu SRT send errors, %llu duplicates\n",
+                   static_cast<unsigned long long>(stream.send_errors),
+                   static_cast<unsigned long long>(stream.duplicates));
+        }
+        if (options.max_loss >= 0.0 && loss > options.max_loss) {
+            status = 1;
+        }
+    }
+    printf("total    %53.2f Mbps\n", total_mbps);
+
+    for (auto& stream : streams) {
+        if (stream.caller != SRT_INVALID_SOCK) {
+            srt_close(stream.caller);
+        }
+        if (stream.receiver) {
+            rist_destroy(stream.receiver);
+        }
+    }
+    close(stop_fd);
+    srt_cleanup();
+    return status;
+}
@@ -0,0 +1,444 @@
+// Microbenchmarks of the per-packet and per-sample code paths. Each case
+// is timed over several repetitions of a calibrated batch, and the results
+// are written as JSON so runs on different commits and CPUs can be diffed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/utsname.h>
+#include <nlohmann/json.hpp>
+
+#include "feedback.h"
+#include "latency_trace.h"
+#include "metrics.h"
+#include "network_utils.h"
+#include "packet_pool.h"
+#include "rate_controller.h"
+#include "rist_output.h"
+#include "spsc_ring.h"
+#include "ts_packetizer.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+// Size of one SRT live message, 7 TS packets
+#define MICRO_PAYLOAD_SIZE 1316
+// Send queue depth of the RIST output cases, the gateway default
+#define MICRO_QUEUE_DEPTH 1024
+// Destination of the RIST output cases; nothing needs to listen there
+#define MICRO_RIST_PORT 23000
+
+struct Options {
+    int repetitions = 5;
+    int min_time_ms = 100;      // Minimum duration of one repetition
+    std::string filter;         // Only run cases whose name contains this
+    std::string json_path = "micro_bench.json";
+    std::string label;          // Free-form tag stored with the results
+};
+
+// Runs a case for the given number of operations and returns the time
+// spent in the measured part, in nanoseconds
+using Body = std::function<int64_t(size_t iterations)>;
+
+struct Case {
+    std::string name;
+    std::string description;
+    Body body;
+    size_t max_iterations = 0;  // Cap for slow cases, 0 for none
+};
+
+struct Result {
+    std::string name;
+    std::string description;
+    size_t iterations = 0;      // Per repetition
+    std::vector<double> ns_per_op;
+};
+
+static int64_t elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+// Time a plain loop of fn
+template <typename Fn>
+static Body timed_loop(Fn fn) {
+    return [fn](size_t iterations) mutable {
+        auto start = Clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            fn(i);
+        }
+        return elapsed_ns(start);
+    };
+}
+
+// Keep a value alive so the compiler cannot drop the work producing it
+template <typename T>
+static void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Silences std::cout and std::cerr while alive, for code that logs per call
+class QuietStreams {
+public:
+    QuietStreams() : m_out(std::cout.rdbuf(&m_null)), m_err(std::cerr.rdbuf(&m_null)) {}
+    ~QuietStreams() {
+        std::cout.rdbuf(m_out);
+        std::cerr.rdbuf(m_err);
+    }
+
+private:
+    std::stringbuf m_null;
+    std::streambuf* m_out;
+    std::streambuf* m_err;
+};
+
+static Result run_case(const Case& c, const Options& options) {
+    Result result;
+    result.name = c.name;
+    result.description = c.description;
+
+    // Grow the batch until one repetition takes at least min_time_ms
+    size_t iterations = 1;
+    int64_t target_ns = static_cast<int64_t>(options.min_time_ms) * 1000000;
+    while (true) {
+        int64_t ns = c.body(iterations);
+        if (ns >= target_ns || (c.max_iterations && iterations >= c.max_iterations)) {
+            break;
+        }
+        size_t next = ns > 0 ? static_cast<size_t>(iterations * 1.2 * target_ns / ns) : iterations * 10;
+        iterations = std::max(iterations + 1, std::min(next, iterations * 10));
+        if (c.max_iterations) {
+            iterations = std::min(iterations, c.max_iterations);
+        }
+    }
+    result.iterations = iterations;
+
+    for (int r = 0; r < options.repetitions; r++) {
+        int64_t ns = c.body(iterations);
+        result.ns_per_op.push_back(static_cast<double>(ns) / iterations);
+    }
+    return result;
+}
+
+static std::string cpu_model() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    std::string part;
+    while (std::getline(cpuinfo, line)) {
+        // x86 names the model; ARM only gives implementer and part numbers
+        if (line.compare(0, 10, "model name") == 0 || line.compare(0, 8, "Hardware") == 0) {
+            return line.substr(line.find(':') + 2);
+        }
+        if (part.empty() && line.compare(0, 8, "CPU part") == 0) {
+            part = "ARM part " + line.substr(line.find(':') + 2);
+        }
+    }
+    return part.empty() ? "unknown" : part;
+}
+
+static json environment(const Options& options) {
+    struct utsname uts;
+    uname(&uts);
+    json env;
+    env["machine"] = uts.machine;
+    env["kernel"] = uts.release;
+    env["cpu"] = cpu_model();
+    env["cores"] = std::thread::hardware_concurrency();
+    env["compiler"] = __VERSION__;
+    env["timestamp"] = static_cast<int64_t>(time(nullptr));
+    if (!options.label.empty()) {
+        env["label"] = options.label;
+    }
+    return env;
+}
+
+static std::vector<Case> make_cases() {
+    std::vector<Case> cases;
+
+    cases.push_back({"packet_pool/acquire_release",
+                     "Take a pooled buffer and return it",
+                     [](size_t iterations) {
+                         PacketPool pool(64);
+                         auto start = Clock::now();
+                         for (size_t i = 0; i < iterations; i++) {
+                             PacketRef packet = pool.acquire();
+                             keep(packet.data());
+                         }
+                         return elapsed_ns(start);
+                     }});
+
+    cases.push_back({"spsc_ring/push_pop",
+                     "Publish one packet reference on a send queue and consume it",
+                     [](size_t iterations) {
+                         PacketPool pool(4);
+                         PacketRef packet = pool.acquire();
+                         SpscRing<PacketRef> ring(MICRO_QUEUE_DEPTH);
+                         auto start = Clock::now();
+                         for (size_t i = 0; i < iterations; i++) {
+                             *ring.write_slot() = packet;
+                             ring.commit_write();
+                             PacketRef* slot = ring.read_slot();
+                             slot->reset();
+                             ring.commit_read();
+                         }
+                         return elapsed_ns(start);
+                     }});
+
+    cases.push_back({"ts_packetizer/push_aligned",
+                     "Pass one aligned 1316-byte message through the TS packetizer",
+                     [](size_t iterations) {
+                         std::vector<char> payload(MICRO_PAYLOAD_SIZE, 0);
+                         for (size_t i = 0; i < payload.size(); i += TS_PACKET_SIZE) {
+                             payload[i] = TS_SYNC_BYTE;
+                         }
+                         size_t emitted = 0;
+                         TsPacketizer packetizer(7, std::chrono::milliseconds(5),
+                                                 [&emitted](const char*, size_t size) { emitted += size; });
+                         auto now = Clock::now();
+                         auto start = Clock::now();
+                         for (size_t i = 0; i < iterations; i++) {
+                             packetizer.push(payload.data(), payload.size(), now);
+                         }
+                         int64_t ns = elapsed_ns(start);
+                         keep(emitted);
+                         return ns;
+                     }});
+
+    // The ingest side of SRTInput::process_socket without the receive
+    // call: take a buffer, copy a message in and queue it on an output.
+    // Only batches that fit the queue are timed, so no packet is dropped.
+    cases.push_back({"ingest/copy_and_enqueue",
+                     "Copy a message into a pooled buffer and queue it on a RIST output",
+                     [](size_t iterations) {
+                         static std::shared_ptr<RistOutput> output;
+                         if (!output) {
+                             output = std::make_shared<RistOutput>("127.0.0.1", MICRO_RIST_PORT,
+                                                                   MICRO_QUEUE_DEPTH);
+                             output->set_packetizer(7, 5);
+                             output->init();
+                         }
+                         PacketPool pool(MICRO_QUEUE_DEPTH * 2);
+                         std::vector<char> payload(MICRO_PAYLOAD_SIZE, 0x47);
+                         size_t batch = MICRO_QUEUE_DEPTH / 2;
+                         int64_t total = 0;
+                         for (size_t done = 0; done < iterations; done += batch) {
+                             while (output->get_queue_stats().depth > 0) {
+                                 std::this_thread::yield();
+                             }
+                             size_t count = std::min(batch, iterations - done);
+                             auto start = Clock::now();
+                             for (size_t i = 0; i < count; i++) {
+                                 PacketRef packet = pool.acquire();
+                                 memcpy(packet.data(), payload.data(), payload.size());
+                                 packet.set_size(payload.size());
+                                 output->send_packet(packet);
+                             }
+                             total += elapsed_ns(start);
+                         }
+                         // The output outlives this call's pool, so the last
+                         // batch must be sent before the pool goes away
+                         while (output->get_queue_stats().depth > 0) {
+                             std::this_thread::yield();
+                         }
+                         return total;
+                     }});
+
+    // The sender thread: queue to librist write, measured as the time for
+    // the output to drain everything queued
+    cases.push_back({"rist_output/send_throughput",
+                     "Queue to rist_sender_data_write, per packet while the sender is saturated",
+                     [](size_t iterations) {
+                         static std::shared_ptr<RistOutput> output;
+                         if (!output) {
+                             output = std::make_shared<RistOutput>("127.0.0.1", MICRO_RIST_PORT + 2,
+                                                                   MICRO_QUEUE_DEPTH);
+                             output->set_packetizer(0, 0);
+                             output->init();
+                         }
+                         PacketPool pool(MICRO_QUEUE_DEPTH * 2);
+                         auto start = Clock::now();
+                         for (size_t i = 0; i < iterations; i++) {
+                             // Keep the queue full without dropping
+                             while (output->get_queue_stats().depth >= MICRO_QUEUE_DEPTH - 1) {
+                                 std::this_thread::yield();
+                             }
+                             PacketRef packet = pool.acquire();
+                             packet.set_size(MICRO_PAYLOAD_SIZE);
+                             output->send_packet(packet);
+                         }
+                         while (output->get_queue_stats().depth > 0) {
+                             std::this_thread::yield();
+                         }
+                         return elapsed_ns(start);
+                     }});
+
+    // Batches stay below the feedback queue size so no sample is dropped
+    cases.push_back({"feedback/process_stats",
+                     "Post one RIST stats sample to the feedback thread",
+                     [](size_t iterations) {
+                         static std::unique_ptr<Feedback> feedback;
+                         if (!feedback) {
+                             feedback = std::make_unique<Feedback>(1000, 8000, "127.0.0.1",
+                                                                   MICRO_RIST_PORT + 4, EncoderConfig());
+                         }
+                         const std::string route = "route0";
+                         size_t batch = FEEDBACK_QUEUE_SIZE / 2;
+                         int64_t total = 0;
+                         for (size_t done = 0; done < iterations; done += batch) {
+                             std::this_thread::sleep_for(std::chrono::microseconds(200));
+                             size_t count = std::min(batch, iterations - done);
+                             auto start = Clock::now();
+                             for (size_t i = 0; i < count; i++) {
+                                 feedback->process_stats(route, 4000000, 0.5f, 40);
+                             }
+                             total += elapsed_ns(start);
+                         }
+                         return total;
+                     }});
+
+    cases.push_back({"rate_controller/update",
+                     "Fold one route sample into rate control and read the target",
+                     [](size_t iterations) {
+                         RateController::Params params;
+                         params.min_bitrate = 1000;
+                         params.max_bitrate = 8000;
+                         RateController controller(params);
+                         const std::string routes[] = {"route0", "route1"};
+                         auto now = Clock::now();
+                         uint32_t target = 0;
+                         auto start = Clock::now();
+                         for (size_t i = 0; i < iterations; i++) {
+                             now += std::chrono::milliseconds(500);
+                             controller.update(routes[i & 1], (i % 7) * 0.3, 40.0 + (i % 5), 4000.0, now);
+                             target += controller.target_bitrate(now);
+                         }
+                         int64_t ns = elapsed_ns(start);
+                         keep(target);
+                         return ns;
+                     }});
+
+    cases.push_back({"metrics/counter_inc",
+                     "Increment a registered counter",
+                     timed_loop([counter = MetricsRegistry::global().counter(
+                                     "micro_bench_total", "Microbenchmark counter")](size_t) {
+                         counter->inc();
+                     })});
+
+    cases.push_back({"latency_trace/record",
+                     "Record one packet's latency sample",
+                     [](size_t iterations) {
+                         LatencyTrace trace(4096);
+                         LatencySample sample;
+                         auto start = Clock::now();
+                         for (size_t i = 0; i < iterations; i++) {
+                             sample.rx_ns = static_cast<int64_t>(i);
+                             trace.record(sample);
+                         }
+                         return elapsed_ns(start);
+                     }});
+
+    // Interface discovery runs once per pipeline start and reads the
+    // netlink-backed interface cache; its log output is silenced
+    cases.push_back({"network_utils/get_wan_interface_ips",
+                     "Discover WAN interface addresses",
+                     [](size_t iterations) {
+                         QuietStreams quiet;
+                         size_t found = 0;
+                         auto start = Clock::now();
+                         for (size_t i = 0; i < iterations; i++) {
+                             found += NetworkUtils::get_wan_interface_ips().size();
+                         }
+                         int64_t ns = elapsed_ns(start);
+                         keep(found);
+                         return ns;
+                     },
+                     1000});
+
+    return cases;
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --filter TEXT        only run cases whose name contains TEXT\n"
+              << "  --repetitions N      timed repetitions per case (default 5)\n"
+              << "  --min-time-ms MS     minimum duration of one repetition (default 100)\n"
+              << "  --json FILE          where to write results (default micro_bench.json)\n"
+              << "  --label TEXT         tag stored with the results, e.g. a commit id\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        const char* value = argv[++i];
+        if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--repetitions") {
+            options.repetitions = std::max(1, atoi(value));
+        } else if (arg == "--min-time-ms") {
+            options.min_time_ms = std::max(1, atoi(value));
+        } else if (arg == "--json") {
+            options.json_path = value;
+        } else if (arg == "--label") {
+            options.label = value;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    json results = json::array();
+    for (const auto& c : make_cases()) {
+        if (!options.filter.empty() && c.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+
+        Result result = run_case(c, options);
+        std::vector<double> sorted = result.ns_per_op;
+        std::sort(sorted.begin(), sorted.end());
+        double median = sorted[sorted.size() / 2];
+
+        printf("%-40s %12.1f ns/op  (min %.1f, max %.1f, %zu ops x %d)\n", result.name.c_str(),
+               median, sorted.front(), sorted.back(), result.iterations, options.repetitions);
+        fflush(stdout);
+
+        json entry;
+        entry["name"] = result.name;
+        entry["description"] = result.description;
+        entry["iterations"] = result.iterations;
+        entry["ns_per_op"] = {
+            {"median", median},
+            {"min", sorted.front()},
+            {"max", sorted.back()},
+            {"samples", result.ns_per_op},
+        };
+        entry["ops_per_sec"] = median > 0 ? 1e9 / median : 0.0;
+        results.push_back(entry);
+    }
+
+    json report;
+    report["environment"] = environment(options);
+    report["results"] = results;
+
+    std::ofstream out(options.json_path);
+    if (!out) {
+        std::cerr << "Failed to open " << options.json_path << std::endl;
+        return 1;
+    }
+    out << report.dump(2) << std::endl;
+    std::cout << "Results written to " << options.json_path << std::endl;
+    return 0;
+}
@@ -1,13 +1,15 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 // Input modes
 enum class InputMode {
     SRT,
-    RTSP
+    RTSP,
+    UDP
 };
 
 // SRT specific modes
@@ -17,31 +19,126 @@ enum class SRTMode {
     MULTI
 };
 
+// How multi-route mode maps routes onto RIST outputs
+enum class MultiOutput {
+    SPLIT,       // One output per route
+    BONDED,      // One output striped across all routes by weight
+    REDUNDANT    // Every packet duplicated onto all routes
+};
+
 // Multi-route configuration for each interface
 struct MultiRouteConfig {
     std::string interface_ip;
     std::string rist_dst;
     int rist_port;
+    int weight = 1;               // Share of traffic when routes are bonded
+};
+
+// RIST destination of one stream ID on a routed SRT listener
+struct StreamRouteConfig {
+    std::string stream_id;
+    std::string rist_dst;
+    int rist_port = 0;
+};
+
+// How a UDP input treats RTP framing
+enum class RtpMode {
+    AUTO,      // Strip RTP headers from datagrams that do not start with TS
+    STRIP,     // Every datagram carries an RTP header
+    OFF        // Datagrams are raw TS
+};
+
+// Plain UDP or RTP over UDP input, unicast or multicast
+struct UdpInputConfig {
+    std::string address = "0.0.0.0";  // Local address, or the multicast group to join
+    int port = 0;
+    std::string interface_ip;     // Interface for the multicast join, empty for any
+    std::string source_ip;        // Source-specific multicast sender, empty for any
+    RtpMode rtp = RtpMode::AUTO;
+    int rcvbuf = 4 * 1024 * 1024; // Socket receive buffer, bytes
+};
+
+// Plain UDP or multicast copy of the stream for local decoders
+struct UdpOutputConfig {
+    std::string dst;
+    int port = 0;
+    int ttl = 0;                  // Hop limit, 0 for the system default
+    std::string interface_ip;     // Source interface, empty for the routing table's choice
+};
+
+// Timeshift recording of everything received to a ring file
+struct RecordConfig {
+    std::string path;             // Ring file, empty to disable recording
+    int size_mb = 256;            // Preallocated ring size
+    int flush_ms = 1000;          // Longest a partly filled block stays in memory
+    int replay_seconds = 120;     // How far back a replay starts
+    double replay_speed = 1.0;    // Replay pace relative to real time
+    std::string replay_dst;       // RIST destination for replays, empty for rist_dst
+    int replay_port = 0;          // 0 disables replay
+};
+
+// RTSP ingest and MPEG-TS remux settings
+struct RtspConfig {
+    std::string transport = "tcp";   // tcp, udp or udp_multicast
+    int io_timeout_ms = 5000;        // Deadline for any blocking open or read
+    int64_t probesize = 0;           // Probe size in bytes, 0 for FFmpeg's default
+    int analyzeduration_ms = -1;     // Stream analysis time, -1 for FFmpeg's default
+    bool nobuffer = false;           // fflags nobuffer
+    bool cache_stream_info = false;  // Skip probing on reconnect using the last result
+    int mux_delay_ms = 700;          // Muxer max_delay
+    int mux_interleave_ms = -1;      // Interleave bound, -1 to follow mux_delay_ms
+    bool mux_flush_packets = false;  // Flush the muxer after every packet
+};
+
+// Encoder control settings; the address is feedback_ip/feedback_port
+struct EncoderConfig {
+    // udp_http (GET request line in a datagram), udp (text datagrams) or
+    // http (keep-alive TCP)
+    std::string protocol = "udp_http";
+    std::string index = "stream1";   // Encoder stream being controlled
+    int width = 1920;
+    int height = 1080;
+    int min_interval_ms = 500;       // Rate limit between bitrate changes
 };
 
 // Configuration structure
 struct Config {
     // General settings
     InputMode mode;
+    std::string name;             // Stream name used in logs
     
     // SRT settings
     SRTMode srt_mode;
     std::string input_url;
     int listen_port;
     bool filter_to_wan = true;
+    int srt_recv_budget = 64;    // Messages drained per socket per wakeup
+    bool srt_groups = false;      // Accept bonded socket groups on listeners
+    std::vector<StreamRouteConfig> stream_routes;  // Listener routing by stream ID, empty for none
+    
+    // RTSP settings
+    RtspConfig rtsp;
+    
+    // UDP input settings
+    UdpInputConfig udp_input;
     
     // RIST settings
     std::string rist_dst;
     int rist_port;
+    int rist_queue_depth = 1024;  // Packet slots between ingest and sender threads
+    int ts_packets_per_datagram = 7;  // TS packets per RIST datagram, 0 to disable
+    int ts_flush_ms = 5;          // Deadline for sending a partial datagram
+    
+    // Local UDP/multicast fan-out, fed every received packet
+    std::vector<UdpOutputConfig> udp_outputs;
+    
+    // Timeshift recording and replay
+    RecordConfig record;
 
     // Feedback settings
     std::string feedback_ip = "192.168.1.50";
     int feedback_port = 5005;
+    EncoderConfig encoder;
     
     // Bitrate settings
     int min_bitrate;
@@ -49,6 +146,19 @@ struct Config {
     
     // Multi-route settings
     std::vector<MultiRouteConfig> multi_routes;
+    MultiOutput multi_output = MultiOutput::SPLIT;
+    
+    // Diagnostics
+    int latency_trace = 0;        // Per-packet latency trace entries, 0 to disable
+    
+    // Independent pipelines from the "streams" array; when non-empty the
+    // settings above are unused and each entry describes one relay
+    std::vector<Config> streams;
+    int workers = 0;              // Worker threads, 0 for one per core
+    
+    // Process-wide settings, only read from the top level
+    int metrics_port = 0;         // Loopback /metrics endpoint, 0 to disable
+    std::string latency_trace_dir = "/tmp";  // Where SIGUSR1 writes latency traces
 };
 
 #endif // CONFIG_H
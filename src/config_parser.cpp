@@ -7,6 +7,301 @@
 
 using json = nlohmann::json;
 
+static const json& require(const json& obj, const std::string& key) {
+    if (!obj.contains(key)) {
+        throw std::runtime_error("Missing required key '" + key + "'");
+    }
+    return obj.at(key);
+}
+
+// Parse RTSP ingest settings; a profile sets defaults that explicit keys override
+static void parse_rtsp(const json& j, RtspConfig& rtsp) {
+    std::string profile = j.value("rtsp_profile", "default");
+    if (profile == "low_latency") {
+        rtsp.probesize = 32768;
+        rtsp.analyzeduration_ms = 200;
+        rtsp.nobuffer = true;
+        rtsp.cache_stream_info = true;
+        rtsp.mux_delay_ms = 0;
+        // Keep a bound, a stalled stream must not hold back the others
+        rtsp.mux_interleave_ms = 5;
+        rtsp.mux_flush_packets = true;
+    } else if (profile != "default") {
+        throw std::runtime_error("Invalid RTSP profile: " + profile);
+    }
+
+    rtsp.transport = j.value("rtsp_transport", rtsp.transport);
+    if (rtsp.transport != "tcp" && rtsp.transport != "udp" && rtsp.transport != "udp_multicast") {
+        throw std::runtime_error("Invalid RTSP transport: " + rtsp.transport);
+    }
+
+    rtsp.io_timeout_ms = j.value("rtsp_timeout_ms", rtsp.io_timeout_ms);
+    if (rtsp.io_timeout_ms <= 0) {
+        throw std::runtime_error("rtsp_timeout_ms must be positive");
+    }
+
+    rtsp.probesize = j.value("rtsp_probesize", rtsp.probesize);
+    rtsp.analyzeduration_ms = j.value("rtsp_analyzeduration_ms", rtsp.analyzeduration_ms);
+    rtsp.nobuffer = j.value("rtsp_nobuffer", rtsp.nobuffer);
+    rtsp.cache_stream_info = j.value("rtsp_cache_stream_info", rtsp.cache_stream_info);
+    rtsp.mux_delay_ms = j.value("rtsp_mux_delay_ms", rtsp.mux_delay_ms);
+    rtsp.mux_interleave_ms = j.value("rtsp_mux_interleave_ms", rtsp.mux_interleave_ms);
+    rtsp.mux_flush_packets = j.value("rtsp_flush_packets", rtsp.mux_flush_packets);
+    if (rtsp.mux_delay_ms < 0) {
+        throw std::runtime_error("rtsp_mux_delay_ms must not be negative");
+    }
+    if (rtsp.mux_interleave_ms < -1) {
+        throw std::runtime_error("rtsp_mux_interleave_ms must not be negative");
+    }
+}
+
+// Parse a udp:// or rtp:// input URL and the UDP input settings
+static void parse_udp(const json& j, const std::string& url, UdpInputConfig& udp) {
+    std::string scheme;
+    std::string rest = url;
+    size_t pos = url.find("://");
+    if (pos != std::string::npos) {
+        scheme = url.substr(0, pos);
+        rest = url.substr(pos + 3);
+    }
+    if (scheme != "udp" && scheme != "rtp") {
+        throw std::runtime_error("UDP input URL must start with udp:// or rtp://: " + url);
+    }
+
+    // "@" marks a local address in FFmpeg-style URLs
+    if (!rest.empty() && rest[0] == '@') {
+        rest = rest.substr(1);
+    }
+    pos = rest.rfind(':');
+    if (pos == std::string::npos) {
+        throw std::runtime_error("UDP input URL has no port: " + url);
+    }
+    if (pos > 0) {
+        udp.address = rest.substr(0, pos);
+    }
+    try {
+        udp.port = std::stoi(rest.substr(pos + 1));
+    } catch (std::logic_error&) {
+        udp.port = 0;
+    }
+    if (udp.port <= 0 || udp.port > 65535) {
+        throw std::runtime_error("Invalid UDP input port: " + url);
+    }
+
+    udp.rtp = scheme == "rtp" ? RtpMode::STRIP : RtpMode::AUTO;
+    if (j.contains("udp_rtp")) {
+        std::string rtp = j.at("udp_rtp").get<std::string>();
+        if (rtp == "auto") {
+            udp.rtp = RtpMode::AUTO;
+        } else if (rtp == "strip") {
+            udp.rtp = RtpMode::STRIP;
+        } else if (rtp == "off") {
+            udp.rtp = RtpMode::OFF;
+        } else {
+            throw std::runtime_error("Invalid udp_rtp: " + rtp);
+        }
+    }
+
+    udp.interface_ip = j.value("udp_interface", udp.interface_ip);
+    udp.source_ip = j.value("udp_source", udp.source_ip);
+    udp.rcvbuf = j.value("udp_rcvbuf", udp.rcvbuf);
+    if (udp.rcvbuf <= 0) {
+        throw std::runtime_error("udp_rcvbuf must be positive");
+    }
+}
+
+// Parse the timeshift recording settings
+static void parse_record(const json& j, const std::string& rist_dst, RecordConfig& record) {
+    record.path = j.value("record_path", record.path);
+    record.size_mb = j.value("record_size_mb", record.size_mb);
+    record.flush_ms = j.value("record_flush_ms", record.flush_ms);
+    record.replay_seconds = j.value("record_replay_seconds", record.replay_seconds);
+    record.replay_speed = j.value("record_replay_speed", record.replay_speed);
+    record.replay_dst = j.value("record_replay_dst", rist_dst);
+    record.replay_port = j.value("record_replay_port", record.replay_port);
+    if (record.size_mb < 2) {
+        throw std::runtime_error("record_size_mb must be at least 2");
+    }
+    if (record.flush_ms <= 0 || record.replay_seconds <= 0 || record.replay_speed <= 0) {
+        throw std::runtime_error("record_flush_ms, record_replay_seconds and record_replay_speed must be positive");
+    }
+    if (record.replay_port < 0 || record.replay_port > 65535) {
+        throw std::runtime_error("record_replay_port must be between 0 and 65535");
+    }
+    if (record.replay_port > 0 && record.replay_dst.empty()) {
+        throw std::runtime_error("record_replay_dst is required when rist_dst is not set");
+    }
+}
+
+// Parse encoder control settings
+static void parse_encoder(const json& j, EncoderConfig& encoder) {
+    encoder.protocol = j.value("encoder_protocol", encoder.protocol);
+    if (encoder.protocol != "udp_http" && encoder.protocol != "udp" &&
+        encoder.protocol != "http") {
+        throw std::runtime_error("Invalid encoder protocol: " + encoder.protocol);
+    }
+
+    encoder.index = j.value("encoder_index", encoder.index);
+    encoder.width = j.value("encoder_width", encoder.width);
+    encoder.height = j.value("encoder_height", encoder.height);
+    encoder.min_interval_ms = j.value("encoder_min_interval_ms", encoder.min_interval_ms);
+    if (encoder.width <= 0 || encoder.height <= 0) {
+        throw std::runtime_error("encoder_width and encoder_height must be positive");
+    }
+    if (encoder.min_interval_ms < 0) {
+        throw std::runtime_error("encoder_min_interval_ms must not be negative");
+    }
+}
+
+// Parse the settings of a single relay pipeline
+static void parse_stream(const json& j, Config& config) {
+    // Parse mode
+    std::string mode = require(j, "mode").get<std::string>();
+    if (mode == "srt") {
+        config.mode = InputMode::SRT;
+
+        // Parse SRT mode
+        std::string srt_mode = require(j, "srt_mode").get<std::string>();
+        if (srt_mode == "caller") {
+            config.srt_mode = SRTMode::CALLER;
+            config.input_url = require(j, "input_url").get<std::string>();
+        } else if (srt_mode == "listener") {
+            config.srt_mode = SRTMode::LISTENER;
+            config.listen_port = require(j, "listen_port").get<int>();
+
+            // Callers told apart by SRTO_STREAMID, each forwarded to its
+            // own destination
+            if (j.contains("srt_stream_routes")) {
+                const auto& routes = j.at("srt_stream_routes");
+                if (!routes.is_object() || routes.empty()) {
+                    throw std::runtime_error("srt_stream_routes must be a non-empty object");
+                }
+                for (const auto& route : routes.items()) {
+                    StreamRouteConfig src;
+                    src.stream_id = route.key();
+                    src.rist_dst = route.value().value("rist_dst", j.value("rist_dst", std::string()));
+                    src.rist_port = require(route.value(), "rist_port").get<int>();
+                    if (src.rist_dst.empty()) {
+                        throw std::runtime_error("No rist_dst for stream ID '" + src.stream_id + "'");
+                    }
+                    config.stream_routes.push_back(src);
+                }
+            }
+        } else if (srt_mode == "multi") {
+            config.srt_mode = SRTMode::MULTI;
+            config.listen_port = require(j, "listen_port").get<int>();
+            config.filter_to_wan = j.value("filter_to_wan", true);
+
+            // Parse multi-route configuration
+            auto routes = require(j, "multi_route");
+            for (const auto& route : routes) {
+                MultiRouteConfig mrc;
+                mrc.interface_ip = require(route, "interface_ip").get<std::string>();
+                mrc.rist_dst = require(route, "rist_dst").get<std::string>();
+                mrc.rist_port = require(route, "rist_port").get<int>();
+                mrc.weight = route.value("weight", mrc.weight);
+                if (mrc.weight <= 0) {
+                    throw std::runtime_error("multi_route weight must be positive");
+                }
+                config.multi_routes.push_back(mrc);
+            }
+
+            // "split" gives each route its own RIST output, "bonded" spreads
+            // one output over all routes by weight, "redundant" sends every
+            // packet over all routes
+            std::string multi_output = j.value("multi_output", std::string("split"));
+            if (multi_output == "split") {
+                config.multi_output = MultiOutput::SPLIT;
+            } else if (multi_output == "bonded") {
+                config.multi_output = MultiOutput::BONDED;
+            } else if (multi_output == "redundant") {
+                if (config.multi_routes.size() < 2) {
+                    throw std::runtime_error("multi_output redundant needs at least two routes");
+                }
+                config.multi_output = MultiOutput::REDUNDANT;
+            } else {
+                throw std::runtime_error("Invalid multi_output: " + multi_output);
+            }
+        } else {
+            throw std::runtime_error("Invalid SRT mode: " + srt_mode);
+        }
+
+        config.srt_recv_budget = j.value("srt_recv_budget", config.srt_recv_budget);
+        if (config.srt_recv_budget <= 0) {
+            throw std::runtime_error("srt_recv_budget must be positive");
+        }
+
+        config.srt_groups = j.value("srt_groups", config.srt_groups);
+        if (config.srt_groups && config.srt_mode == SRTMode::CALLER) {
+            throw std::runtime_error("srt_groups needs a listener or multi srt_mode");
+        }
+    } else if (mode == "rtsp") {
+        config.mode = InputMode::RTSP;
+        config.input_url = require(j, "input_url").get<std::string>();
+        parse_rtsp(j, config.rtsp);
+    } else if (mode == "udp") {
+        config.mode = InputMode::UDP;
+        config.input_url = require(j, "input_url").get<std::string>();
+        parse_udp(j, config.input_url, config.udp_input);
+    } else {
+        throw std::runtime_error("Invalid mode: " + mode);
+    }
+
+    // Parse common parameters
+    bool routed = !config.stream_routes.empty();
+    if ((config.mode != InputMode::SRT || config.srt_mode != SRTMode::MULTI) && !routed) {
+        config.rist_dst = require(j, "rist_dst").get<std::string>();
+        config.rist_port = require(j, "rist_port").get<int>();
+    }
+
+    config.rist_queue_depth = j.value("rist_queue_depth", config.rist_queue_depth);
+    if (config.rist_queue_depth <= 0) {
+        throw std::runtime_error("rist_queue_depth must be positive");
+    }
+
+    config.ts_packets_per_datagram = j.value("ts_packets_per_datagram", config.ts_packets_per_datagram);
+    config.ts_flush_ms = j.value("ts_flush_ms", config.ts_flush_ms);
+    if (config.ts_packets_per_datagram < 0 || config.ts_flush_ms < 0) {
+        throw std::runtime_error("ts_packets_per_datagram and ts_flush_ms must not be negative");
+    }
+
+    if (j.contains("udp_outputs")) {
+        for (const auto& output : j.at("udp_outputs")) {
+            UdpOutputConfig udp;
+            udp.dst = require(output, "dst").get<std::string>();
+            udp.port = require(output, "port").get<int>();
+            udp.ttl = output.value("ttl", udp.ttl);
+            udp.interface_ip = output.value("interface_ip", udp.interface_ip);
+            if (udp.port <= 0 || udp.port > 65535) {
+                throw std::runtime_error("udp_outputs port must be between 1 and 65535");
+            }
+            if (udp.ttl < 0 || udp.ttl > 255) {
+                throw std::runtime_error("udp_outputs ttl must be between 0 and 255");
+            }
+            config.udp_outputs.push_back(udp);
+        }
+    }
+
+    parse_record(j, config.rist_dst, config.record);
+    if (routed && (!config.udp_outputs.empty() || !config.record.path.empty())) {
+        // Both would receive every caller's TS interleaved
+        throw std::runtime_error("udp_outputs and record_path cannot be used with srt_stream_routes");
+    }
+
+    config.min_bitrate = require(j, "min_bitrate").get<int>();
+    config.max_bitrate = require(j, "max_bitrate").get<int>();
+
+    // Parse feedback settings
+    config.feedback_ip = j.value("feedback_ip", config.feedback_ip);
+    config.feedback_port = j.value("feedback_port", config.feedback_port);
+    parse_encoder(j, config.encoder);
+
+    config.latency_trace = j.value("latency_trace", config.latency_trace);
+    if (config.latency_trace < 0) {
+        throw std::runtime_error("latency_trace must not be negative");
+    }
+}
+
 Config parse_config(const std::string& config_path) {
     Config config;
 
@@ -19,62 +314,54 @@ Config parse_config(const std::string& config_path) {
         json j;
         config_file >> j;
 
-        auto require = [&](const json &obj, const std::string &key) -> const json & {
-            if (!obj.contains(key)) {
-                throw std::runtime_error("Missing required key '" + key + "'");
-            }
-            return obj.at(key);
-        };
-
-        // Parse mode
-        std::string mode = require(j, "mode").get<std::string>();
-        if (mode == "srt") {
-            config.mode = InputMode::SRT;
-
-            // Parse SRT mode
-            std::string srt_mode = require(j, "srt_mode").get<std::string>();
-            if (srt_mode == "caller") {
-                config.srt_mode = SRTMode::CALLER;
-                config.input_url = require(j, "input_url").get<std::string>();
-            } else if (srt_mode == "listener") {
-                config.srt_mode = SRTMode::LISTENER;
-                config.listen_port = require(j, "listen_port").get<int>();
-            } else if (srt_mode == "multi") {
-                config.srt_mode = SRTMode::MULTI;
-                config.listen_port = require(j, "listen_port").get<int>();
-                config.filter_to_wan = j.value("filter_to_wan", true);
-
-                // Parse multi-route configuration
-                auto routes = require(j, "multi_route");
-                for (const auto& route : routes) {
-                    MultiRouteConfig mrc;
-                    mrc.interface_ip = require(route, "interface_ip").get<std::string>();
-                    mrc.rist_dst = require(route, "rist_dst").get<std::string>();
-                    mrc.rist_port = require(route, "rist_port").get<int>();
-                    config.multi_routes.push_back(mrc);
-                }
-            } else {
-                throw std::runtime_error("Invalid SRT mode: " + srt_mode);
-            }
-        } else if (mode == "rtsp") {
-            config.mode = InputMode::RTSP;
-            config.input_url = require(j, "input_url").get<std::string>();
-        } else {
-            throw std::runtime_error("Invalid mode: " + mode);
+        config.metrics_port = j.value("metrics_port", config.metrics_port);
+        if (config.metrics_port < 0 || config.metrics_port > 65535) {
+            throw std::runtime_error("metrics_port must be between 0 and 65535");
         }
+        config.latency_trace_dir = j.value("latency_trace_dir", config.latency_trace_dir);
+
+        if (!j.contains("streams")) {
+            parse_stream(j, config);
+            return config;
+        }
+
+        // Top-level keys act as defaults that each stream entry overrides
+        config.workers = j.value("workers", config.workers);
+        json defaults = j;
+        defaults.erase("streams");
+        defaults.erase("workers");
+        defaults.erase("metrics_port");
+        defaults.erase("latency_trace_dir");
 
-        // Parse common parameters
-        if (config.mode != InputMode::SRT || config.srt_mode != SRTMode::MULTI) {
-            config.rist_dst = require(j, "rist_dst").get<std::string>();
-            config.rist_port = require(j, "rist_port").get<int>();
+        const auto& streams = j.at("streams");
+        if (!streams.is_array() || streams.empty()) {
+            throw std::runtime_error("'streams' must be a non-empty array");
         }
 
-        config.min_bitrate = require(j, "min_bitrate").get<int>();
-        config.max_bitrate = require(j, "max_bitrate").get<int>();
+        for (size_t i = 0; i < streams.size(); i++) {
+            json merged = defaults;
+            merged.update(streams[i]);
 
-        // Parse feedback settings
-        config.feedback_ip = j.value("feedback_ip", config.feedback_ip);
-        config.feedback_port = j.value("feedback_port", config.feedback_port);
+            Config stream;
+            stream.name = merged.value("name", "stream" + std::to_string(i + 1));
+            try {
+                parse_stream(merged, stream);
+            } catch (std::runtime_error& e) {
+                throw std::runtime_error("Stream '" + stream.name + "': " + e.what());
+            }
+            config.streams.push_back(stream);
+        }
+
+        // Streams inheriting one record_path would overwrite each other
+        for (size_t i = 0; i < config.streams.size(); i++) {
+            for (size_t k = 0; k < i; k++) {
+                const std::string& path = config.streams[i].record.path;
+                if (!path.empty() && path == config.streams[k].record.path) {
+                    throw std::runtime_error("Streams '" + config.streams[k].name + "' and '" +
+                                             config.streams[i].name + "' record to the same file");
+                }
+            }
+        }
 
     } catch (json::exception& e) {
         throw std::runtime_error("JSON parsing error: " + std::string(e.what()));
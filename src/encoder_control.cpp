@@ -0,0 +1,440 @@
+#include "encoder_control.h"
+#include <iostream>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+// Time allowed for connecting and for each request/response exchange
+#define ENCODER_HTTP_TIMEOUT_MS 2000
+// Wait before retrying an adapter whose last delivery failed
+#define ENCODER_FAILURE_BACKOFF_MS 1000
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+EncoderAdapter::EncoderAdapter(const char* protocol) {
+    auto& metrics = MetricsRegistry::global();
+    std::string labels = metric_label("protocol", protocol);
+    m_sent = metrics.counter("encoder_bitrate_updates_total", "Bitrate changes delivered to the encoder", labels);
+    m_failed = metrics.counter("encoder_bitrate_failures_total", "Failed bitrate deliveries", labels);
+}
+
+void EncoderAdapter::record_success(uint32_t bitrate_kbps) {
+    m_delivered = bitrate_kbps;
+    m_failures = 0;
+    m_sent->inc();
+}
+
+void EncoderAdapter::record_failure() {
+    ++m_failures;
+    m_failed->inc();
+}
+
+UdpTextAdapter::UdpTextAdapter(const struct sockaddr_in& dest, const std::string& host,
+                               const EncoderConfig& config)
+    : EncoderAdapter(config.protocol.c_str()), m_http(config.protocol == "udp_http"),
+      m_host(host), m_config(config) {
+    // Connected socket, so each send needs no address
+    m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0 || !set_nonblocking(m_fd) ||
+        connect(m_fd, (const struct sockaddr*)&dest, sizeof(dest)) != 0) {
+        spdlog::error("Failed to set up UDP encoder control: {}", strerror(errno));
+        if (m_fd >= 0) {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+}
+
+UdpTextAdapter::~UdpTextAdapter() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool UdpTextAdapter::ready(Clock::time_point now) const {
+    (void)now;
+    return m_fd >= 0;
+}
+
+bool UdpTextAdapter::send(uint32_t bitrate_kbps, Clock::time_point now) {
+    (void)now;
+    int len;
+    if (m_http) {
+        len = snprintf(m_message, sizeof(m_message),
+                       "GET /ctrl/stream_setting?index=%s&width=%d&height=%d&bitrate=%llu HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "\r\n",
+                       m_config.index.c_str(), m_config.width, m_config.height,
+                       static_cast<unsigned long long>(bitrate_kbps) * 1000, // Convert to bps
+                       m_host.c_str());
+    } else {
+        len = snprintf(m_message, sizeof(m_message), "index: %s\nbitrate_hint: %u kbps\n",
+                       m_config.index.c_str(), bitrate_kbps);
+    }
+    if (len < 0 || static_cast<size_t>(len) >= sizeof(m_message) ||
+        ::send(m_fd, m_message, len, MSG_DONTWAIT) < 0) {
+        record_failure();
+        spdlog::error("Failed to send UDP encoder control: {}", strerror(errno));
+        return false;
+    }
+
+    record_success(bitrate_kbps);
+    spdlog::info("Sent bitrate {} kbps to encoder over UDP", bitrate_kbps);
+    return true;
+}
+
+int UdpTextAdapter::poll_fd(short& events) const {
+    events = 0;
+    return -1;
+}
+
+void UdpTextAdapter::handle_events(short revents, Clock::time_point now) {
+    (void)revents;
+    (void)now;
+}
+
+HttpAdapter::HttpAdapter(const struct sockaddr_in& dest, const std::string& host,
+                         const EncoderConfig& config)
+    : EncoderAdapter("http"), m_dest(dest), m_host(host), m_config(config) {
+}
+
+HttpAdapter::~HttpAdapter() {
+    close_socket();
+}
+
+void HttpAdapter::close_socket() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_state = State::DISCONNECTED;
+    m_deadline = Clock::time_point::max();
+}
+
+void HttpAdapter::fail(const char* reason) {
+    record_failure();
+    spdlog::error("HTTP encoder control to {}: {}", m_host, reason);
+    close_socket();
+}
+
+bool HttpAdapter::ready(Clock::time_point now) const {
+    (void)now;
+    return m_state == State::DISCONNECTED || m_state == State::IDLE;
+}
+
+bool HttpAdapter::send(uint32_t bitrate_kbps, Clock::time_point now) {
+    int len = snprintf(m_request, sizeof(m_request),
+                       "GET /ctrl/stream_setting?index=%s&width=%d&height=%d&bitrate=%llu HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "Connection: keep-alive\r\n"
+                       "\r\n",
+                       m_config.index.c_str(), m_config.width, m_config.height,
+                       static_cast<unsigned long long>(bitrate_kbps) * 1000, // Convert to bps
+                       m_host.c_str());
+    if (len < 0 || static_cast<size_t>(len) >= sizeof(m_request)) {
+        record_failure();
+        spdlog::error("HTTP encoder control request too long");
+        return false;
+    }
+    m_request_size = len;
+    m_request_sent = 0;
+    m_response_size = 0;
+    m_pending = bitrate_kbps;
+    m_deadline = now + std::chrono::milliseconds(ENCODER_HTTP_TIMEOUT_MS);
+
+    if (m_state == State::IDLE) {
+        m_state = State::SENDING;
+        write_request(now);
+        return m_state != State::DISCONNECTED;
+    }
+
+    // Open the persistent connection without blocking
+    m_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0 || !set_nonblocking(m_fd)) {
+        fail(strerror(errno));
+        return false;
+    }
+    int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(m_fd, (const struct sockaddr*)&m_dest, sizeof(m_dest)) == 0) {
+        m_state = State::SENDING;
+        write_request(now);
+    } else if (errno == EINPROGRESS) {
+        m_state = State::CONNECTING;
+    } else {
+        fail(strerror(errno));
+        return false;
+    }
+    return m_state != State::DISCONNECTED;
+}
+
+int HttpAdapter::poll_fd(short& events) const {
+    switch (m_state) {
+        case State::CONNECTING:
+        case State::SENDING:
+            events = POLLOUT;
+            return m_fd;
+        case State::RECEIVING:
+        case State::IDLE:
+            // Watch idle connections too, to notice the server closing them
+            events = POLLIN;
+            return m_fd;
+        default:
+            events = 0;
+            return -1;
+    }
+}
+
+void HttpAdapter::handle_events(short revents, Clock::time_point now) {
+    if (m_state == State::CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+            fail(strerror(err ? err : errno));
+            return;
+        }
+        m_state = State::SENDING;
+    }
+
+    if (m_state == State::SENDING && (revents & (POLLOUT | POLLERR | POLLHUP))) {
+        write_request(now);
+    } else if ((m_state == State::RECEIVING || m_state == State::IDLE) &&
+               (revents & (POLLIN | POLLERR | POLLHUP))) {
+        read_response(now);
+    }
+}
+
+void HttpAdapter::write_request(Clock::time_point now) {
+    (void)now;
+    while (m_request_sent < m_request_size) {
+        ssize_t sent = ::send(m_fd, m_request + m_request_sent,
+                              m_request_size - m_request_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            fail(strerror(errno));
+            return;
+        }
+        m_request_sent += sent;
+    }
+    m_state = State::RECEIVING;
+}
+
+void HttpAdapter::read_response(Clock::time_point now) {
+    (void)now;
+    for (;;) {
+        ssize_t got = recv(m_fd, m_response + m_response_size,
+                           sizeof(m_response) - 1 - m_response_size, 0);
+        if (got == 0) {
+            if (m_state == State::IDLE) {
+                // Server closed an idle keep-alive connection, reconnect on
+                // the next request without counting a failure
+                close_socket();
+            } else {
+                fail("connection closed before response");
+            }
+            return;
+        }
+        if (got < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            fail(strerror(errno));
+            return;
+        }
+        if (m_state == State::IDLE) {
+            // Nothing is expected between requests
+            m_response_size = 0;
+            continue;
+        }
+        m_response_size += got;
+        if (m_response_size == sizeof(m_response) - 1) {
+            break;
+        }
+    }
+    if (m_state != State::RECEIVING) {
+        return;
+    }
+    m_response[m_response_size] = '\0';
+
+    // Wait for the full header, then for Content-Length bytes of body
+    char* header_end = strstr(m_response, "\r\n\r\n");
+    if (!header_end) {
+        if (m_response_size == sizeof(m_response) - 1) {
+            fail("response header too large");
+        }
+        return;
+    }
+    size_t header_size = header_end + 4 - m_response;
+
+    int status = 0;
+    if (sscanf(m_response, "HTTP/%*d.%*d %d", &status) != 1) {
+        fail("malformed response");
+        return;
+    }
+
+    size_t content_length = 0;
+    bool keep_alive = true;
+    for (char* line = strstr(m_response, "\r\n"); line && line < header_end;
+         line = strstr(line + 2, "\r\n")) {
+        const char* field = line + 2;
+        if (strncasecmp(field, "Content-Length:", 15) == 0) {
+            content_length = strtoul(field + 15, nullptr, 10);
+        } else if (strncasecmp(field, "Connection:", 11) == 0) {
+            const char* value = field + 11;
+            while (*value == ' ') {
+                ++value;
+            }
+            keep_alive = strncasecmp(value, "close", 5) != 0;
+        }
+    }
+
+    if (m_response_size < header_size + content_length) {
+        if (m_response_size == sizeof(m_response) - 1) {
+            // Body will not fit; the status is all that matters, so stop
+            // reusing a connection left mid-body
+            keep_alive = false;
+        } else {
+            return;
+        }
+    }
+
+    if (status >= 200 && status < 300) {
+        record_success(m_pending);
+        spdlog::info("Sent bitrate {} kbps to encoder over HTTP", m_pending);
+    } else {
+        record_failure();
+        spdlog::error("HTTP encoder control to {} returned status {}", m_host, status);
+    }
+
+    if (keep_alive) {
+        m_state = State::IDLE;
+        m_deadline = Clock::time_point::max();
+        m_response_size = 0;
+    } else {
+        close_socket();
+    }
+}
+
+EncoderAdapter::Clock::time_point HttpAdapter::deadline() const {
+    return m_deadline;
+}
+
+void HttpAdapter::handle_timeout(Clock::time_point now) {
+    if (now >= m_deadline) {
+        fail(m_state == State::CONNECTING ? "connect timed out" : "request timed out");
+    }
+}
+
+EncoderControl::EncoderControl(const std::string& ip, int port, const EncoderConfig& config)
+    : m_config(config) {
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &dest.sin_addr) != 1) {
+        std::cerr << "Invalid encoder address: " << ip << std::endl;
+        return;
+    }
+
+    Slot slot;
+    if (config.protocol == "http") {
+        slot.adapter = std::make_unique<HttpAdapter>(dest, ip, config);
+    } else {
+        slot.adapter = std::make_unique<UdpTextAdapter>(dest, ip, config);
+    }
+    m_slots.push_back(std::move(slot));
+}
+
+void EncoderControl::check_failures(Slot& slot, Clock::time_point now) {
+    size_t failures = slot.adapter->failures();
+    if (failures > slot.failures_seen) {
+        slot.next_send = std::max(slot.next_send,
+                                  now + std::chrono::milliseconds(ENCODER_FAILURE_BACKOFF_MS));
+    }
+    slot.failures_seen = failures;
+}
+
+void EncoderControl::service(Clock::time_point now) {
+    for (auto& slot : m_slots) {
+        EncoderAdapter& adapter = *slot.adapter;
+        if (now >= adapter.deadline()) {
+            adapter.handle_timeout(now);
+            check_failures(slot, now);
+        }
+
+        if (m_latest == 0 || adapter.delivered() == m_latest ||
+            now < slot.next_send || !adapter.ready(now)) {
+            continue;
+        }
+
+        adapter.send(m_latest, now);
+        slot.next_send = now + std::chrono::milliseconds(m_config.min_interval_ms);
+        check_failures(slot, now);
+    }
+}
+
+void EncoderControl::add_poll_fds(std::vector<struct pollfd>& fds) const {
+    m_polled.clear();
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        short events = 0;
+        int fd = m_slots[i].adapter->poll_fd(events);
+        if (fd >= 0) {
+            fds.push_back({fd, events, 0});
+            m_polled.push_back(static_cast<int>(i));
+        }
+    }
+}
+
+void EncoderControl::handle_events(const struct pollfd* fds, size_t count, Clock::time_point now) {
+    for (size_t i = 0; i < count && i < m_polled.size(); i++) {
+        if (fds[i].revents) {
+            Slot& slot = m_slots[m_polled[i]];
+            slot.adapter->handle_events(fds[i].revents, now);
+            check_failures(slot, now);
+        }
+    }
+}
+
+int EncoderControl::timeout_ms(Clock::time_point now) const {
+    Clock::time_point next = Clock::time_point::max();
+    for (const auto& slot : m_slots) {
+        next = std::min(next, slot.adapter->deadline());
+        // A bitrate waiting only on the rate limit needs a timed wakeup
+        if (m_latest != 0 && slot.adapter->delivered() != m_latest &&
+            slot.adapter->ready(now)) {
+            next = std::min(next, slot.next_send);
+        }
+    }
+
+    if (next == Clock::time_point::max()) {
+        return -1;
+    }
+    if (next <= now) {
+        return 0;
+    }
+    // Round up so the wakeup lands on or after the deadline
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count() + 1;
+    return static_cast<int>(std::min<int64_t>(wait, 60000));
+}
+
+size_t EncoderControl::failure_count() const {
+    size_t worst = 0;
+    for (const auto& slot : m_slots) {
+        worst = std::max(worst, slot.adapter->failures());
+    }
+    return worst;
+}
@@ -0,0 +1,183 @@
+#ifndef ENCODER_CONTROL_H
+#define ENCODER_CONTROL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <netinet/in.h>
+#include "config.h"
+#include "metrics.h"
+
+// One way of telling the encoder its new bitrate. Adapters are driven by
+// EncoderControl from a single thread and never block: they expose the
+// descriptor to poll and advance their I/O when it becomes ready.
+class EncoderAdapter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit EncoderAdapter(const char* protocol);
+    virtual ~EncoderAdapter() = default;
+
+    virtual const char* name() const = 0;
+
+    // Whether a new request can be started now
+    virtual bool ready(Clock::time_point now) const = 0;
+
+    // Start delivering a bitrate (kbps); false if it failed immediately
+    virtual bool send(uint32_t bitrate_kbps, Clock::time_point now) = 0;
+
+    // Descriptor to poll and the events of interest, -1 when idle
+    virtual int poll_fd(short& events) const = 0;
+
+    // Advance I/O after poll reported revents on poll_fd()
+    virtual void handle_events(short revents, Clock::time_point now) = 0;
+
+    // When handle_timeout() must run, Clock::time_point::max() for never
+    virtual Clock::time_point deadline() const { return Clock::time_point::max(); }
+    virtual void handle_timeout(Clock::time_point now) { (void)now; }
+
+    // Bitrate the encoder is known to have received, 0 before the first
+    uint32_t delivered() const { return m_delivered; }
+
+    // Consecutive failed deliveries
+    size_t failures() const { return m_failures; }
+
+protected:
+    // Book-keeping for a finished delivery
+    void record_success(uint32_t bitrate_kbps);
+    void record_failure();
+
+    uint32_t m_delivered = 0;
+    size_t m_failures = 0;
+
+private:
+    std::shared_ptr<Counter> m_sent;
+    std::shared_ptr<Counter> m_failed;
+};
+
+// Fire-and-forget datagrams. "udp" sends plain text carrying "index:" and
+// "bitrate_hint: <kbps> kbps" lines; "udp_http" sends the same
+// GET /ctrl/stream_setting request HttpAdapter uses, as a single datagram,
+// which is what earlier releases sent.
+class UdpTextAdapter : public EncoderAdapter {
+public:
+    UdpTextAdapter(const struct sockaddr_in& dest, const std::string& host,
+                   const EncoderConfig& config);
+    ~UdpTextAdapter() override;
+
+    const char* name() const override { return m_http ? "udp_http" : "udp"; }
+    bool ready(Clock::time_point now) const override;
+    bool send(uint32_t bitrate_kbps, Clock::time_point now) override;
+    int poll_fd(short& events) const override;
+    void handle_events(short revents, Clock::time_point now) override;
+
+private:
+    int m_fd = -1;
+    bool m_http;
+    std::string m_host;
+    EncoderConfig m_config;
+    char m_message[512];
+};
+
+// HTTP/1.1 GET /ctrl/stream_setting over one keep-alive TCP connection,
+// so a bitrate change costs a single round trip once connected
+class HttpAdapter : public EncoderAdapter {
+public:
+    HttpAdapter(const struct sockaddr_in& dest, const std::string& host,
+                const EncoderConfig& config);
+    ~HttpAdapter() override;
+
+    const char* name() const override { return "http"; }
+    bool ready(Clock::time_point now) const override;
+    bool send(uint32_t bitrate_kbps, Clock::time_point now) override;
+    int poll_fd(short& events) const override;
+    void handle_events(short revents, Clock::time_point now) override;
+    Clock::time_point deadline() const override;
+    void handle_timeout(Clock::time_point now) override;
+
+private:
+    enum class State {
+        DISCONNECTED,
+        CONNECTING,
+        SENDING,
+        RECEIVING,
+        IDLE             // Connected, waiting for the next request
+    };
+
+    // Write as much of the request as the socket takes
+    void write_request(Clock::time_point now);
+
+    // Read the response, completing the request once it is whole
+    void read_response(Clock::time_point now);
+
+    // Drop the connection after an error
+    void fail(const char* reason);
+
+    void close_socket();
+
+    struct sockaddr_in m_dest;
+    std::string m_host;
+    EncoderConfig m_config;
+
+    int m_fd = -1;
+    State m_state = State::DISCONNECTED;
+    Clock::time_point m_deadline = Clock::time_point::max();
+
+    uint32_t m_pending = 0;
+    char m_request[512];
+    size_t m_request_size = 0;
+    size_t m_request_sent = 0;
+    char m_response[2048];
+    size_t m_response_size = 0;
+};
+
+// Delivers bitrate changes to the encoder through its adapters. Changes
+// are coalesced: while a request is in flight or an adapter is inside its
+// rate limit, newer bitrates replace the pending one and only the latest
+// is sent. Not thread-safe; owned by the feedback thread.
+class EncoderControl {
+public:
+    using Clock = EncoderAdapter::Clock;
+
+    EncoderControl(const std::string& ip, int port, const EncoderConfig& config);
+
+    // Request a new bitrate (kbps), replacing any not yet sent
+    void set_bitrate(uint32_t bitrate_kbps) { m_latest = bitrate_kbps; }
+
+    // Start a request on every adapter that is free, behind the latest
+    // bitrate and past its rate limit
+    void service(Clock::time_point now);
+
+    // Append the adapters' descriptors to fds
+    void add_poll_fds(std::vector<struct pollfd>& fds) const;
+
+    // Dispatch poll results; fds starts at the first entry add_poll_fds added
+    void handle_events(const struct pollfd* fds, size_t count, Clock::time_point now);
+
+    // Milliseconds until service() has timed work to do, -1 for none
+    int timeout_ms(Clock::time_point now) const;
+
+    // Consecutive failures of the worst adapter
+    size_t failure_count() const;
+
+private:
+    struct Slot {
+        std::unique_ptr<EncoderAdapter> adapter;
+        Clock::time_point next_send;    // Rate limit and failure backoff
+        size_t failures_seen = 0;
+    };
+
+    // Back off a slot whose adapter reported a new failure
+    void check_failures(Slot& slot, Clock::time_point now);
+
+    EncoderConfig m_config;
+    std::vector<Slot> m_slots;
+    mutable std::vector<int> m_polled;  // Slot index of each polled fd
+    uint32_t m_latest = 0;
+};
+
+#endif // ENCODER_CONTROL_H
@@ -1,146 +1,162 @@
 #include "feedback.h"
 #include <iostream>
-#include <sstream>
-#include <iomanip>
 #include <spdlog/spdlog.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <unistd.h>
+#include <vector>
+#include <cstdio>
 #include <cstring>
 #include <cmath>
 #include <cerrno>
 
-Feedback::Feedback(uint32_t min_bitrate, uint32_t max_bitrate,
-                   const std::string& ip, int port)
-    : m_min_bitrate(min_bitrate), m_max_bitrate(max_bitrate),
-      m_ip(ip), m_port(port) {
-    // Initialize socket
-    init_socket();
-}
+// Nice value for the feedback thread, below the data path threads
+#define FEEDBACK_NICE 10
+// Upper bound on one poll() of the feedback thread
+#define FEEDBACK_POLL_MS 1000
 
-Feedback::~Feedback() {
-    // Close socket
-    if (m_socket_fd >= 0) {
-        close(m_socket_fd);
-        m_socket_fd = -1;
-    }
+// Build controller parameters for the configured bitrate range
+static RateController::Params make_rate_params(uint32_t min_bitrate, uint32_t max_bitrate) {
+    RateController::Params params;
+    params.min_bitrate = min_bitrate;
+    params.max_bitrate = max_bitrate;
+    return params;
 }
 
-bool Feedback::init_socket() {
-    // Create UDP socket
-    m_socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (m_socket_fd < 0) {
-        std::cerr << "Failed to create feedback socket: " << strerror(errno) << std::endl;
-        return false;
+Feedback::Feedback(uint32_t min_bitrate, uint32_t max_bitrate,
+                   const std::string& ip, int port, const EncoderConfig& encoder,
+                   RateController::Aggregation aggregation)
+    : m_controller(make_rate_params(min_bitrate, max_bitrate), aggregation),
+      m_control(ip, port, encoder),
+      m_queue(FEEDBACK_QUEUE_SIZE) {
+    m_dropped_metric = MetricsRegistry::global().counter(
+        "feedback_samples_dropped_total", "RIST stats samples dropped before rate control");
+    
+    m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wakeup_fd < 0) {
+        std::cerr << "Failed to create feedback eventfd: " << strerror(errno) << std::endl;
     }
     
-    return true;
+    m_running = true;
+    m_thread = std::thread(&Feedback::sender_loop, this);
 }
 
-void Feedback::process_stats(uint32_t bitrate_avg, float packet_loss, uint32_t rtt) {
-    // Lock for thread safety
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    // Calculate suggested bitrate
-    uint32_t bitrate_hint = calculate_bitrate_hint(bitrate_avg, packet_loss, rtt);
-    
-    // Clamp to min/max range
-    bitrate_hint = clamp_bitrate(bitrate_hint);
-    
-    // Check if values have changed significantly to avoid spamming
-    const float packet_loss_threshold = 0.1f;  // 0.1% change
-    const uint32_t rtt_threshold = 5;          // 5ms change
-    const uint32_t bitrate_threshold = 100;    // 100kbps change
+Feedback::~Feedback() {
+    // Stop the feedback thread
+    m_running = false;
+    wake();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
     
-    bool should_send = 
-        (std::abs(m_last_packet_loss - packet_loss) >= packet_loss_threshold) ||
-        (std::abs(static_cast<int>(m_last_rtt) - static_cast<int>(rtt)) >= static_cast<int>(rtt_threshold)) ||
-        (std::abs(static_cast<int>(m_last_bitrate) - static_cast<int>(bitrate_hint)) >= static_cast<int>(bitrate_threshold));
+    uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped > 0) {
+        std::cout << "Feedback dropped " << dropped << " stats samples" << std::endl;
+    }
     
-    if (should_send) {
-        if (send_feedback(bitrate_hint, packet_loss, rtt)) {
-            // Update last sent values
-            m_last_bitrate = bitrate_hint;
-            m_last_packet_loss = packet_loss;
-            m_last_rtt = rtt;
-        }
+    if (m_wakeup_fd >= 0) {
+        close(m_wakeup_fd);
+        m_wakeup_fd = -1;
     }
 }
 
-uint32_t Feedback::calculate_bitrate_hint(uint32_t current_bitrate, float packet_loss, uint32_t rtt) {
-    // Simple algorithm to adjust bitrate based on packet loss and RTT
-    // This can be improved with more sophisticated algorithms
-    
-    if (packet_loss > 5.0f) {
-        // High packet loss, reduce bitrate significantly
-        return current_bitrate * 0.7;
-    } else if (packet_loss > 2.0f) {
-        // Moderate packet loss, reduce bitrate slightly
-        return current_bitrate * 0.9;
-    } else if (packet_loss < 0.1f && rtt < 50) {
-        // Low packet loss and RTT, can increase bitrate
-        return current_bitrate * 1.1;
+void Feedback::wake() {
+    if (m_wakeup_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t ret = write(m_wakeup_fd, &one, sizeof(one));
+        (void)ret;
     }
-    
-    // Default case, maintain current bitrate
-    return current_bitrate;
 }
 
-uint32_t Feedback::clamp_bitrate(uint32_t bitrate) {
-    if (bitrate < m_min_bitrate) {
-        return m_min_bitrate;
-    } else if (bitrate > m_max_bitrate) {
-        return m_max_bitrate;
+void Feedback::process_stats(const std::string& route, uint32_t bitrate_avg,
+                             float packet_loss, uint32_t rtt) {
+    Sample sample;
+    snprintf(sample.route, sizeof(sample.route), "%s", route.c_str());
+    sample.bitrate_avg = bitrate_avg;
+    sample.packet_loss = packet_loss;
+    sample.rtt = rtt;
+    
+    if (!m_queue.push(sample)) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        m_dropped_metric->inc();
+        return;
+    }
+    
+    // Wake the feedback thread only if it is parked; the fence orders the
+    // push above against reading the waiting flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiting.load(std::memory_order_relaxed)) {
+        wake();
     }
-    return bitrate;
 }
 
-bool Feedback::send_feedback(uint32_t bitrate_hint, float packet_loss, uint32_t rtt) {
-    if (m_socket_fd < 0) {
-        ++m_failure_count;
-        spdlog::error("Feedback socket not initialized");
-        return false;
+void Feedback::sender_loop() {
+    // Control-plane work, yield the CPU to the data path
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), FEEDBACK_NICE) != 0) {
+        spdlog::warn("Failed to lower feedback thread priority: {}", strerror(errno));
     }
     
-    // Format feedback message
-    std::stringstream ss;
-    ss << "bitrate_hint: " << bitrate_hint << " kbps\n"
-       << "packet_loss: " << std::fixed << std::setprecision(2) << packet_loss << "%\n"
-       << "rtt_ms: " << rtt << "\n";
-    
-    std::string feedback_msg = ss.str();
-    
-    // Alternative HTTP GET format
-    std::stringstream http_ss;
-    http_ss << "GET /ctrl/stream_setting?index=stream1&width=1920&height=1080&bitrate="
-            << (bitrate_hint * 1000) // Convert to bps
-            << " HTTP/1.1\r\n"
-            << "Host: " << m_ip << "\r\n"
-            << "\r\n";
+    std::vector<struct pollfd> fds;
+    Sample sample;
+    while (m_running) {
+        while (m_queue.pop(sample)) {
+            handle_sample(sample);
+        }
+        
+        auto now = EncoderControl::Clock::now();
+        m_control.service(now);
+        m_failure_count.store(m_control.failure_count(), std::memory_order_relaxed);
+        
+        // Sleep on the wakeup eventfd and the encoder sockets together
+        fds.clear();
+        fds.push_back({m_wakeup_fd, POLLIN, 0});
+        m_control.add_poll_fds(fds);
+        int timeout = m_control.timeout_ms(now);
+        if (timeout < 0 || timeout > FEEDBACK_POLL_MS) {
+            timeout = FEEDBACK_POLL_MS;
+        }
+        
+        m_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // Re-check after announcing the wait so a concurrent push is not missed
+        if (m_running && m_queue.empty()) {
+            poll(fds.data(), fds.size(), timeout);
+        } else {
+            for (auto& fd : fds) {
+                fd.revents = 0;
+            }
+        }
+        m_waiting.store(false, std::memory_order_relaxed);
+        
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            ssize_t ret = read(m_wakeup_fd, &value, sizeof(value));
+            (void)ret;
+        }
+        m_control.handle_events(fds.data() + 1, fds.size() - 1, EncoderControl::Clock::now());
+    }
+}
+
+void Feedback::handle_sample(const Sample& sample) {
+    // Fold the sample into this route's estimates, then take the target
+    // aggregated over every route that is still reporting
+    auto now = RateController::Clock::now();
+    m_controller.update(sample.route, sample.packet_loss, sample.rtt,
+                        sample.bitrate_avg / 1000.0, now);
+    uint32_t bitrate_hint = m_controller.target_bitrate(now);
     
-    std::string http_msg = http_ss.str();
+    // Only pass on changes that matter; routes reporting in turn must not
+    // each trigger a request
+    const uint32_t bitrate_threshold = 100;    // 100kbps change
     
-    // Set up destination address
-    struct sockaddr_in dest_addr;
-    memset(&dest_addr, 0, sizeof(dest_addr));
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(m_port);
-    inet_pton(AF_INET, m_ip.c_str(), &dest_addr.sin_addr);
+    bool should_send =
+        (std::abs(static_cast<int>(m_last_bitrate) - static_cast<int>(bitrate_hint)) >= static_cast<int>(bitrate_threshold));
     
-    // Send feedback message
-    ssize_t sent = sendto(m_socket_fd, http_msg.c_str(), http_msg.size(), 0,
-                          (struct sockaddr*)&dest_addr, sizeof(dest_addr));
-
-    if (sent < 0) {
-        ++m_failure_count;
-        spdlog::error("Failed to send feedback: {}", strerror(errno));
-        return false;
+    if (should_send) {
+        // Coalesced with any change still waiting on the rate limit
+        m_control.set_bitrate(bitrate_hint);
+        m_last_bitrate = bitrate_hint;
     }
-
-    // Reset failure counter on success
-    m_failure_count = 0;
-
-    std::cout << "Sent feedback to encoder - " << feedback_msg;
-    return true;
 }
@@ -3,47 +3,72 @@
 
 #include <cstdint>
 #include <string>
-#include <mutex>
+#include <atomic>
+#include <thread>
+#include "config.h"
+#include "rate_controller.h"
+#include "encoder_control.h"
+#include "mpsc_queue.h"
+
+// Stats samples queued between the RIST stats callbacks and the sender
+#define FEEDBACK_QUEUE_SIZE 64
 
 class Feedback {
 public:
     Feedback(uint32_t min_bitrate, uint32_t max_bitrate,
-             const std::string& ip, int port);
+             const std::string& ip, int port, const EncoderConfig& encoder,
+             RateController::Aggregation aggregation = RateController::Aggregation::SUM);
     ~Feedback();
     
-    // Process network stats and send feedback
-    void process_stats(uint32_t bitrate_avg, float packet_loss, uint32_t rtt);
+    // Post one route's network stats to the feedback thread; bitrate_avg in
+    // bps, packet_loss in percent. Never blocks, safe from any thread.
+    void process_stats(const std::string& route, uint32_t bitrate_avg,
+                       float packet_loss, uint32_t rtt);
 
     // Number of consecutive failures when sending feedback
-    size_t get_failure_count() const { return m_failure_count; }
+    size_t get_failure_count() const { return m_failure_count.load(std::memory_order_relaxed); }
+    
+    // Samples dropped because the feedback thread fell behind
+    uint64_t get_dropped_samples() const { return m_dropped.load(std::memory_order_relaxed); }
     
 private:
-    // Initialize UDP socket for feedback
-    bool init_socket();
+    // One stats sample as posted by a RIST stats callback
+    struct Sample {
+        char route[64];
+        uint32_t bitrate_avg;
+        float packet_loss;
+        uint32_t rtt;
+    };
     
-    // Send feedback to encoder
-    bool send_feedback(uint32_t bitrate_hint, float packet_loss, uint32_t rtt);
+    // Thread function running rate control and encoder control I/O
+    void sender_loop();
     
-    // Calculate suggested bitrate based on network conditions
-    uint32_t calculate_bitrate_hint(uint32_t current_bitrate, float packet_loss, uint32_t rtt);
+    // Fold one sample into rate control, updating the encoder's target
+    void handle_sample(const Sample& sample);
     
-    // Clamp bitrate within min/max range
-    uint32_t clamp_bitrate(uint32_t bitrate);
+    // Wake the feedback thread from poll()
+    void wake();
     
-    uint32_t m_min_bitrate;
-    uint32_t m_max_bitrate;
-    std::string m_ip;
-    int m_port;
-    int m_socket_fd = -1;
-    std::mutex m_mutex;
+    // Per-route rate control and encoder delivery, feedback thread only
+    RateController m_controller;
+    EncoderControl m_control;
     
-    // Last sent values (to avoid duplicate messages)
+    // Last bitrate hint handed to encoder control
     uint32_t m_last_bitrate = 0;
-    float m_last_packet_loss = 0.0f;
-    uint32_t m_last_rtt = 0;
 
     // Track consecutive send failures
-    size_t m_failure_count = 0;
+    std::atomic<size_t> m_failure_count{0};
+    
+    // Samples from the stats callbacks, drained by the feedback thread
+    MpscQueue<Sample> m_queue;
+    std::atomic<uint64_t> m_dropped{0};
+    std::shared_ptr<Counter> m_dropped_metric;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    
+    // Eventfd the feedback thread polls alongside the encoder sockets
+    int m_wakeup_fd = -1;
+    std::atomic<bool> m_waiting{false};
 };
 
 #endif // FEEDBACK_H
@@ -3,7 +3,12 @@
 
 #include <memory>
 #include <vector>
-#include "rist_output.h"
+#include <cstring>
+#include <algorithm>
+#include <poll.h>
+#include "output_sink.h"
+#include "packet_pool.h"
+#include "latency_trace.h"
 
 // Base class for all input types
 class InputBase {
@@ -13,19 +18,96 @@ public:
     // Start receiving input
     virtual bool start() = 0;
     
-    // Process a single iteration
+    // Process a single iteration, blocking until data arrives or the
+    // wakeup descriptor becomes readable
     virtual void process() = 0;
     
     // Stop receiving input
     virtual void stop() = 0;
     
-    // Add a RIST output destination
-    virtual void add_output(std::shared_ptr<RistOutput> output) {
+    // Add an output destination
+    virtual void add_output(std::shared_ptr<OutputSink> output) {
         m_outputs.push_back(output);
     }
     
+    // Add a sink that receives every packet, whichever output an input
+    // routes it to (e.g. local UDP fan-out); must be called before start()
+    void add_fanout(std::shared_ptr<OutputSink> sink) {
+        m_fanout.push_back(sink);
+    }
+    
+    // Pool that received packets are allocated from; must be set before
+    // start() and sized to cover every packet queued on the outputs
+    virtual void set_packet_pool(std::shared_ptr<PacketPool> pool) {
+        m_pool = pool;
+    }
+    
+    // Stamp every received packet with its receive time for the outputs'
+    // latency trace; must be set before start()
+    virtual void set_latency_tracing(bool enabled) {
+        m_trace_latency = enabled;
+    }
+    
+    // Pollable descriptor (eventfd or pipe) that interrupts a blocking
+    // process(); must be set before start()
+    virtual void set_wakeup_fd(int fd) {
+        m_wakeup_fd = fd;
+    }
+    
 protected:
-    std::vector<std::shared_ptr<RistOutput>> m_outputs;
+    // Wait up to timeout_ms (-1 for ever) for the wakeup descriptor to fire.
+    // Without a descriptor this only sleeps, bounded to 100 ms.
+    bool wait_for_wakeup(int timeout_ms) const {
+        if (m_wakeup_fd < 0) {
+            poll(nullptr, 0, timeout_ms < 0 ? 100 : timeout_ms);
+            return false;
+        }
+        struct pollfd pfd = {m_wakeup_fd, POLLIN, 0};
+        return poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLIN);
+    }
+
+    
+    // Hand one pooled packet to every output, sharing the buffer
+    void dispatch(const PacketRef& packet) {
+        for (auto& output : m_outputs) {
+            output->send_packet(packet);
+        }
+        fan_out(packet);
+    }
+    
+    // Hand one pooled packet to the fan-out sinks only
+    void fan_out(const PacketRef& packet) {
+        for (auto& sink : m_fanout) {
+            sink->send_packet(packet);
+        }
+    }
+    
+    // Copy an arbitrary-size payload into pooled slots and dispatch them;
+    // returns false if the pool ran out part way through
+    bool dispatch_data(const char* data, size_t size) {
+        int64_t rx_ns = m_trace_latency ? LatencyTrace::now_ns() : 0;
+        while (size > 0) {
+            PacketRef packet = m_pool->acquire();
+            if (!packet) {
+                return false;
+            }
+            size_t chunk = std::min(size, packet.capacity());
+            memcpy(packet.data(), data, chunk);
+            packet.set_size(chunk);
+            packet.set_rx_ns(rx_ns);
+            dispatch(packet);
+            data += chunk;
+            size -= chunk;
+        }
+        return true;
+    }
+    
+    // Declared before the outputs so queued packets are released first
+    std::shared_ptr<PacketPool> m_pool;
+    std::vector<std::shared_ptr<OutputSink>> m_outputs;
+    std::vector<std::shared_ptr<OutputSink>> m_fanout;
+    int m_wakeup_fd = -1;
+    bool m_trace_latency = false;
 };
 
 #endif // INPUT_BASE_H
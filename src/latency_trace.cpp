@@ -0,0 +1,154 @@
+#include "latency_trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+LatencyTrace::LatencyTrace(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    m_slots.reset(new Slot[size]);
+    m_mask = size - 1;
+}
+
+int64_t LatencyTrace::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LatencyTrace::record(const LatencySample& sample) {
+    uint64_t pos = m_next.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = m_slots[pos & m_mask];
+
+    // Mark the slot busy before touching the fields so a concurrent reader
+    // discards it
+    slot.seq.store(BUSY, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.rx_ns.store(sample.rx_ns, std::memory_order_relaxed);
+    slot.enqueue_ns.store(sample.enqueue_ns, std::memory_order_relaxed);
+    slot.dequeue_ns.store(sample.dequeue_ns, std::memory_order_relaxed);
+    slot.send_ns.store(sample.send_ns, std::memory_order_relaxed);
+    slot.size.store(sample.size, std::memory_order_relaxed);
+    slot.output.store(sample.output, std::memory_order_relaxed);
+
+    slot.seq.store(pos + 1, std::memory_order_release);
+}
+
+std::vector<LatencySample> LatencyTrace::snapshot() const {
+    uint64_t end = m_next.load(std::memory_order_acquire);
+    uint64_t begin = end > capacity() ? end - capacity() : 0;
+
+    std::vector<LatencySample> samples;
+    samples.reserve(end - begin);
+    for (uint64_t pos = begin; pos < end; pos++) {
+        const Slot& slot = m_slots[pos & m_mask];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != pos + 1) {
+            // Still being written, or already overwritten by a newer sample
+            continue;
+        }
+
+        LatencySample sample;
+        sample.rx_ns = slot.rx_ns.load(std::memory_order_relaxed);
+        sample.enqueue_ns = slot.enqueue_ns.load(std::memory_order_relaxed);
+        sample.dequeue_ns = slot.dequeue_ns.load(std::memory_order_relaxed);
+        sample.send_ns = slot.send_ns.load(std::memory_order_relaxed);
+        sample.size = slot.size.load(std::memory_order_relaxed);
+        sample.output = slot.output.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq) {
+            samples.push_back(sample);
+        }
+    }
+    return samples;
+}
+
+// Percentiles of a set of delays given in nanoseconds
+static LatencyTrace::Percentiles percentiles(std::vector<int64_t>& delays) {
+    LatencyTrace::Percentiles result;
+    result.count = delays.size();
+    if (delays.empty()) {
+        return result;
+    }
+
+    std::sort(delays.begin(), delays.end());
+    auto rank = [&delays](double p) {
+        size_t index = static_cast<size_t>(std::ceil(p * delays.size()));
+        return delays[index > 0 ? index - 1 : 0] / 1000.0;
+    };
+    result.p50 = rank(0.50);
+    result.p99 = rank(0.99);
+    result.p999 = rank(0.999);
+    result.max = delays.back() / 1000.0;
+    return result;
+}
+
+LatencyTrace::Summary LatencyTrace::summarize(const std::vector<LatencySample>& samples) {
+    std::vector<int64_t> ingest, queue, send, total;
+    for (const auto& sample : samples) {
+        // A zero receive stamp means the input did not trace this packet
+        if (sample.rx_ns > 0) {
+            ingest.push_back(sample.enqueue_ns - sample.rx_ns);
+            total.push_back(sample.send_ns - sample.rx_ns);
+        }
+        queue.push_back(sample.dequeue_ns - sample.enqueue_ns);
+        send.push_back(sample.send_ns - sample.dequeue_ns);
+    }
+
+    Summary summary;
+    summary.ingest = percentiles(ingest);
+    summary.queue = percentiles(queue);
+    summary.send = percentiles(send);
+    summary.total = percentiles(total);
+    return summary;
+}
+
+bool LatencyTrace::dump(const std::string& path, Summary* summary_out) const {
+    auto samples = snapshot();
+    Summary summary = summarize(samples);
+    if (summary_out) {
+        *summary_out = summary;
+    }
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "Failed to open latency trace file " << path << std::endl;
+        return false;
+    }
+
+    const std::pair<const char*, const Percentiles*> stages[] = {
+        {"ingest", &summary.ingest},
+        {"queue", &summary.queue},
+        {"send", &summary.send},
+        {"total", &summary.total},
+    };
+    fprintf(file, "# stage,count,p50_us,p99_us,p999_us,max_us\n");
+    for (const auto& stage : stages) {
+        const Percentiles& p = *stage.second;
+        fprintf(file, "# %s,%zu,%.1f,%.1f,%.1f,%.1f\n", stage.first, p.count,
+                p.p50, p.p99, p.p999, p.max);
+    }
+
+    fprintf(file, "output,size,rx_ns,enqueue_ns,dequeue_ns,send_ns\n");
+    for (const auto& sample : samples) {
+        fprintf(file, "%u,%u,%lld,%lld,%lld,%lld\n", static_cast<unsigned>(sample.output),
+                sample.size, static_cast<long long>(sample.rx_ns),
+                static_cast<long long>(sample.enqueue_ns),
+                static_cast<long long>(sample.dequeue_ns),
+                static_cast<long long>(sample.send_ns));
+    }
+
+    bool ok = ferror(file) == 0;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        std::cerr << "Failed to write latency trace file " << path << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,88 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Monotonic timestamps of one packet on its way through a pipeline, in
+// steady clock nanoseconds
+struct LatencySample {
+    int64_t rx_ns = 0;         // Returned from the input's receive call
+    int64_t enqueue_ns = 0;    // Published on the output's send queue
+    int64_t dequeue_ns = 0;    // Taken off the queue by the sender thread
+    int64_t send_ns = 0;       // Handed to librist (or the TS packetizer)
+    uint32_t size = 0;
+    uint16_t output = 0;       // Index of the output within the pipeline
+};
+
+// Fixed-size ring of the most recent LatencySamples. Recording is
+// lock-free and may happen from every sender thread of a pipeline; the
+// oldest samples are overwritten. Readers skip slots that are being
+// rewritten while they copy, so a dump never stalls the data path.
+class LatencyTrace {
+public:
+    // Nearest-rank percentiles of one stage, in microseconds
+    struct Percentiles {
+        size_t count = 0;
+        double p50 = 0.0;
+        double p99 = 0.0;
+        double p999 = 0.0;
+        double max = 0.0;
+    };
+
+    // Per-stage delays over a set of samples
+    struct Summary {
+        Percentiles ingest;    // Receive to enqueue
+        Percentiles queue;     // Enqueue to dequeue
+        Percentiles send;      // Dequeue to send
+        Percentiles total;     // Receive to send
+    };
+
+    // Capacity is rounded up to a power of two
+    explicit LatencyTrace(size_t capacity);
+
+    LatencyTrace(const LatencyTrace&) = delete;
+    LatencyTrace& operator=(const LatencyTrace&) = delete;
+
+    // Current steady clock time in nanoseconds
+    static int64_t now_ns();
+
+    // Any thread: store one sample, replacing the oldest
+    void record(const LatencySample& sample);
+
+    // Copy of the samples currently held, oldest first
+    std::vector<LatencySample> snapshot() const;
+
+    static Summary summarize(const std::vector<LatencySample>& samples);
+
+    // Write a snapshot as CSV, preceded by its summary as # comment lines;
+    // the summary is also stored in summary when given
+    bool dump(const std::string& path, Summary* summary = nullptr) const;
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    // Seqlock-style slot: seq is the sample's position plus one once it is
+    // complete, or BUSY while a writer fills it
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<int64_t> rx_ns{0};
+        std::atomic<int64_t> enqueue_ns{0};
+        std::atomic<int64_t> dequeue_ns{0};
+        std::atomic<int64_t> send_ns{0};
+        std::atomic<uint32_t> size{0};
+        std::atomic<uint16_t> output{0};
+    };
+
+    static constexpr uint64_t BUSY = ~uint64_t(0);
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask = 0;
+    alignas(64) std::atomic<uint64_t> m_next{0};
+};
+
+#endif // LATENCY_TRACE_H
@@ -2,29 +2,91 @@
 #include <fstream>
 #include <string>
 #include <memory>
-#include <signal.h>
 #include <thread>
-#include <chrono>
+#include <vector>
+#include <ctime>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <nlohmann/json.hpp>
 
 #include "config.h"
-#include "srt_input.h"
-#include "rtsp_input.h"
-#include "rist_output.h"
-#include "feedback.h"
-#include "network_utils.h"
 #include "config_parser.h"
+#include "pipeline.h"
+#include "worker_pool.h"
+#include "metrics.h"
 
 using json = nlohmann::json;
 
 // Global flag for graceful shutdown
 volatile sig_atomic_t running = 1;
 
+// Eventfd that wakes the blocking run loop on shutdown
+int shutdown_fd = -1;
+
 void signal_handler(int signal) {
     std::cout << "Caught signal " << signal << ", shutting down..." << std::endl;
     running = 0;
+    if (shutdown_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t ret = write(shutdown_fd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+// Handle the control signals until shutdown: SIGUSR1 dumps the latency
+// trace of every pipeline, SIGUSR2 replays their recordings. Both are
+// blocked in all threads and taken here synchronously, so the work runs
+// outside signal context.
+static void control_signal_loop(std::vector<Pipeline*> pipelines, std::string dir) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGUSR2);
+    
+    while (running) {
+        struct timespec timeout = {0, 500 * 1000 * 1000};
+        int signal = sigtimedwait(&set, nullptr, &timeout);
+        if (signal == SIGUSR1) {
+            bool dumped = false;
+            for (Pipeline* pipeline : pipelines) {
+                dumped |= pipeline->dump_latency_trace(dir);
+            }
+            if (!dumped) {
+                std::cout << "No latency trace to dump, set latency_trace to enable tracing" << std::endl;
+            }
+        } else if (signal == SIGUSR2) {
+            bool replaying = false;
+            for (Pipeline* pipeline : pipelines) {
+                replaying |= pipeline->replay_recording();
+            }
+            if (!replaying) {
+                std::cout << "No recording replayed, set record_path and record_replay_port to enable replay"
+                          << std::endl;
+            }
+        }
+    }
 }
 
+// Runs control_signal_loop for as long as it is in scope. Declared after
+// the pipelines it serves, so on every way out of their scope, exceptions
+// included, it stops and joins the thread before they are destroyed.
+class ControlThread {
+public:
+    ControlThread(std::vector<Pipeline*> pipelines, const std::string& dir)
+        : m_thread(control_signal_loop, std::move(pipelines), dir) {}
+
+    ~ControlThread() {
+        running = 0;
+        m_thread.join();
+    }
+
+private:
+    ControlThread(const ControlThread&) = delete;
+    ControlThread& operator=(const ControlThread&) = delete;
+
+    std::thread m_thread;
+};
 
 int main(int argc, char* argv[]) {
     if (argc < 2) {
@@ -32,120 +94,77 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Create the shutdown eventfd before the handlers can fire
+    shutdown_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (shutdown_fd < 0) {
+        std::cerr << "Failed to create shutdown eventfd" << std::endl;
+        return 1;
+    }
+    
     // Register signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     
+    // Block the control signals before any thread starts so only the
+    // control thread sees them
+    sigset_t control_signals;
+    sigemptyset(&control_signals);
+    sigaddset(&control_signals, SIGUSR1);
+    sigaddset(&control_signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &control_signals, nullptr);
+    
     try {
         // Parse config
         Config config = parse_config(argv[1]);
         
-        // Setup feedback handler
-        auto feedback = std::make_shared<Feedback>(
-            config.min_bitrate, config.max_bitrate,
-            config.feedback_ip, config.feedback_port);
-        
-        // Setup input and output based on config
-        std::unique_ptr<InputBase> input;
-        std::vector<std::shared_ptr<RistOutput>> outputs;
-        
-        if (config.mode == InputMode::SRT) {
-            if (config.srt_mode == SRTMode::MULTI) {
-                // Get available WAN interfaces if using "auto"
-                if (config.filter_to_wan) {
-                    auto wan_ips = NetworkUtils::get_wan_interface_ips();
-                    if (wan_ips.empty()) {
-                        throw std::runtime_error("No WAN interfaces found");
-                    }
-                    
-                    // Assign IPs to multi-route config
-                    size_t ip_index = 0;
-                    for (auto& route : config.multi_routes) {
-                        if (route.interface_ip == "auto") {
-                            if (ip_index < wan_ips.size()) {
-                                route.interface_ip = wan_ips[ip_index++];
-                                std::cout << "Assigned WAN IP " << route.interface_ip 
-                                          << " to route " << ip_index << std::endl;
-                            } else {
-                                throw std::runtime_error("Not enough WAN interfaces for configured routes");
-                            }
-                        }
-                    }
-                }
-                
-                // Create multiple RIST outputs
-                for (const auto& route : config.multi_routes) {
-                    auto rist = std::make_shared<RistOutput>(route.rist_dst, route.rist_port);
-                    rist->set_feedback_callback(feedback);
-                    if (!rist->init()) {
-                        throw std::runtime_error("Failed to initialize RIST output");
-                    }
-                    outputs.push_back(rist);
-                }
-                
-                // Create multi-interface SRT input
-                auto srt_input = std::make_unique<SRTInput>(config.listen_port);
-                for (size_t i = 0; i < config.multi_routes.size(); i++) {
-                    srt_input->add_binding(config.multi_routes[i].interface_ip, outputs[i]);
-                }
-                input = std::move(srt_input);
-                
-            } else if (config.srt_mode == SRTMode::CALLER) {
-                // Create SRT caller input
-                auto rist = std::make_shared<RistOutput>(config.rist_dst, config.rist_port);
-                rist->set_feedback_callback(feedback);
-                if (!rist->init()) {
-                    throw std::runtime_error("Failed to initialize RIST output");
-                }
-                outputs.push_back(rist);
-                input = std::make_unique<SRTInput>(config.input_url, outputs[0]);
-                
-            } else if (config.srt_mode == SRTMode::LISTENER) {
-                // Create SRT listener input
-                auto rist = std::make_shared<RistOutput>(config.rist_dst, config.rist_port);
-                rist->set_feedback_callback(feedback);
-                if (!rist->init()) {
-                    throw std::runtime_error("Failed to initialize RIST output");
-                }
-                outputs.push_back(rist);
-                input = std::make_unique<SRTInput>(config.listen_port, outputs[0]);
+        // Optional local metrics endpoint, shared by every stream
+        std::unique_ptr<MetricsServer> metrics_server;
+        if (config.metrics_port > 0) {
+            metrics_server = std::make_unique<MetricsServer>(MetricsRegistry::global(), config.metrics_port);
+            if (!metrics_server->start()) {
+                metrics_server.reset();
             }
-        } else if (config.mode == InputMode::RTSP) {
-            // Create RTSP input
-            auto rist = std::make_shared<RistOutput>(config.rist_dst, config.rist_port);
-            rist->set_feedback_callback(feedback);
-            if (!rist->init()) {
-                throw std::runtime_error("Failed to initialize RIST output");
-            }
-            outputs.push_back(rist);
-            input = std::make_unique<RTSPInput>(config.input_url, outputs[0]);
-        }
-        
-        if (!input || outputs.empty()) {
-            throw std::runtime_error("Failed to initialize input or output");
         }
         
-        std::cout << "Stream relay initialized successfully" << std::endl;
-        
-        // Start the stream relay
-        input->start();
-        
-        // Main loop
-        while (running) {
-            input->process();
+        if (!config.streams.empty()) {
+            // Independent pipelines scheduled over a worker pool
+            WorkerPool pool(config.workers, shutdown_fd);
+            std::vector<Pipeline*> pipelines;
+            for (const auto& stream : config.streams) {
+                auto pipeline = std::make_shared<Pipeline>(stream, stream.name);
+                pipeline->init();
+                pool.add(pipeline);
+                pipelines.push_back(pipeline.get());
+            }
+            
+            std::cout << "Stream relay initialized successfully" << std::endl;
+            ControlThread control_thread(pipelines, config.latency_trace_dir);
+            pool.run();
+        } else {
+            Pipeline pipeline(config, "main");
+            pipeline.init();
+            
+            std::cout << "Stream relay initialized successfully" << std::endl;
+            ControlThread control_thread({&pipeline}, config.latency_trace_dir);
             
-            // Sleep to avoid busy waiting
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            // Start the stream relay
+            pipeline.start(shutdown_fd);
+            
+            // Main loop, process() blocks until data arrives or shutdown fires
+            while (running) {
+                pipeline.process();
+            }
+            
+            // Stop and cleanup
+            pipeline.stop();
         }
         
-        // Stop and cleanup
-        input->stop();
-        
     } catch (std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
     
+    close(shutdown_fd);
     std::cout << "Stream relay terminated" << std::endl;
     return 0;
 }
@@ -0,0 +1,272 @@
+#include "metrics.h"
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+// How often the server thread checks for shutdown while idle
+#define METRICS_POLL_MS 500
+// Time a scraper gets to send its request
+#define METRICS_CLIENT_TIMEOUT_MS 1000
+
+Histogram::Histogram(const std::vector<double>& bounds)
+    : m_bounds(bounds), m_buckets(new std::atomic<uint64_t>[bounds.size() + 1]) {
+    for (size_t i = 0; i <= m_bounds.size(); i++) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(double value) {
+    // Bounds are few, a linear scan beats a binary search here
+    size_t i = 0;
+    while (i < m_bounds.size() && value > m_bounds[i]) {
+        ++i;
+    }
+    m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum_micros.fetch_add(std::llround(value * 1e6), std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> Histogram::counts() const {
+    std::vector<uint64_t> result(m_bounds.size() + 1);
+    for (size_t i = 0; i < result.size(); i++) {
+        result[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+double Histogram::sum() const {
+    return m_sum_micros.load(std::memory_order_relaxed) / 1e6;
+}
+
+MetricsRegistry& MetricsRegistry::global() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Family& MetricsRegistry::family(const std::string& name,
+                                                 const std::string& help, const char* type) {
+    Family& family = m_families[name];
+    if (family.type.empty()) {
+        family.help = help;
+        family.type = type;
+    }
+    return family;
+}
+
+std::shared_ptr<Counter> MetricsRegistry::counter(const std::string& name, const std::string& help,
+                                                  const std::string& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& metric = family(name, help, "counter").counters[labels];
+    if (!metric) {
+        metric = std::make_shared<Counter>();
+    }
+    return metric;
+}
+
+std::shared_ptr<Gauge> MetricsRegistry::gauge(const std::string& name, const std::string& help,
+                                              const std::string& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& metric = family(name, help, "gauge").gauges[labels];
+    if (!metric) {
+        metric = std::make_shared<Gauge>();
+    }
+    return metric;
+}
+
+std::shared_ptr<Histogram> MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                                      const std::string& labels,
+                                                      const std::vector<double>& bounds) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& metric = family(name, help, "histogram").histograms[labels];
+    if (!metric) {
+        metric = std::make_shared<Histogram>(bounds);
+    }
+    return metric;
+}
+
+// Label set with an extra label appended, e.g. for histogram "le"
+static std::string join_labels(const std::string& labels, const std::string& extra) {
+    if (labels.empty()) {
+        return "{" + extra + "}";
+    }
+    return "{" + labels + "," + extra + "}";
+}
+
+static std::string wrap_labels(const std::string& labels) {
+    return labels.empty() ? "" : "{" + labels + "}";
+}
+
+std::string MetricsRegistry::render() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ostringstream out;
+
+    for (const auto& entry : m_families) {
+        const std::string& name = entry.first;
+        const Family& family = entry.second;
+        out << "# HELP " << name << " " << family.help << "\n";
+        out << "# TYPE " << name << " " << family.type << "\n";
+
+        for (const auto& metric : family.counters) {
+            out << name << wrap_labels(metric.first) << " " << metric.second->value() << "\n";
+        }
+        for (const auto& metric : family.gauges) {
+            out << name << wrap_labels(metric.first) << " " << metric.second->value() << "\n";
+        }
+        for (const auto& metric : family.histograms) {
+            const Histogram& histogram = *metric.second;
+            auto counts = histogram.counts();
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < histogram.bounds().size(); i++) {
+                cumulative += counts[i];
+                std::ostringstream bound;
+                bound << histogram.bounds()[i];
+                out << name << "_bucket" << join_labels(metric.first, "le=\"" + bound.str() + "\"")
+                    << " " << cumulative << "\n";
+            }
+            cumulative += counts.back();
+            out << name << "_bucket" << join_labels(metric.first, "le=\"+Inf\"")
+                << " " << cumulative << "\n";
+            out << name << "_sum" << wrap_labels(metric.first) << " " << histogram.sum() << "\n";
+            out << name << "_count" << wrap_labels(metric.first) << " " << cumulative << "\n";
+        }
+    }
+
+    return out.str();
+}
+
+std::string metric_label(const std::string& key, const std::string& value) {
+    std::string result = key + "=\"";
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            result += '\\';
+        } else if (c == '\n') {
+            result += "\\n";
+            continue;
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+MetricsServer::MetricsServer(MetricsRegistry& registry, int port)
+    : m_registry(registry), m_port(port) {
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start() {
+    m_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listen_fd < 0) {
+        std::cerr << "Failed to create metrics socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    // Loopback only, the endpoint has no authentication
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(m_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(m_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(m_listen_fd, 8) != 0) {
+        std::cerr << "Failed to listen for metrics on port " << m_port << ": "
+                  << strerror(errno) << std::endl;
+        close(m_listen_fd);
+        m_listen_fd = -1;
+        return false;
+    }
+
+    m_running = true;
+    m_thread = std::thread(&MetricsServer::serve_loop, this);
+    std::cout << "Metrics available at http://127.0.0.1:" << m_port << "/metrics" << std::endl;
+    return true;
+}
+
+void MetricsServer::stop() {
+    m_running = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_listen_fd >= 0) {
+        close(m_listen_fd);
+        m_listen_fd = -1;
+    }
+}
+
+void MetricsServer::serve_loop() {
+    while (m_running) {
+        struct pollfd pfd = {m_listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) {
+            continue;
+        }
+
+        int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        handle_client(fd);
+        close(fd);
+    }
+}
+
+void MetricsServer::handle_client(int fd) {
+    // Read until the end of the request header; the body is never used
+    char request[2048];
+    size_t size = 0;
+    while (size < sizeof(request) - 1) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, METRICS_CLIENT_TIMEOUT_MS) <= 0) {
+            return;
+        }
+        ssize_t got = recv(fd, request + size, sizeof(request) - 1 - size, 0);
+        if (got <= 0) {
+            return;
+        }
+        size += got;
+        request[size] = '\0';
+        if (strstr(request, "\r\n\r\n")) {
+            break;
+        }
+    }
+    request[size] = '\0';
+
+    std::string body;
+    const char* status;
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+        status = "200 OK";
+        body = m_registry.render();
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n"
+             << "\r\n"
+             << body;
+    std::string data = response.str();
+
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            return;
+        }
+        sent += ret;
+    }
+}
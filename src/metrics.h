@@ -0,0 +1,118 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Monotonic event count. Updating is one relaxed atomic add, cheap enough
+// for the per-packet path.
+class Counter {
+public:
+    void inc(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_value{0};
+};
+
+// Value that goes up and down, such as a queue depth
+class Gauge {
+public:
+    void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+    void add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> m_value{0};
+};
+
+// Distribution over fixed upper bounds. Each observation bumps one bucket
+// and the running sum; buckets are cumulated only when rendered.
+class Histogram {
+public:
+    explicit Histogram(const std::vector<double>& bounds);
+
+    void observe(double value);
+
+    const std::vector<double>& bounds() const { return m_bounds; }
+
+    // Per-bucket counts (not cumulative), the last one for +Inf
+    std::vector<uint64_t> counts() const;
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    double sum() const;
+
+private:
+    std::vector<double> m_bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<int64_t> m_sum_micros{0};   // Sum in millionths, kept integral
+};
+
+// Process-wide set of named metrics, rendered in the Prometheus text format.
+// Registration takes a lock and is meant for setup; the returned handles
+// are updated lock-free. Registering the same name and labels again
+// returns the existing metric, so reconnecting components keep counting.
+class MetricsRegistry {
+public:
+    static MetricsRegistry& global();
+
+    // labels is the inner part of a Prometheus label set, e.g. route="a:1"
+    std::shared_ptr<Counter> counter(const std::string& name, const std::string& help,
+                                     const std::string& labels = "");
+    std::shared_ptr<Gauge> gauge(const std::string& name, const std::string& help,
+                                 const std::string& labels = "");
+    std::shared_ptr<Histogram> histogram(const std::string& name, const std::string& help,
+                                         const std::string& labels,
+                                         const std::vector<double>& bounds);
+
+    // Text exposition of every metric
+    std::string render() const;
+
+private:
+    struct Family {
+        std::string help;
+        std::string type;
+        std::map<std::string, std::shared_ptr<Counter>> counters;
+        std::map<std::string, std::shared_ptr<Gauge>> gauges;
+        std::map<std::string, std::shared_ptr<Histogram>> histograms;
+    };
+
+    // Family for name, created with help and type on first use
+    Family& family(const std::string& name, const std::string& help, const char* type);
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Family> m_families;
+};
+
+// Quote a label value for use in a label set
+std::string metric_label(const std::string& key, const std::string& value);
+
+// Minimal HTTP server answering GET /metrics on the loopback interface
+class MetricsServer {
+public:
+    MetricsServer(MetricsRegistry& registry, int port);
+    ~MetricsServer();
+
+    bool start();
+    void stop();
+
+private:
+    void serve_loop();
+
+    // Answer one request on an accepted connection
+    void handle_client(int fd);
+
+    MetricsRegistry& m_registry;
+    int m_port;
+    int m_listen_fd = -1;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+};
+
+#endif // METRICS_H
@@ -0,0 +1,91 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounded multi-producer/single-consumer queue. Each slot carries a
+// sequence number telling producers and the consumer whose turn it is, so
+// pushes from several threads never take a lock and a full queue is
+// reported instead of blocking the producer.
+template <typename T>
+class MpscQueue {
+public:
+    // Capacity is rounded up to a power of two
+    explicit MpscQueue(size_t capacity) : m_cells(round_up(capacity)) {
+        for (size_t i = 0; i < m_cells.size(); i++) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_mask = m_cells.size() - 1;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread: copy value in, or return false when the queue is full
+    bool push(const T& value) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // Slot is free for this position, claim it
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // Consumer has not released the slot from the previous lap
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer: move the oldest value out, or return false when empty
+    bool pop(T& value) {
+        Cell& cell = m_cells[m_head & m_mask];
+        if (cell.seq.load(std::memory_order_acquire) != m_head + 1) {
+            return false;
+        }
+        value = cell.value;
+        cell.seq.store(m_head + m_mask + 1, std::memory_order_release);
+        ++m_head;
+        return true;
+    }
+
+    // Consumer: whether there is nothing to pop
+    bool empty() const {
+        return m_cells[m_head & m_mask].seq.load(std::memory_order_acquire) != m_head + 1;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    static size_t round_up(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    struct Cell {
+        std::atomic<size_t> seq{0};
+        T value;
+    };
+
+    std::vector<Cell> m_cells;
+    size_t m_mask = 0;
+
+    // Producers and the consumer on separate cache lines
+    alignas(64) std::atomic<size_t> m_tail{0};
+    alignas(64) size_t m_head = 0;
+};
+
+#endif // MPSC_QUEUE_H
@@ -1,173 +1,467 @@
 #include "network_utils.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 #include <ifaddrs.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <cstring>
 #include <cerrno>
+#include <poll.h>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+// OpenWRT network configuration, read once for WAN classification
+#define UCI_NETWORK_CONFIG "/etc/config/network"
+
+// Receive buffer for netlink messages; dumps arrive in chunks of this size
+#define NETLINK_BUFFER_SIZE 16384
 
 std::vector<std::string> NetworkUtils::get_interface_ips() {
     std::vector<std::string> ips;
-    struct ifaddrs *ifaddr, *ifa;
-    
-    if (getifaddrs(&ifaddr) == -1) {
-        std::cerr << "getifaddrs failed: " << strerror(errno) << std::endl;
-        return ips;
-    }
-    
-    // Walk through linked list
-    for (ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
-        if (ifa->ifa_addr == nullptr) {
+
+    for (const auto& iface : InterfaceCache::global().snapshot()) {
+        // Skip loopback
+        if (iface.loopback) {
             continue;
         }
-        
-        // Filter only IPv4 addresses
-        if (ifa->ifa_addr->sa_family == AF_INET) {
-            char ip[INET_ADDRSTRLEN];
-            void* addr_ptr = &((struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
-            
-            // Convert IP to string
-            inet_ntop(AF_INET, addr_ptr, ip, INET_ADDRSTRLEN);
-            
-            // Skip loopback
-            if (strcmp(ip, "127.0.0.1") != 0) {
-                ips.push_back(std::string(ip));
-                std::cout << "Found interface " << ifa->ifa_name << " with IP " << ip << std::endl;
+        for (const auto& ip : iface.ipv4) {
+            if (ip != "127.0.0.1") {
+                ips.push_back(ip);
+                std::cout << "Found interface " << iface.name << " with IP " << ip << std::endl;
             }
         }
     }
-    
-    freeifaddrs(ifaddr);
+
     return ips;
 }
 
 std::vector<std::string> NetworkUtils::get_wan_interface_ips() {
     std::vector<std::string> wan_ips;
-    struct ifaddrs *ifaddr, *ifa;
-    
-    if (getifaddrs(&ifaddr) == -1) {
-        std::cerr << "getifaddrs failed: " << strerror(errno) << std::endl;
-        return wan_ips;
-    }
-    
-    // Walk through linked list
-    for (ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
-        if (ifa->ifa_addr == nullptr) {
+
+    for (const auto& iface : InterfaceCache::global().snapshot()) {
+        if (iface.loopback || !iface.wan) {
             continue;
         }
-        
-        // Filter only IPv4 addresses
-        if (ifa->ifa_addr->sa_family == AF_INET) {
-            char ip[INET_ADDRSTRLEN];
-            void* addr_ptr = &((struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
-            
-            // Convert IP to string
-            inet_ntop(AF_INET, addr_ptr, ip, INET_ADDRSTRLEN);
-            
-            // Skip loopback
-            if (strcmp(ip, "127.0.0.1") != 0) {
-                // Check if this is a WAN interface
-                if (is_wan_interface(ifa->ifa_name)) {
-                    wan_ips.push_back(std::string(ip));
-                    std::cout << "Found WAN interface " << ifa->ifa_name << " with IP " << ip << std::endl;
-                }
+        for (const auto& ip : iface.ipv4) {
+            if (ip != "127.0.0.1") {
+                wan_ips.push_back(ip);
+                std::cout << "Found WAN interface " << iface.name << " with IP " << ip << std::endl;
             }
         }
     }
-    
-    freeifaddrs(ifaddr);
-    
+
     // If no WAN interfaces found, fallback to all non-loopback interfaces
     if (wan_ips.empty()) {
         std::cout << "No WAN interfaces found, falling back to all interfaces" << std::endl;
         return get_interface_ips();
     }
-    
+
     return wan_ips;
 }
 
 bool NetworkUtils::is_wan_interface(const std::string& interface_name) {
-    // Skip loopback
-    if (interface_name == "lo") {
+    return InterfaceCache::global().is_wan(interface_name);
+}
+
+// Strip surrounding whitespace and one pair of uci quotes
+static std::string unquote(const std::string& value) {
+    size_t begin = value.find_first_not_of(" \t\r");
+    size_t end = value.find_last_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    std::string result = value.substr(begin, end - begin + 1);
+    if (result.size() >= 2 && (result[0] == '\'' || result[0] == '"') && result.back() == result[0]) {
+        result = result.substr(1, result.size() - 2);
+    }
+    return result;
+}
+
+std::set<std::string> NetworkUtils::parse_uci_wan_devices(std::istream& config) {
+    std::set<std::string> devices;
+    bool in_wan = false;
+    std::string line;
+
+    while (std::getline(config, line)) {
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+
+        if (keyword == "config") {
+            // A new section: "config interface 'wan'"
+            std::string type, name;
+            tokens >> type >> name;
+            name = unquote(name);
+            in_wan = unquote(type) == "interface" && name.compare(0, 3, "wan") == 0;
+        } else if (in_wan && (keyword == "option" || keyword == "list")) {
+            // Older releases name the devices in ifname, newer ones in device;
+            // either may hold several space separated names
+            std::string key, value;
+            tokens >> key;
+            if (key != "ifname" && key != "device") {
+                continue;
+            }
+            std::getline(tokens, value);
+            std::istringstream names(unquote(value));
+            std::string device;
+            while (names >> device) {
+                // Skip "@wan" references to other interfaces
+                if (device[0] != '@') {
+                    devices.insert(device);
+                }
+            }
+        }
+    }
+
+    return devices;
+}
+
+InterfaceCache& InterfaceCache::global() {
+    static InterfaceCache cache;
+    return cache;
+}
+
+InterfaceCache::InterfaceCache() {
+    std::ifstream uci(UCI_NETWORK_CONFIG);
+    if (uci) {
+        m_uci_wan = NetworkUtils::parse_uci_wan_devices(uci);
+    }
+
+    if (open_netlink() && dump(RTM_GETLINK) && dump(RTM_GETADDR)) {
+        m_updates = 0;
+        m_loaded = true;
+        m_monitor = std::thread(&InterfaceCache::monitor_loop, this);
+        return;
+    }
+
+    // No netlink: take one snapshot that will not follow changes
+    std::cerr << "Interface monitoring unavailable, using a static interface list" << std::endl;
+    if (m_netlink_fd >= 0) {
+        close(m_netlink_fd);
+        m_netlink_fd = -1;
+    }
+    if (m_stop_fd >= 0) {
+        close(m_stop_fd);
+        m_stop_fd = -1;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_interfaces.clear();
+    scan_getifaddrs();
+}
+
+InterfaceCache::~InterfaceCache() {
+    if (m_monitor.joinable()) {
+        uint64_t one = 1;
+        ssize_t ret = write(m_stop_fd, &one, sizeof(one));
+        (void)ret;
+        m_monitor.join();
+    }
+    if (m_netlink_fd >= 0) {
+        close(m_netlink_fd);
+    }
+    if (m_stop_fd >= 0) {
+        close(m_stop_fd);
+    }
+}
+
+bool InterfaceCache::open_netlink() {
+    m_netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (m_netlink_fd < 0) {
+        std::cerr << "netlink socket failed: " << strerror(errno) << std::endl;
         return false;
     }
-    
-    // Skip Docker and bridge interfaces (usually LAN)
-    if (interface_name.substr(0, 4) == "docker" || 
-        interface_name.substr(0, 2) == "br" ||
-        interface_name.substr(0, 4) == "virbr") {
+
+    struct sockaddr_nl local;
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR;
+    if (bind(m_netlink_fd, (struct sockaddr*)&local, sizeof(local)) < 0) {
+        std::cerr << "netlink bind failed: " << strerror(errno) << std::endl;
         return false;
     }
-    
-    // Common WAN interface names
-    if (interface_name == "eth0" || 
-        interface_name == "ppp0" || 
-        interface_name == "wwan0" ||
-        interface_name == "wan" ||
-        interface_name.substr(0, 3) == "wan") {
-        return true;
+
+    m_stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_stop_fd < 0) {
+        std::cerr << "eventfd failed: " << strerror(errno) << std::endl;
+        return false;
     }
-    
-    // For OpenWRT, try to use UCI to determine if WAN
-    return check_uci_interface(interface_name);
+    return true;
 }
 
-bool NetworkUtils::check_uci_interface(const std::string& interface_name) {
-    // On OpenWRT, we can use uci to check if an interface is WAN
-    // Create child process for shell command
-    int pipefd[2];
-    if (pipe(pipefd) == -1) {
-        std::cerr << "pipe failed: " << strerror(errno) << std::endl;
+bool InterfaceCache::dump(int type) {
+    struct {
+        struct nlmsghdr header;
+        struct rtgenmsg body;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.body));
+    request.header.nlmsg_type = type;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++m_seq;
+    request.body.rtgen_family = type == RTM_GETADDR ? AF_INET : AF_UNSPEC;
+
+    struct sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(m_netlink_fd, &request, request.header.nlmsg_len, 0,
+               (struct sockaddr*)&kernel, sizeof(kernel)) < 0) {
+        std::cerr << "netlink dump request failed: " << strerror(errno) << std::endl;
         return false;
     }
-    
-    pid_t pid = fork();
-    if (pid == -1) {
-        std::cerr << "fork failed: " << strerror(errno) << std::endl;
-        close(pipefd[0]);
-        close(pipefd[1]);
+
+    bool done = false;
+    while (!done) {
+        if (read_messages(request.header.nlmsg_seq, &done) < 0) {
+            std::cerr << "netlink dump failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int InterfaceCache::read_messages(uint32_t wait_seq, bool* done) {
+    alignas(struct nlmsghdr) char buffer[NETLINK_BUFFER_SIZE];
+    ssize_t received = recv(m_netlink_fd, buffer, sizeof(buffer), 0);
+    if (received < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int len = static_cast<int>(received);
+    for (struct nlmsghdr* msg = (struct nlmsghdr*)buffer; NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+        if (msg->nlmsg_type == NLMSG_DONE || msg->nlmsg_type == NLMSG_ERROR) {
+            // End of our dump, or its failure; events never carry these
+            if (!done || wait_seq == 0 || msg->nlmsg_seq != wait_seq) {
+                continue;
+            }
+            if (msg->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr* err = (const struct nlmsgerr*)NLMSG_DATA(msg);
+                if (err->error != 0) {
+                    errno = -err->error;
+                    return -1;
+                }
+            }
+            *done = true;
+            continue;
+        }
+        apply(msg);
+    }
+    return static_cast<int>(received);
+}
+
+void InterfaceCache::apply(const struct nlmsghdr* msg) {
+    switch (msg->nlmsg_type) {
+    case RTM_NEWLINK: {
+        const struct ifinfomsg* info = (const struct ifinfomsg*)NLMSG_DATA(msg);
+        std::string name;
+        int len = IFLA_PAYLOAD(msg);
+        for (const struct rtattr* attr = IFLA_RTA(info); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+            if (attr->rta_type == IFLA_IFNAME) {
+                name = (const char*)RTA_DATA(attr);
+            }
+        }
+
+        Interface& iface = m_interfaces[info->ifi_index];
+        iface.loopback = (info->ifi_flags & IFF_LOOPBACK) != 0;
+        if (!name.empty() && name != iface.name) {
+            // New or renamed link
+            iface.name = name;
+            iface.wan = lookup_wan(name);
+        }
+        m_updates++;
+        break;
+    }
+    case RTM_DELLINK: {
+        const struct ifinfomsg* info = (const struct ifinfomsg*)NLMSG_DATA(msg);
+        auto it = m_interfaces.find(info->ifi_index);
+        if (it != m_interfaces.end()) {
+            std::cout << "Interface " << it->second.name << " removed" << std::endl;
+            m_interfaces.erase(it);
+        }
+        m_updates++;
+        break;
+    }
+    case RTM_NEWADDR:
+    case RTM_DELADDR: {
+        const struct ifaddrmsg* info = (const struct ifaddrmsg*)NLMSG_DATA(msg);
+        if (info->ifa_family != AF_INET) {
+            break;
+        }
+
+        // IFA_LOCAL is the interface's own address; on point-to-point
+        // links IFA_ADDRESS is the peer
+        const void* address = nullptr;
+        int len = IFA_PAYLOAD(msg);
+        for (const struct rtattr* attr = IFA_RTA(info); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+            if (attr->rta_type == IFA_LOCAL || (attr->rta_type == IFA_ADDRESS && !address)) {
+                address = RTA_DATA(attr);
+            }
+        }
+        if (!address) {
+            break;
+        }
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, address, ip, INET_ADDRSTRLEN);
+
+        Interface& iface = m_interfaces[info->ifa_index];
+        if (iface.name.empty()) {
+            // Address reported before its link
+            char name[IF_NAMESIZE];
+            if (if_indextoname(info->ifa_index, name)) {
+                iface.name = name;
+                iface.wan = lookup_wan(iface.name);
+            }
+        }
+
+        auto it = std::find(iface.ipv4.begin(), iface.ipv4.end(), ip);
+        if (msg->nlmsg_type == RTM_NEWADDR && it == iface.ipv4.end()) {
+            iface.ipv4.push_back(ip);
+            if (m_loaded) {
+                std::cout << "Interface " << iface.name << " gained IP " << ip << std::endl;
+            }
+        } else if (msg->nlmsg_type == RTM_DELADDR && it != iface.ipv4.end()) {
+            iface.ipv4.erase(it);
+            std::cout << "Interface " << iface.name << " lost IP " << ip << std::endl;
+        }
+        m_updates++;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void InterfaceCache::scan_getifaddrs() {
+    struct ifaddrs *ifaddr, *ifa;
+
+    if (getifaddrs(&ifaddr) == -1) {
+        std::cerr << "getifaddrs failed: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    for (ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == nullptr || ifa->ifa_addr->sa_family != AF_INET) {
+            continue;
+        }
+        char ip[INET_ADDRSTRLEN];
+        void* addr_ptr = &((struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
+        inet_ntop(AF_INET, addr_ptr, ip, INET_ADDRSTRLEN);
+
+        Interface& iface = m_interfaces[if_nametoindex(ifa->ifa_name)];
+        if (iface.name.empty()) {
+            iface.name = ifa->ifa_name;
+            iface.loopback = (ifa->ifa_flags & IFF_LOOPBACK) != 0;
+            iface.wan = lookup_wan(iface.name);
+        }
+        iface.ipv4.push_back(ip);
+    }
+
+    freeifaddrs(ifaddr);
+}
+
+void InterfaceCache::monitor_loop() {
+    struct pollfd fds[2];
+    fds[0].fd = m_netlink_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_stop_fd;
+    fds[1].events = POLLIN;
+
+    while (true) {
+        int ready = poll(fds, 2, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "netlink poll failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (fds[1].revents & POLLIN) {
+            return;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        if (read_messages(0, nullptr) < 0) {
+            if (errno != ENOBUFS) {
+                std::cerr << "netlink receive failed: " << strerror(errno) << std::endl;
+                return;
+            }
+            // The kernel dropped events while the socket buffer was full;
+            // rebuild the table from a fresh dump
+            std::cerr << "Interface events lost, reloading interface list" << std::endl;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_interfaces.clear();
+                m_loaded = false;
+            }
+            bool reloaded = dump(RTM_GETLINK) && dump(RTM_GETADDR);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loaded = true;
+            if (!reloaded) {
+                return;
+            }
+        }
+    }
+}
+
+bool InterfaceCache::classify(const std::string& name) const {
+    // Skip loopback
+    if (name == "lo") {
+        return false;
+    }
+
+    // Devices the OpenWRT wan interfaces are configured on
+    if (m_uci_wan.count(name)) {
+        return true;
+    }
+
+    // Skip Docker and bridge interfaces (usually LAN)
+    if (name.compare(0, 6, "docker") == 0 ||
+        name.compare(0, 2, "br") == 0 ||
+        name.compare(0, 5, "virbr") == 0) {
         return false;
     }
-    
-    if (pid == 0) {
-        // Child process
-        close(pipefd[0]);  // Close read end
-        
-        // Redirect stdout to pipe
-        dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[1]);
-        
-        // Execute uci command
-        execlp("uci", "uci", "show", "network.wan.ifname", nullptr);
-        
-        // If execlp returns, it failed
-        std::cerr << "execlp failed: " << strerror(errno) << std::endl;
-        exit(1);
-    } else {
-        // Parent process
-        close(pipefd[1]);  // Close write end
-        
-        // Read output
-        char buffer[1024];
-        std::string output;
-        ssize_t count;
-        
-        while ((count = read(pipefd[0], buffer, sizeof(buffer))) > 0) {
-            output.append(buffer, count);
-        }
-        
-        close(pipefd[0]);
-        
-        // Wait for child
-        int status;
-        waitpid(pid, &status, 0);
-        
-        // Check if interface name appears in output
-        return output.find(interface_name) != std::string::npos;
-    }
-    
-    return false;
+
+    // Common WAN interface names
+    return name == "eth0" ||
+           name == "ppp0" ||
+           name == "wwan0" ||
+           name.compare(0, 3, "wan") == 0;
+}
+
+bool InterfaceCache::lookup_wan(const std::string& name) {
+    auto it = m_wan_cache.find(name);
+    if (it == m_wan_cache.end()) {
+        it = m_wan_cache.emplace(name, classify(name)).first;
+    }
+    return it->second;
+}
+
+bool InterfaceCache::is_wan(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return lookup_wan(name);
+}
+
+std::vector<InterfaceCache::Interface> InterfaceCache::snapshot() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Interface> interfaces;
+    interfaces.reserve(m_interfaces.size());
+    for (const auto& entry : m_interfaces) {
+        if (!entry.second.name.empty()) {
+            interfaces.push_back(entry.second);
+        }
+    }
+    return interfaces;
+}
+
+uint64_t InterfaceCache::updates() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_updates;
 }
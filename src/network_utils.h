@@ -1,23 +1,106 @@
 #ifndef NETWORK_UTILS_H
 #define NETWORK_UTILS_H
 
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
+struct nlmsghdr;
+
 class NetworkUtils {
 public:
     // Get list of all interface IPs
     static std::vector<std::string> get_interface_ips();
-    
+
     // Get list of WAN interface IPs
     static std::vector<std::string> get_wan_interface_ips();
-    
+
     // Check if interface is a WAN interface
     static bool is_wan_interface(const std::string& interface_name);
-    
+
+    // Devices of the OpenWRT "wan*" interfaces in a /etc/config/network
+    // style file, from their ifname and device options
+    static std::set<std::string> parse_uci_wan_devices(std::istream& config);
+};
+
+// Process-wide table of interfaces and their IPv4 addresses. Filled by one
+// rtnetlink dump on first use and kept current from link and address
+// events by a monitor thread; falls back to a one-shot getifaddrs() scan
+// where netlink is unavailable. WAN classification is computed once per
+// interface name.
+class InterfaceCache {
+public:
+    struct Interface {
+        std::string name;
+        bool loopback = false;
+        bool wan = false;
+        std::vector<std::string> ipv4;
+    };
+
+    static InterfaceCache& global();
+
+    // Copy of every known interface, ordered by interface index
+    std::vector<Interface> snapshot() const;
+
+    // Cached WAN classification of an interface name
+    bool is_wan(const std::string& name);
+
+    // Number of link and address changes applied since the initial dump
+    uint64_t updates() const;
+
+    // True if the table is kept current by netlink events
+    bool live() const { return m_netlink_fd >= 0; }
+
+    ~InterfaceCache();
+
 private:
-    // Check interface properties using ubus/uci (OpenWRT specific)
-    static bool check_uci_interface(const std::string& interface_name);
+    InterfaceCache();
+    InterfaceCache(const InterfaceCache&) = delete;
+    InterfaceCache& operator=(const InterfaceCache&) = delete;
+
+    // Open the netlink socket subscribed to link and IPv4 address events
+    bool open_netlink();
+
+    // Request a dump of links or addresses and apply the replies; events
+    // arriving in between are applied as well
+    bool dump(int type);
+
+    // Read one batch from the netlink socket and apply it; returns the
+    // number of bytes read, or -1 on error
+    int read_messages(uint32_t wait_seq, bool* done);
+
+    // Apply one link or address message; caller holds m_mutex
+    void apply(const struct nlmsghdr* msg);
+
+    // One-shot scan used when netlink is not available
+    void scan_getifaddrs();
+
+    // Apply events until the cache is destroyed
+    void monitor_loop();
+
+    // Classify a name without the cache; caller holds m_mutex
+    bool classify(const std::string& name) const;
+
+    // Classify a name through the cache; caller holds m_mutex
+    bool lookup_wan(const std::string& name);
+
+    mutable std::mutex m_mutex;
+    std::map<int, Interface> m_interfaces;
+    std::map<std::string, bool> m_wan_cache;
+    std::set<std::string> m_uci_wan;
+    uint64_t m_updates = 0;
+    // Set once the initial dump is applied, so only later changes are logged
+    bool m_loaded = false;
+
+    int m_netlink_fd = -1;
+    int m_stop_fd = -1;
+    uint32_t m_seq = 0;
+    std::thread m_monitor;
 };
 
 #endif // NETWORK_UTILS_H
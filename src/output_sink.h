@@ -0,0 +1,28 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <string>
+#include "packet_pool.h"
+
+// Destination that inputs hand received packets to. Implementations own
+// their send queue and thread; inputs only ever call send_packet().
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    // Queue a pooled packet without copying it. Called from a single
+    // ingest thread; must never block, dropping the packet instead.
+    virtual bool send_packet(const PacketRef& packet) = 0;
+
+    // Destination(s) for log messages and metric labels
+    virtual std::string describe() const = 0;
+
+    // Wait up to timeout_ms for everything queued to be sent; false if
+    // packets are still queued. Only called once inputs stopped sending.
+    virtual bool drain(int timeout_ms) {
+        (void)timeout_ms;
+        return true;
+    }
+};
+
+#endif // OUTPUT_SINK_H
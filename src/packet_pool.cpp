@@ -0,0 +1,44 @@
+#include "packet_pool.h"
+
+PacketPool::PacketPool(size_t slot_count, size_t slot_size)
+    : m_slot_size(slot_size), m_slab(slot_count * slot_size), m_buffers(slot_count) {
+    // Thread every buffer onto the free list
+    for (size_t i = 0; i < slot_count; i++) {
+        PacketBuffer& buffer = m_buffers[i];
+        buffer.data = m_slab.data() + i * slot_size;
+        buffer.pool = this;
+        buffer.next_free = m_free.load(std::memory_order_relaxed);
+        m_free.store(&buffer, std::memory_order_relaxed);
+    }
+}
+
+PacketRef PacketPool::acquire() {
+    PacketBuffer* head = m_free.load(std::memory_order_acquire);
+    while (head && !m_free.compare_exchange_weak(head, head->next_free,
+                                                 std::memory_order_acquire,
+                                                 std::memory_order_acquire)) {
+    }
+
+    if (!head) {
+        m_exhausted.fetch_add(1, std::memory_order_relaxed);
+        return PacketRef();
+    }
+
+    head->refs.store(1, std::memory_order_relaxed);
+    head->data = m_slab.data() + (head - m_buffers.data()) * m_slot_size;
+    head->size = 0;
+    head->seq = 0;
+    head->ts_ntp = 0;
+    head->stamp_ns = 0;
+    head->rx_ns = 0;
+    return PacketRef(head);
+}
+
+void PacketPool::release(PacketBuffer* buffer) {
+    PacketBuffer* head = m_free.load(std::memory_order_relaxed);
+    do {
+        buffer->next_free = head;
+    } while (!m_free.compare_exchange_weak(head, buffer,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed));
+}
@@ -0,0 +1,157 @@
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Size of one pooled packet slot, large enough for any SRT live payload
+#define PACKET_SLOT_SIZE 1500
+
+class PacketPool;
+
+// Fixed-size buffer carved out of a PacketPool slab. The reference count
+// is intrusive so handing a packet to another output is one atomic add.
+struct PacketBuffer {
+    std::atomic<uint32_t> refs{0};
+    uint32_t size = 0;
+    char* data = nullptr;
+
+    // Stamp shared by every path of a redundancy group, zero when unset
+    uint64_t seq = 0;
+    uint64_t ts_ntp = 0;
+    int64_t stamp_ns = 0;      // Steady clock at stamping, for path delay
+
+    // Steady clock at receive when latency tracing is on, zero otherwise
+    int64_t rx_ns = 0;
+
+    PacketPool* pool = nullptr;
+    PacketBuffer* next_free = nullptr;
+};
+
+// Shared handle to a pooled buffer; the buffer returns to its pool when
+// the last handle is released
+class PacketRef {
+public:
+    PacketRef() = default;
+    explicit PacketRef(PacketBuffer* buffer) : m_buffer(buffer) {}
+
+    PacketRef(const PacketRef& other) : m_buffer(other.m_buffer) {
+        if (m_buffer) {
+            m_buffer->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    PacketRef(PacketRef&& other) noexcept : m_buffer(other.m_buffer) {
+        other.m_buffer = nullptr;
+    }
+
+    PacketRef& operator=(const PacketRef& other) {
+        if (this != &other) {
+            PacketRef(other).swap(*this);
+        }
+        return *this;
+    }
+
+    PacketRef& operator=(PacketRef&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_buffer = other.m_buffer;
+            other.m_buffer = nullptr;
+        }
+        return *this;
+    }
+
+    ~PacketRef() { reset(); }
+
+    // Drop this handle, returning the buffer to the pool if it was the last
+    void reset();
+
+    void swap(PacketRef& other) noexcept {
+        PacketBuffer* tmp = m_buffer;
+        m_buffer = other.m_buffer;
+        other.m_buffer = tmp;
+    }
+
+    explicit operator bool() const { return m_buffer != nullptr; }
+
+    char* data() const { return m_buffer->data; }
+    size_t size() const { return m_buffer->size; }
+    void set_size(size_t size) { m_buffer->size = static_cast<uint32_t>(size); }
+    size_t capacity() const;
+    
+    // Drop n bytes from the front, e.g. a protocol header, without moving
+    // the payload; the buffer's full capacity is restored on reuse
+    void trim_front(size_t n) {
+        m_buffer->data += n;
+        m_buffer->size -= static_cast<uint32_t>(n);
+    }
+
+    // Redundancy stamp, written by the ingest thread before the packet is
+    // queued and read-only afterwards
+    void set_stamp(uint64_t seq, uint64_t ts_ntp, int64_t stamp_ns) {
+        m_buffer->seq = seq;
+        m_buffer->ts_ntp = ts_ntp;
+        m_buffer->stamp_ns = stamp_ns;
+    }
+    uint64_t seq() const { return m_buffer->seq; }
+    uint64_t ts_ntp() const { return m_buffer->ts_ntp; }
+    int64_t stamp_ns() const { return m_buffer->stamp_ns; }
+
+    // Receive time for latency tracing, written by the ingest thread
+    void set_rx_ns(int64_t rx_ns) { m_buffer->rx_ns = rx_ns; }
+    int64_t rx_ns() const { return m_buffer->rx_ns; }
+
+private:
+    PacketBuffer* m_buffer = nullptr;
+};
+
+// Preallocated slab of packet buffers. acquire() must only be called from
+// one thread at a time (the ingest thread); buffers may be released from
+// any thread through a lock-free free list.
+class PacketPool {
+public:
+    explicit PacketPool(size_t slot_count, size_t slot_size = PACKET_SLOT_SIZE);
+
+    PacketPool(const PacketPool&) = delete;
+    PacketPool& operator=(const PacketPool&) = delete;
+
+    // Take a free buffer, or an empty handle when the pool is exhausted
+    PacketRef acquire();
+
+    size_t slot_size() const { return m_slot_size; }
+    size_t capacity() const { return m_buffers.size(); }
+
+    // Number of acquire() calls that found the pool empty
+    uint64_t exhausted() const { return m_exhausted.load(std::memory_order_relaxed); }
+
+private:
+    friend class PacketRef;
+
+    // Push a buffer back onto the free list
+    void release(PacketBuffer* buffer);
+
+    size_t m_slot_size;
+    std::vector<char> m_slab;
+    std::vector<PacketBuffer> m_buffers;
+
+    // Treiber stack; safe against ABA because only acquire() pops
+    std::atomic<PacketBuffer*> m_free{nullptr};
+    std::atomic<uint64_t> m_exhausted{0};
+};
+
+inline void PacketRef::reset() {
+    if (m_buffer) {
+        if (m_buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            m_buffer->pool->release(m_buffer);
+        }
+        m_buffer = nullptr;
+    }
+}
+
+inline size_t PacketRef::capacity() const {
+    return m_buffer->pool->slot_size();
+}
+
+#endif // PACKET_POOL_H
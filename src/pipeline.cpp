@@ -0,0 +1,287 @@
+#include "pipeline.h"
+#include "srt_input.h"
+#include "rtsp_input.h"
+#include "udp_input.h"
+#include "network_utils.h"
+#include "redundancy_group.h"
+#include "udp_output.h"
+#include <iostream>
+#include <stdexcept>
+#include <ctime>
+
+// Pool slots beyond the RIST queue depth for packets still being received
+#define PACKET_POOL_HEADROOM 256
+
+Pipeline::Pipeline(const Config& config, const std::string& name)
+    : m_config(config), m_name(name) {
+}
+
+Pipeline::~Pipeline() {
+    stop();
+}
+
+std::shared_ptr<RistOutput> Pipeline::make_output(const std::string& dst, int port) {
+    return setup_output(std::make_shared<RistOutput>(dst, port, m_config.rist_queue_depth));
+}
+
+std::shared_ptr<RistOutput> Pipeline::setup_output(std::shared_ptr<RistOutput> rist) {
+    rist->set_feedback_callback(m_feedback);
+    rist->set_packetizer(m_config.ts_packets_per_datagram, m_config.ts_flush_ms);
+    if (m_trace) {
+        rist->set_latency_trace(m_trace, static_cast<uint16_t>(m_outputs.size()));
+    }
+    
+    if (!rist->init()) {
+        throw std::runtime_error("Failed to initialize RIST output");
+    }
+    return rist;
+}
+
+std::shared_ptr<OutputSink> Pipeline::make_stream_output(const std::string& stream_id) {
+    const auto& routes = m_config.stream_routes;
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (routes[i].stream_id != stream_id) {
+            continue;
+        }
+        
+        // Callers are independent encoders, so no bitrate feedback
+        auto rist = std::make_shared<RistOutput>(routes[i].rist_dst, routes[i].rist_port,
+                                                 m_config.rist_queue_depth);
+        rist->set_packetizer(m_config.ts_packets_per_datagram, m_config.ts_flush_ms);
+        if (m_trace) {
+            rist->set_latency_trace(m_trace, static_cast<uint16_t>(i));
+        }
+        if (!rist->init()) {
+            return nullptr;
+        }
+        return rist;
+    }
+    return nullptr;
+}
+
+void Pipeline::init() {
+    Config& config = m_config;
+
+    // Setup feedback handler
+    // Redundant routes each carry the whole stream, so the weakest one
+    // bounds the bitrate; otherwise route capacities add up
+    auto aggregation = config.multi_output == MultiOutput::REDUNDANT
+        ? RateController::Aggregation::MIN : RateController::Aggregation::SUM;
+    m_feedback = std::make_shared<Feedback>(
+        config.min_bitrate, config.max_bitrate,
+        config.feedback_ip, config.feedback_port, config.encoder, aggregation);
+
+    if (config.latency_trace > 0) {
+        m_trace = std::make_shared<LatencyTrace>(config.latency_trace);
+    }
+
+    // Setup input and output based on config
+    if (config.mode == InputMode::SRT) {
+        if (config.srt_mode == SRTMode::MULTI) {
+            // Get available WAN interfaces if using "auto"
+            if (config.filter_to_wan) {
+                auto wan_ips = NetworkUtils::get_wan_interface_ips();
+                if (wan_ips.empty()) {
+                    throw std::runtime_error("No WAN interfaces found");
+                }
+
+                // Assign IPs to multi-route config
+                size_t ip_index = 0;
+                for (auto& route : config.multi_routes) {
+                    if (route.interface_ip == "auto") {
+                        if (ip_index < wan_ips.size()) {
+                            route.interface_ip = wan_ips[ip_index++];
+                            std::cout << "Assigned WAN IP " << route.interface_ip
+                                      << " to route " << ip_index << std::endl;
+                        } else {
+                            throw std::runtime_error("Not enough WAN interfaces for configured routes");
+                        }
+                    }
+                }
+            }
+
+            // Create multi-interface SRT input
+            auto srt_input = std::make_unique<SRTInput>(config.listen_port);
+
+            if (config.multi_output == MultiOutput::BONDED) {
+                // One RIST context bonding every route, weighted by link health
+                std::vector<RistOutput::PeerConfig> peers;
+                for (const auto& route : config.multi_routes) {
+                    peers.push_back({route.rist_dst, route.rist_port, static_cast<uint32_t>(route.weight)});
+                }
+                auto rist = std::make_shared<RistOutput>(peers, config.rist_queue_depth);
+                rist->set_adaptive_weights(true);
+                m_outputs.push_back(setup_output(rist));
+
+                for (const auto& route : config.multi_routes) {
+                    srt_input->add_binding(route.interface_ip, m_outputs[0]);
+                }
+            } else if (config.multi_output == MultiOutput::REDUNDANT) {
+                // One output per route, each fed a stamped copy of every
+                // packet regardless of the interface it arrived on
+                auto group = std::make_shared<RedundancyGroup>();
+                for (const auto& route : config.multi_routes) {
+                    auto rist = std::make_shared<RistOutput>(
+                        route.rist_dst, route.rist_port, config.rist_queue_depth);
+                    rist->set_redundancy_group(group);
+                    m_outputs.push_back(setup_output(rist));
+                }
+                for (size_t i = 0; i < config.multi_routes.size(); i++) {
+                    srt_input->add_binding(config.multi_routes[i].interface_ip, m_outputs[i]);
+                }
+            } else {
+                // Create multiple RIST outputs
+                for (const auto& route : config.multi_routes) {
+                    m_outputs.push_back(make_output(route.rist_dst, route.rist_port));
+                }
+                for (size_t i = 0; i < config.multi_routes.size(); i++) {
+                    srt_input->add_binding(config.multi_routes[i].interface_ip, m_outputs[i]);
+                }
+            }
+            srt_input->set_recv_budget(config.srt_recv_budget);
+            srt_input->set_group_connect(config.srt_groups);
+            m_srt_input = srt_input.get();
+            m_input = std::move(srt_input);
+
+        } else if (config.srt_mode == SRTMode::CALLER) {
+            // Create SRT caller input
+            m_outputs.push_back(make_output(config.rist_dst, config.rist_port));
+            auto srt_input = std::make_unique<SRTInput>(config.input_url, m_outputs[0]);
+            srt_input->set_recv_budget(config.srt_recv_budget);
+            m_srt_input = srt_input.get();
+            m_input = std::move(srt_input);
+
+        } else if (config.srt_mode == SRTMode::LISTENER && !config.stream_routes.empty()) {
+            // One port shared by many callers, each routed by stream ID to
+            // a RIST output that exists while it is connected
+            std::vector<std::string> stream_ids;
+            for (const auto& route : config.stream_routes) {
+                stream_ids.push_back(route.stream_id);
+            }
+            auto srt_input = std::make_unique<SRTInput>(
+                config.listen_port, stream_ids,
+                [this](const std::string& stream_id) { return make_stream_output(stream_id); });
+            srt_input->set_recv_budget(config.srt_recv_budget);
+            srt_input->set_group_connect(config.srt_groups);
+            m_srt_input = srt_input.get();
+            m_input = std::move(srt_input);
+
+        } else if (config.srt_mode == SRTMode::LISTENER) {
+            // Create SRT listener input
+            m_outputs.push_back(make_output(config.rist_dst, config.rist_port));
+            auto srt_input = std::make_unique<SRTInput>(config.listen_port, m_outputs[0]);
+            srt_input->set_recv_budget(config.srt_recv_budget);
+            srt_input->set_group_connect(config.srt_groups);
+            m_srt_input = srt_input.get();
+            m_input = std::move(srt_input);
+        }
+    } else if (config.mode == InputMode::RTSP) {
+        // Create RTSP input
+        m_outputs.push_back(make_output(config.rist_dst, config.rist_port));
+        m_input = std::make_unique<RTSPInput>(config.input_url, m_outputs[0], config.rtsp);
+    } else if (config.mode == InputMode::UDP) {
+        // Create UDP/RTP input
+        m_outputs.push_back(make_output(config.rist_dst, config.rist_port));
+        m_input = std::make_unique<UdpInput>(config.udp_input, m_outputs[0]);
+    }
+
+    if (!m_input || (m_outputs.empty() && config.stream_routes.empty())) {
+        throw std::runtime_error("Failed to initialize input or output");
+    }
+
+    // Local UDP/multicast copies of everything received
+    for (const auto& udp : config.udp_outputs) {
+        auto output = std::make_shared<UdpOutput>(udp, config.rist_queue_depth);
+        if (!output->init()) {
+            throw std::runtime_error("Failed to initialize UDP output " + output->describe());
+        }
+        m_input->add_fanout(output);
+        m_fanout.push_back(output);
+    }
+
+    // Timeshift recording of everything received, with a RIST output of
+    // its own for replays so they never share a send queue with the input
+    if (!config.record.path.empty()) {
+        m_recorder = std::make_shared<RingRecorder>(config.record, config.rist_queue_depth);
+        if (!m_recorder->init()) {
+            throw std::runtime_error("Failed to initialize recording to " + config.record.path);
+        }
+        m_input->add_fanout(m_recorder);
+        m_fanout.push_back(m_recorder);
+
+        if (config.record.replay_port > 0) {
+            // No feedback: replayed traffic must not steer the encoder
+            m_replay_output = std::make_shared<RistOutput>(
+                config.record.replay_dst, config.record.replay_port, config.rist_queue_depth);
+            m_replay_output->set_packetizer(config.ts_packets_per_datagram, config.ts_flush_ms);
+            if (!m_replay_output->init()) {
+                throw std::runtime_error("Failed to initialize replay output");
+            }
+        }
+    }
+
+    // A packet fanned out to several outputs holds a single slot, so
+    // the pool only has to cover every output queue being full at once
+    size_t queues = m_outputs.size() + m_fanout.size() + config.stream_routes.size();
+    m_pool = std::make_shared<PacketPool>(config.rist_queue_depth * queues + PACKET_POOL_HEADROOM);
+    m_input->set_packet_pool(m_pool);
+    m_input->set_latency_tracing(m_trace != nullptr);
+}
+
+bool Pipeline::start(int wakeup_fd) {
+    if (!m_input) {
+        return false;
+    }
+
+    if (wakeup_fd >= 0) {
+        m_input->set_wakeup_fd(wakeup_fd);
+    }
+
+    m_started = m_input->start();
+    if (!m_started) {
+        std::cerr << "Failed to start stream " << m_name << std::endl;
+    }
+    return m_started;
+}
+
+void Pipeline::process() {
+    m_input->process();
+}
+
+void Pipeline::stop() {
+    if (m_started) {
+        m_input->stop();
+        m_started = false;
+    }
+}
+
+bool Pipeline::replay_recording() {
+    if (!m_recorder || !m_replay_output) {
+        return false;
+    }
+    if (!m_recorder->replay(m_replay_output, m_config.record.replay_seconds, m_config.record.replay_speed)) {
+        std::cout << "Stream " << m_name << ": "
+                  << (m_recorder->replaying() ? "a replay is already running" : "nothing recorded to replay")
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Pipeline::dump_latency_trace(const std::string& dir) const {
+    if (!m_trace) {
+        return false;
+    }
+
+    std::string path = dir + "/latency-" + m_name + "-" + std::to_string(time(nullptr)) + ".csv";
+    LatencyTrace::Summary summary;
+    if (!m_trace->dump(path, &summary)) {
+        return false;
+    }
+
+    std::cout << "Latency trace of " << m_name << " written to " << path
+              << ": total p50 " << summary.total.p50 << " us, p99 " << summary.total.p99
+              << " us, p999 " << summary.total.p999 << " us; queue p99 "
+              << summary.queue.p99 << " us" << std::endl;
+    return true;
+}
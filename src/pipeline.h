@@ -0,0 +1,77 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "input_base.h"
+#include "rist_output.h"
+#include "feedback.h"
+#include "packet_pool.h"
+#include "latency_trace.h"
+#include "ring_recorder.h"
+
+class SRTInput;
+
+// One independent relay: an input, its RIST outputs and feedback handler
+class Pipeline {
+public:
+    Pipeline(const Config& config, const std::string& name);
+    ~Pipeline();
+    
+    // Build input, outputs and feedback from the config; throws on failure
+    void init();
+    
+    // Start receiving; wakeup_fd interrupts a blocking process(), -1 if
+    // the caller polls the input itself
+    bool start(int wakeup_fd);
+    
+    // Process a single iteration of the input
+    void process();
+    
+    // Stop receiving input
+    void stop();
+    
+    const std::string& name() const { return m_name; }
+    
+    // Write the latency trace with its percentiles to a CSV file in dir;
+    // false if tracing is off for this pipeline or the file failed
+    bool dump_latency_trace(const std::string& dir) const;
+    
+    // Replay the last record_replay_seconds of the recording to the replay
+    // destination; false if recording or replay is off, or a replay is running
+    bool replay_recording();
+    
+    // SRT input of this pipeline, nullptr for other input modes
+    SRTInput* srt_input() const { return m_srt_input; }
+    
+private:
+    // Create and initialize one RIST output
+    std::shared_ptr<RistOutput> make_output(const std::string& dst, int port);
+    
+    // Attach feedback and packetizer to an output, then initialize it
+    std::shared_ptr<RistOutput> setup_output(std::shared_ptr<RistOutput> rist);
+    
+    // Create the RIST output of a routed SRT stream ID when its caller
+    // connects; nullptr on failure. Called on the SRT input's route thread.
+    std::shared_ptr<OutputSink> make_stream_output(const std::string& stream_id);
+    
+    Config m_config;
+    std::string m_name;
+    
+    // Declared first so it outlives every queued packet
+    std::shared_ptr<PacketPool> m_pool;
+    std::shared_ptr<Feedback> m_feedback;
+    std::shared_ptr<LatencyTrace> m_trace;
+    std::shared_ptr<RingRecorder> m_recorder;
+    // Fed from the recorder's replay pool, so released before the recorder
+    std::shared_ptr<RistOutput> m_replay_output;
+    std::vector<std::shared_ptr<RistOutput>> m_outputs;
+    std::vector<std::shared_ptr<OutputSink>> m_fanout;
+    std::unique_ptr<InputBase> m_input;
+    SRTInput* m_srt_input = nullptr;
+    bool m_started = false;
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,103 @@
+#include "rate_controller.h"
+#include <algorithm>
+#include <limits>
+
+// A route may probe this far above the bitrate it is actually carrying
+#define RATE_PROBE_HEADROOM 1.25
+
+RateController::RateController(const Params& params, Aggregation aggregation)
+    : m_params(params), m_aggregation(aggregation) {
+}
+
+void RateController::update(const std::string& route, double loss, double rtt_ms,
+                            double bandwidth_kbps, Clock::time_point now) {
+    auto it = m_routes.find(route);
+    if (it == m_routes.end()) {
+        // First sample seeds the estimates and starts from the carried rate
+        RouteState state;
+        state.estimate.loss = loss;
+        state.estimate.rtt = rtt_ms;
+        state.estimate.base_rtt = rtt_ms;
+        state.estimate.bandwidth = bandwidth_kbps;
+        state.estimate.rate = bandwidth_kbps > 0 ? bandwidth_kbps : m_params.min_bitrate;
+        state.last_sample = now;
+        state.last_increase = now;
+        m_routes[route] = state;
+        return;
+    }
+
+    RouteState& state = it->second;
+    RouteEstimate& est = state.estimate;
+    const double alpha = m_params.alpha;
+    est.loss += alpha * (loss - est.loss);
+    est.rtt += alpha * (rtt_ms - est.rtt);
+    est.bandwidth += alpha * (bandwidth_kbps - est.bandwidth);
+    if (rtt_ms > 0 && (est.base_rtt <= 0 || rtt_ms < est.base_rtt)) {
+        est.base_rtt = rtt_ms;
+    }
+    state.last_sample = now;
+
+    // Loss, or RTT inflated past the base by queueing, means congestion.
+    // The latest sample must show it too, so the smoothed estimates still
+    // decaying after a cut do not trigger another one; a severe loss
+    // sample acts at once rather than waiting for the EWMA.
+    bool severe = loss >= m_params.severe_loss;
+    double queue_rtt = est.base_rtt * m_params.rtt_inflation + m_params.rtt_slack_ms;
+    bool sample_congested = loss > m_params.loss_threshold ||
+        (est.base_rtt > 0 && rtt_ms > queue_rtt);
+    bool smoothed_congested = est.loss > m_params.loss_threshold ||
+        (est.base_rtt > 0 && est.rtt > queue_rtt);
+    bool congested = sample_congested && (severe || smoothed_congested);
+
+    auto since_decrease = now - state.last_decrease;
+    if (congested) {
+        if (!state.decreased ||
+            since_decrease >= std::chrono::milliseconds(m_params.decrease_interval_ms)) {
+            // Cut from what the route actually carried, not from a rate it
+            // was allowed but never used
+            double base = bandwidth_kbps > 0 ? std::min(est.rate, bandwidth_kbps) : est.rate;
+            est.rate = base * (severe ? m_params.severe_decrease : m_params.decrease);
+            state.last_decrease = now;
+            state.decreased = true;
+            ++est.decreases;
+        }
+    } else if (!smoothed_congested && est.loss < m_params.clean_loss &&
+               (!state.decreased || since_decrease >= std::chrono::milliseconds(m_params.hold_down_ms)) &&
+               now - state.last_increase >= std::chrono::milliseconds(m_params.increase_interval_ms)) {
+        // Probe upwards, but only a step beyond the carried bitrate so a
+        // route whose share of traffic is small cannot claim the maximum
+        double cap = est.bandwidth * RATE_PROBE_HEADROOM + m_params.increase_kbps;
+        if (est.rate < cap) {
+            est.rate = std::min(est.rate + m_params.increase_kbps, cap);
+            ++est.increases;
+        }
+        state.last_increase = now;
+    }
+
+    est.rate = std::min(est.rate, static_cast<double>(m_params.max_bitrate));
+}
+
+uint32_t RateController::target_bitrate(Clock::time_point now) const {
+    double total = 0.0;
+    double lowest = std::numeric_limits<double>::max();
+    bool any = false;
+    for (const auto& entry : m_routes) {
+        const RouteState& state = entry.second;
+        if (now - state.last_sample > std::chrono::milliseconds(m_params.stale_ms)) {
+            continue;
+        }
+        total += state.estimate.rate;
+        lowest = std::min(lowest, state.estimate.rate);
+        any = true;
+    }
+
+    double target = any ? (m_aggregation == Aggregation::MIN ? lowest : total) : 0.0;
+    target = std::max(target, static_cast<double>(m_params.min_bitrate));
+    target = std::min(target, static_cast<double>(m_params.max_bitrate));
+    return static_cast<uint32_t>(target);
+}
+
+const RateController::RouteEstimate* RateController::route(const std::string& route) const {
+    auto it = m_routes.find(route);
+    return it == m_routes.end() ? nullptr : &it->second.estimate;
+}
@@ -0,0 +1,83 @@
+#ifndef RATE_CONTROLLER_H
+#define RATE_CONTROLLER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Encoder bitrate controller driven by per-route RIST stats. Each route
+// keeps smoothed loss, RTT and bandwidth estimates and an AIMD rate: a
+// multiplicative cut when the route shows loss or queueing delay, then a
+// hold-down before additive increases resume. The target bitrate is the
+// routes' rates aggregated and clamped to the configured range. Time is
+// passed in, so the controller is deterministic and can replay traces.
+class RateController {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // How route rates combine into the encoder target
+    enum class Aggregation {
+        SUM,    // Routes carry different packets (split or bonded)
+        MIN     // Every route carries every packet (redundant)
+    };
+
+    struct Params {
+        uint32_t min_bitrate = 0;        // kbps
+        uint32_t max_bitrate = 0;        // kbps
+        double alpha = 0.3;              // EWMA weight of a new sample
+        double loss_threshold = 2.0;     // Smoothed loss (%) that counts as congestion
+        double severe_loss = 5.0;        // Loss (%) that triggers the deep cut
+        double clean_loss = 0.5;         // Loss (%) below which the rate may grow
+        double rtt_inflation = 1.5;      // RTT over this multiple of the base is queueing
+        double rtt_slack_ms = 10.0;      // Jitter allowed on top of the base RTT
+        double decrease = 0.85;          // Multiplicative cut on congestion
+        double severe_decrease = 0.7;    // Cut on severe loss
+        uint32_t increase_kbps = 200;    // Additive step per increase interval
+        int increase_interval_ms = 1000; // Minimum time between increases
+        int decrease_interval_ms = 1000; // Minimum time between cuts
+        int hold_down_ms = 3000;         // No increase for this long after a cut
+        int stale_ms = 5000;             // Routes silent this long are ignored
+    };
+
+    // Current estimates for one route
+    struct RouteEstimate {
+        double loss = 0.0;               // Smoothed loss, percent
+        double rtt = 0.0;                // Smoothed RTT, ms
+        double base_rtt = 0.0;           // Lowest RTT seen, ms
+        double bandwidth = 0.0;          // Smoothed sent bitrate, kbps
+        double rate = 0.0;               // AIMD rate, kbps
+        uint64_t decreases = 0;
+        uint64_t increases = 0;
+    };
+
+    explicit RateController(const Params& params, Aggregation aggregation = Aggregation::SUM);
+
+    // Fold one stats sample for a route into its estimates and rate
+    void update(const std::string& route, double loss, double rtt_ms,
+                double bandwidth_kbps, Clock::time_point now);
+
+    // Aggregated bitrate for the encoder, clamped to min/max (kbps)
+    uint32_t target_bitrate(Clock::time_point now) const;
+
+    // Estimates for a route, or nullptr if it never reported
+    const RouteEstimate* route(const std::string& route) const;
+
+    size_t route_count() const { return m_routes.size(); }
+
+private:
+    struct RouteState {
+        RouteEstimate estimate;
+        Clock::time_point last_sample;
+        Clock::time_point last_decrease;
+        Clock::time_point last_increase;
+        bool decreased = false;
+    };
+
+    Params m_params;
+    Aggregation m_aggregation;
+    std::map<std::string, RouteState> m_routes;
+};
+
+#endif // RATE_CONTROLLER_H
@@ -0,0 +1,46 @@
+#include "redundancy_group.h"
+#include <chrono>
+#include <random>
+
+// Seconds between the NTP epoch (1900) and the Unix epoch
+#define NTP_UNIX_OFFSET 2208988800ULL
+
+// Current wall clock as a 64-bit NTP timestamp (32.32 fixed point)
+static uint64_t ntp_now() {
+    auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+    uint64_t seconds = ns / 1000000000 + NTP_UNIX_OFFSET;
+    uint64_t fraction = ((ns % 1000000000) << 32) / 1000000000;
+    return (seconds << 32) | fraction;
+}
+
+RedundancyGroup::RedundancyGroup() {
+    std::random_device random;
+    m_flow_id = random() & ~1u;
+}
+
+void RedundancyGroup::add_path(RistOutput* output) {
+    m_paths.push_back(output);
+}
+
+void RedundancyGroup::send_packet(const PacketRef& packet) {
+    auto stamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    
+    // Stamp before the first enqueue; the queue's release store publishes
+    // it to every sender thread together with the payload
+    PacketRef stamped(packet);
+    stamped.set_stamp(m_next_seq++, ntp_now(), stamp_ns);
+    
+    for (RistOutput* path : m_paths) {
+        path->enqueue(stamped);
+    }
+}
+
+std::vector<RistOutput::PathStats> RedundancyGroup::get_path_stats() const {
+    std::vector<RistOutput::PathStats> result;
+    for (const RistOutput* path : m_paths) {
+        result.push_back(path->get_path_stats());
+    }
+    return result;
+}
@@ -0,0 +1,41 @@
+#ifndef REDUNDANCY_GROUP_H
+#define REDUNDANCY_GROUP_H
+
+#include <cstdint>
+#include <vector>
+#include "rist_output.h"
+
+// Seamless path protection: a packet handed to any member output is stamped
+// once with a shared sequence number and timestamp, then queued on every
+// member so the receiver can merge the copies hitlessly. Every member's
+// sender context uses the group's flow id, so the receiver sees one flow
+// arriving over several paths rather than unrelated flows. Each member keeps
+// its own queue and sender thread, so a stalled path only drops its own
+// copies and never delays the others.
+class RedundancyGroup {
+public:
+    RedundancyGroup();
+    
+    // Members are registered through RistOutput::set_redundancy_group()
+    // before any packet is sent, and must outlive the ingest thread
+    void add_path(RistOutput* output);
+
+    // Stamp the packet and queue it on every path; ingest thread only
+    void send_packet(const PacketRef& packet);
+
+    // Delivery counters for each path, in registration order
+    std::vector<RistOutput::PathStats> get_path_stats() const;
+
+    size_t path_count() const { return m_paths.size(); }
+    
+    // RIST flow id shared by every path; even, as librist reserves the
+    // lowest bit
+    uint32_t flow_id() const { return m_flow_id; }
+
+private:
+    std::vector<RistOutput*> m_paths;
+    uint32_t m_flow_id;
+    uint64_t m_next_seq = 0;     // Ingest thread only
+};
+
+#endif // REDUNDANCY_GROUP_H
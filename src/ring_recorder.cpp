@@ -0,0 +1,501 @@
+#include "ring_recorder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// "TSRR" in the first bytes of every block header
+#define RECORD_MAGIC 0x52525354
+// Receive time and size in front of every recorded payload
+#define RECORD_ENTRY_HEADER (sizeof(int64_t) + sizeof(uint32_t))
+// Packets appended per queue pass before the flush deadline is checked
+#define RECORD_DRAIN_BATCH 256
+// Replay pool slots beyond the recorder's queue depth
+#define REPLAY_POOL_HEADROOM 64
+
+static int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Record times are wall-clock so that a ring survives restarts
+static int64_t wall_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static size_t align_up(size_t n) {
+    return (n + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+}
+
+// Aligned buffer for O_DIRECT transfers, nullptr on failure
+static char* alloc_aligned(size_t size) {
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, RECORD_ALIGN, size) != 0) {
+        return nullptr;
+    }
+    memset(buffer, 0, size);
+    return static_cast<char*>(buffer);
+}
+
+// Full-length pread/pwrite, retrying short transfers
+static bool pread_all(int fd, char* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t ret = pread(fd, buffer, size, offset);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        buffer += ret;
+        size -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+static bool pwrite_all(int fd, const char* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t ret = pwrite(fd, buffer, size, offset);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        buffer += ret;
+        size -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+RingRecorder::RingRecorder(const RecordConfig& config, size_t queue_depth)
+    : m_config(config), m_queue(queue_depth), m_replay_pool_size(queue_depth + REPLAY_POOL_HEADROOM) {
+    auto& metrics = MetricsRegistry::global();
+    std::string labels = metric_label("file", describe());
+    m_bytes_written = metrics.counter("record_bytes_written_total", "Bytes written to recording rings", labels);
+    m_blocks_written = metrics.counter("record_blocks_written_total", "Ring blocks filled and closed", labels);
+    m_write_errors = metrics.counter("record_write_errors_total", "Failed recording ring writes", labels);
+    m_queue_drops = metrics.counter("record_queue_dropped_total", "Packets dropped on recorder queue overflow", labels);
+    m_replayed = metrics.counter("record_replayed_packets_total", "Recorded packets sent by replays", labels);
+}
+
+RingRecorder::~RingRecorder() {
+    m_running = false;
+    {
+        std::lock_guard<std::mutex> lock(m_wait_mutex);
+        m_wait_cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_replay_mutex);
+        m_replay_cv.notify_all();
+    }
+    if (m_writer_thread.joinable()) {
+        m_writer_thread.join();
+    }
+    if (m_replay_thread.joinable()) {
+        m_replay_thread.join();
+    }
+
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    free(m_block);
+}
+
+std::string RingRecorder::describe() const {
+    return m_config.path;
+}
+
+bool RingRecorder::init() {
+    m_block_count = static_cast<size_t>(m_config.size_mb) * 1024 * 1024 / RECORD_BLOCK_SIZE;
+    if (m_block_count < 2) {
+        std::cerr << "Recording ring " << describe() << " must hold at least two blocks" << std::endl;
+        return false;
+    }
+    m_index.assign(m_block_count, BlockInfo());
+
+    m_block = alloc_aligned(RECORD_BLOCK_SIZE);
+    if (!m_block) {
+        std::cerr << "Failed to allocate recording buffer" << std::endl;
+        return false;
+    }
+
+    // tmpfs and some FUSE filesystems reject O_DIRECT; fall back to the
+    // page cache there rather than not recording at all
+    m_fd = open(m_config.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_DIRECT, 0644);
+    m_direct = m_fd >= 0;
+    if (m_fd < 0 && errno == EINVAL) {
+        m_fd = open(m_config.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (m_fd < 0) {
+        std::cerr << "Failed to open recording ring " << describe() << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Reuse a ring of the same size, otherwise start over; allocating the
+    // whole file up front keeps block writes from extending it
+    off_t size = static_cast<off_t>(m_block_count) * RECORD_BLOCK_SIZE;
+    struct stat st;
+    if (fstat(m_fd, &st) == 0 && st.st_size == size) {
+        load_index();
+    } else {
+        int ret = ftruncate(m_fd, 0);
+        if (ret == 0) {
+            ret = posix_fallocate(m_fd, 0, size);
+            if (ret != 0) {
+                // Not supported everywhere (e.g. some FAT drivers)
+                ret = ftruncate(m_fd, size);
+            }
+        }
+        if (ret != 0) {
+            std::cerr << "Failed to allocate recording ring " << describe() << std::endl;
+            return false;
+        }
+    }
+
+    open_block();
+    m_running = true;
+    m_writer_thread = std::thread(&RingRecorder::writer_loop, this);
+
+    std::cout << "Recording to " << describe() << " (" << m_config.size_mb << " MiB ring"
+              << (m_direct ? ", O_DIRECT" : "") << ")" << std::endl;
+    return true;
+}
+
+void RingRecorder::load_index() {
+    char* sector = alloc_aligned(RECORD_ALIGN);
+    if (!sector) {
+        return;
+    }
+
+    size_t found = 0;
+    for (size_t slot = 0; slot < m_block_count; slot++) {
+        if (!pread_all(m_fd, sector, RECORD_ALIGN, static_cast<off_t>(slot) * RECORD_BLOCK_SIZE)) {
+            break;
+        }
+        BlockHeader header;
+        memcpy(&header, sector, sizeof(header));
+        if (header.magic != RECORD_MAGIC || header.sequence == 0 ||
+            (header.sequence - 1) % m_block_count != slot ||
+            header.bytes <= RECORD_ALIGN || header.bytes > RECORD_BLOCK_SIZE) {
+            continue;
+        }
+
+        m_index[slot].sequence = header.sequence;
+        m_index[slot].first_ns = header.first_ns;
+        m_index[slot].last_ns = header.last_ns;
+        m_index[slot].bytes = header.bytes;
+        m_sequence = std::max(m_sequence, header.sequence);
+        found++;
+    }
+    free(sector);
+
+    if (found > 0) {
+        std::cout << "Recording ring " << describe() << " holds " << found
+                  << " blocks from an earlier run" << std::endl;
+    }
+}
+
+bool RingRecorder::send_packet(const PacketRef& packet) {
+    if (!m_running) {
+        return false;
+    }
+
+    PacketRef* slot = m_queue.write_slot();
+    if (!slot) {
+        // Slow storage must never back-pressure the ingest thread
+        m_queue_drops->inc();
+        return false;
+    }
+
+    *slot = packet;
+    m_queue.commit_write();
+
+    // Wake the writer only if it is parked on an empty queue; the fence
+    // orders the publish above against reading the waiting flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_writer_waiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_wait_mutex);
+        m_wait_cv.notify_one();
+    }
+    return true;
+}
+
+void RingRecorder::writer_loop() {
+    int64_t flush_ns = static_cast<int64_t>(m_config.flush_ms) * 1000000;
+    auto wait = std::chrono::milliseconds(std::min(m_config.flush_ms, 100));
+
+    while (m_running) {
+        size_t count = 0;
+        while (count < RECORD_DRAIN_BATCH) {
+            PacketRef* slot = m_queue.read_slot();
+            if (!slot) {
+                break;
+            }
+            PacketRef packet = std::move(*slot);
+            m_queue.commit_read();
+            append(packet);
+            count++;
+        }
+
+        // A partly filled block goes to disk once its oldest record is
+        // flush_ms old, bounding what a power cut can lose
+        if (m_used > m_flushed && monotonic_ns() - m_opened_ns >= flush_ns) {
+            flush_block();
+        }
+
+        if (count == 0) {
+            std::unique_lock<std::mutex> lock(m_wait_mutex);
+            m_writer_waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // Re-check after announcing the wait so a concurrent push is not missed
+            m_wait_cv.wait_for(lock, wait, [this] {
+                return !m_running || !m_queue.empty();
+            });
+            m_writer_waiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // Keep whatever was received up to shutdown
+    while (PacketRef* slot = m_queue.read_slot()) {
+        PacketRef packet = std::move(*slot);
+        m_queue.commit_read();
+        append(packet);
+    }
+    flush_block();
+}
+
+void RingRecorder::open_block() {
+    m_sequence++;
+    m_used = RECORD_ALIGN;
+    m_flushed = 0;
+    m_opened_ns = 0;
+    memset(m_block, 0, RECORD_ALIGN);
+
+    BlockHeader header = {};
+    header.magic = RECORD_MAGIC;
+    header.sequence = m_sequence;
+    header.bytes = static_cast<uint32_t>(m_used);
+    memcpy(m_block, &header, sizeof(header));
+
+    // The slot's old contents are about to be overwritten
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    m_index[(m_sequence - 1) % m_block_count] = BlockInfo();
+}
+
+void RingRecorder::append(const PacketRef& packet) {
+    size_t size = packet.size();
+    size_t needed = RECORD_ENTRY_HEADER + size;
+    if (needed > RECORD_BLOCK_SIZE - RECORD_ALIGN) {
+        return;
+    }
+    if (m_used + needed > RECORD_BLOCK_SIZE) {
+        flush_block();
+        m_blocks_written->inc();
+        open_block();
+    }
+
+    int64_t now = wall_ns();
+    uint32_t size32 = static_cast<uint32_t>(size);
+    char* entry = m_block + m_used;
+    memcpy(entry, &now, sizeof(now));
+    memcpy(entry + sizeof(now), &size32, sizeof(size32));
+    memcpy(entry + RECORD_ENTRY_HEADER, packet.data(), size);
+    m_used += needed;
+
+    BlockHeader* header = reinterpret_cast<BlockHeader*>(m_block);
+    if (header->records == 0) {
+        header->first_ns = now;
+    }
+    header->last_ns = now;
+    header->records++;
+    header->bytes = static_cast<uint32_t>(m_used);
+    if (m_opened_ns == 0) {
+        m_opened_ns = monotonic_ns();
+    }
+}
+
+bool RingRecorder::flush_block() {
+    if (m_used == m_flushed) {
+        return true;
+    }
+
+    // O_DIRECT needs sector-aligned transfers: rewrite from the sector the
+    // last flush ended in, zero-padded up to the next boundary
+    size_t start = m_flushed / RECORD_ALIGN * RECORD_ALIGN;
+    size_t end = align_up(m_used);
+    memset(m_block + m_used, 0, end - m_used);
+
+    off_t base = static_cast<off_t>((m_sequence - 1) % m_block_count) * RECORD_BLOCK_SIZE;
+    bool ok = pwrite_all(m_fd, m_block + start, end - start, base + start);
+    if (ok && start > 0) {
+        // Header last, so it never covers records that are not on disk
+        ok = pwrite_all(m_fd, m_block, RECORD_ALIGN, base);
+    }
+    m_opened_ns = 0;
+
+    if (!ok) {
+        m_write_errors->inc();
+        if (!m_write_failed) {
+            std::cerr << "Recording ring " << describe() << " write failed: " << strerror(errno) << std::endl;
+            m_write_failed = true;
+        }
+        return false;
+    }
+    if (m_write_failed) {
+        std::cout << "Recording ring " << describe() << " writes recovered" << std::endl;
+        m_write_failed = false;
+    }
+
+    m_bytes_written->inc(end - start);
+    m_flushed = m_used;
+
+    const BlockHeader* header = reinterpret_cast<const BlockHeader*>(m_block);
+    std::lock_guard<std::mutex> lock(m_index_mutex);
+    BlockInfo& info = m_index[(m_sequence - 1) % m_block_count];
+    info.sequence = header->sequence;
+    info.first_ns = header->first_ns;
+    info.last_ns = header->last_ns;
+    info.bytes = header->bytes;
+    return true;
+}
+
+bool RingRecorder::replay(std::shared_ptr<OutputSink> target, int seconds, double speed) {
+    if (!m_running || m_replaying.exchange(true)) {
+        return false;
+    }
+    // Any previous replay has finished, since it cleared the flag
+    if (m_replay_thread.joinable()) {
+        m_replay_thread.join();
+    }
+
+    int64_t start_ns = wall_ns() - static_cast<int64_t>(seconds) * 1000000000;
+    std::vector<BlockInfo> blocks;
+    {
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        for (const auto& info : m_index) {
+            if (info.sequence != 0 && info.last_ns >= start_ns) {
+                blocks.push_back(info);
+            }
+        }
+    }
+    if (blocks.empty()) {
+        m_replaying = false;
+        return false;
+    }
+    std::sort(blocks.begin(), blocks.end(), [](const BlockInfo& a, const BlockInfo& b) {
+        return a.sequence < b.sequence;
+    });
+
+    if (!m_replay_pool) {
+        m_replay_pool = std::make_shared<PacketPool>(m_replay_pool_size);
+    }
+
+    std::cout << "Replaying the last " << seconds << " s of " << describe() << " to "
+              << target->describe() << " (" << blocks.size() << " blocks)" << std::endl;
+    m_replay_thread = std::thread(&RingRecorder::replay_loop, this, std::move(blocks), target,
+                                  start_ns, speed);
+    return true;
+}
+
+void RingRecorder::replay_loop(std::vector<BlockInfo> blocks, std::shared_ptr<OutputSink> target,
+                               int64_t start_ns, double speed) {
+    // A descriptor of its own, opened like the writer's so reads see
+    // what O_DIRECT wrote rather than stale page cache
+    int fd = open(m_config.path.c_str(), O_RDONLY | O_CLOEXEC | (m_direct ? O_DIRECT : 0));
+    char* buffer = alloc_aligned(RECORD_BLOCK_SIZE);
+    uint64_t sent = 0;
+    uint64_t skipped = 0;
+
+    // Records are sent at their recorded spacing, divided by speed
+    auto replay_start = std::chrono::steady_clock::now();
+    int64_t first_ns = -1;
+
+    for (const BlockInfo& block : blocks) {
+        if (fd < 0 || !buffer || !m_running) {
+            break;
+        }
+        size_t length = align_up(block.bytes);
+        off_t offset = static_cast<off_t>((block.sequence - 1) % m_block_count) * RECORD_BLOCK_SIZE;
+        if (!pread_all(fd, buffer, length, offset)) {
+            break;
+        }
+
+        // The writer may have lapped a slow replay
+        BlockHeader header;
+        memcpy(&header, buffer, sizeof(header));
+        if (header.magic != RECORD_MAGIC || header.sequence != block.sequence) {
+            skipped++;
+            continue;
+        }
+
+        size_t bytes = std::min<size_t>(header.bytes, length);
+        for (size_t pos = RECORD_ALIGN; pos + RECORD_ENTRY_HEADER <= bytes && m_running;) {
+            int64_t rx_ns;
+            uint32_t size;
+            memcpy(&rx_ns, buffer + pos, sizeof(rx_ns));
+            memcpy(&size, buffer + pos + sizeof(rx_ns), sizeof(size));
+            if (size == 0 || pos + RECORD_ENTRY_HEADER + size > bytes) {
+                break;
+            }
+            const char* payload = buffer + pos + RECORD_ENTRY_HEADER;
+            pos += RECORD_ENTRY_HEADER + size;
+            if (rx_ns < start_ns) {
+                continue;
+            }
+
+            if (first_ns < 0) {
+                first_ns = rx_ns;
+            }
+            auto due = replay_start + std::chrono::nanoseconds(
+                static_cast<int64_t>((rx_ns - first_ns) / speed));
+            {
+                // A gap in the recording can be minutes long; the
+                // destructor must not wait it out
+                std::unique_lock<std::mutex> lock(m_replay_mutex);
+                m_replay_cv.wait_until(lock, due, [this] { return !m_running; });
+            }
+            if (!m_running) {
+                break;
+            }
+
+            // The pool drains as fast as the target sends
+            PacketRef packet = m_replay_pool->acquire();
+            while (!packet && m_running) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                packet = m_replay_pool->acquire();
+            }
+            if (!packet) {
+                break;
+            }
+            size_t copy = std::min<size_t>(size, packet.capacity());
+            memcpy(packet.data(), payload, copy);
+            packet.set_size(copy);
+            if (target->send_packet(packet)) {
+                m_replayed->inc();
+                sent++;
+            }
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(buffer);
+
+    std::cout << "Replay of " << describe() << " finished: " << sent << " packets sent";
+    if (skipped > 0) {
+        std::cout << ", " << skipped << " blocks overwritten meanwhile";
+    }
+    std::cout << std::endl;
+    m_replaying.store(false, std::memory_order_release);
+}
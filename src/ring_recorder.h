@@ -0,0 +1,138 @@
+#ifndef RING_RECORDER_H
+#define RING_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "metrics.h"
+#include "output_sink.h"
+#include "packet_pool.h"
+#include "spsc_ring.h"
+
+// Ring file block; the unit of recording, indexing and replay
+#define RECORD_BLOCK_SIZE (1024 * 1024)
+// Alignment of O_DIRECT buffers, offsets and lengths
+#define RECORD_ALIGN 4096
+
+// Timeshift recorder writing everything received into a preallocated
+// ring file, so the last minutes can be replayed after a RIST outage.
+// Packets are queued like on an output and a writer thread copies them
+// into an aligned block that goes to disk with O_DIRECT writes, once full
+// or after flush_ms; the ingest thread never touches storage.
+//
+// The file is a ring of RECORD_BLOCK_SIZE blocks, each starting with a
+// header sector and followed by records of a receive time, a size and the
+// payload. Blocks carry a sequence number, so a ring left by an earlier
+// run is picked up again and can be replayed.
+class RingRecorder : public OutputSink {
+public:
+    RingRecorder(const RecordConfig& config, size_t queue_depth = 1024);
+    ~RingRecorder() override;
+
+    // Open or create the ring file and start the writer thread
+    bool init();
+
+    bool send_packet(const PacketRef& packet) override;
+
+    std::string describe() const override;
+
+    // Send everything recorded in the last seconds to target from a
+    // background thread, paced at speed times real time. Records are read
+    // back from disk, so target must not be fed by anything else while the
+    // replay runs. False if a replay is still running or nothing is recorded.
+    bool replay(std::shared_ptr<OutputSink> target, int seconds, double speed);
+
+    // True while a replay is sending
+    bool replaying() const { return m_replaying.load(std::memory_order_acquire); }
+
+private:
+    // On-disk block header, padded to one sector
+    struct BlockHeader {
+        uint32_t magic;
+        uint32_t bytes;          // Used bytes including this header
+        uint64_t sequence;       // 1 for the first block ever written
+        int64_t first_ns;        // Wall-clock receive time of the first record
+        int64_t last_ns;         // ... and of the last one
+        uint32_t records;
+    };
+
+    // In-memory copy of what is on disk for one block
+    struct BlockInfo {
+        uint64_t sequence = 0;   // 0 while the slot holds nothing usable
+        int64_t first_ns = 0;
+        int64_t last_ns = 0;
+        uint32_t bytes = 0;
+    };
+
+    // Read the headers of an existing ring into the index
+    void load_index();
+
+    // Thread function draining the queue into the current block
+    void writer_loop();
+
+    // Append one packet to the current block, writing it out when full
+    void append(const PacketRef& packet);
+
+    // Write the unflushed part of the current block; the block stays open
+    // for appends unless it is full
+    bool flush_block();
+
+    // Move on to the next slot of the ring
+    void open_block();
+
+    // Replay thread: send the given blocks' records newer than start_ns
+    void replay_loop(std::vector<BlockInfo> blocks, std::shared_ptr<OutputSink> target,
+                     int64_t start_ns, double speed);
+
+    RecordConfig m_config;
+    int m_fd = -1;
+    bool m_direct = false;           // O_DIRECT is supported by the filesystem
+    size_t m_block_count = 0;
+
+    // Block being filled, writer thread only
+    char* m_block = nullptr;
+    size_t m_used = 0;               // Bytes filled, header included
+    size_t m_flushed = 0;            // Bytes already on disk
+    uint64_t m_sequence = 0;
+    int64_t m_opened_ns = 0;         // Monotonic time of the first unflushed record
+    bool m_write_failed = false;     // Last write failed; logged once per outage
+
+    // What is on disk, shared with the replay thread
+    mutable std::mutex m_index_mutex;
+    std::vector<BlockInfo> m_index;
+
+    std::thread m_writer_thread;
+    std::atomic<bool> m_running{false};
+
+    // Write queue between the ingest thread and the writer thread
+    SpscRing<PacketRef> m_queue;
+
+    // Parks the writer thread while the queue is empty
+    std::mutex m_wait_mutex;
+    std::condition_variable m_wait_cv;
+    std::atomic<bool> m_writer_waiting{false};
+
+    // Replay sends from its own pool, since only one thread may acquire
+    // from the ingest pool; declared before the thread using it
+    std::shared_ptr<PacketPool> m_replay_pool;
+    size_t m_replay_pool_size;
+    std::thread m_replay_thread;
+    std::atomic<bool> m_replaying{false};
+    // Wakes a replay paced out to its next record when recording stops
+    std::mutex m_replay_mutex;
+    std::condition_variable m_replay_cv;
+
+    // Metrics, labelled by file
+    std::shared_ptr<Counter> m_bytes_written;
+    std::shared_ptr<Counter> m_blocks_written;
+    std::shared_ptr<Counter> m_write_errors;
+    std::shared_ptr<Counter> m_queue_drops;
+    std::shared_ptr<Counter> m_replayed;
+};
+
+#endif // RING_RECORDER_H
@@ -1,25 +1,99 @@
 #include "rist_output.h"
 #include "feedback.h"
+#include "redundancy_group.h"
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 
-RistOutput::RistOutput(const std::string& dst_ip, int dst_port)
-    : m_dst_ip(dst_ip), m_dst_port(dst_port) {
+// Smoothing factor for per-peer quality and RTT used by weight rebalancing
+#define PEER_STATS_ALPHA 0.3
+// Weight given to the best peer; the others scale down from it
+#define PEER_WEIGHT_SCALE 100
+
+// Bucket bounds for the per-peer RTT histogram, in milliseconds
+static const std::vector<double> RTT_BUCKETS_MS = {5, 10, 20, 50, 100, 200, 500, 1000, 2000};
+
+RistOutput::RistOutput(const std::string& dst_ip, int dst_port, size_t queue_depth)
+    : RistOutput(std::vector<PeerConfig>{{dst_ip, dst_port, 0}}, queue_depth) {
+}
+
+RistOutput::RistOutput(const std::vector<PeerConfig>& peers, size_t queue_depth)
+    : m_queue(queue_depth) {
+    for (size_t i = 0; i < peers.size(); i++) {
+        Peer peer;
+        peer.config = peers[i];
+        peer.cname = "route" + std::to_string(i);
+        peer.stats.address = peers[i].dst_ip + ":" + std::to_string(peers[i].dst_port);
+        peer.stats.weight = peers[i].weight;
+        peer.rtt_histogram = MetricsRegistry::global().histogram(
+            "rist_peer_rtt_ms", "RTT reported by RIST for each peer",
+            metric_label("peer", peer.stats.address), RTT_BUCKETS_MS);
+        m_peers.push_back(peer);
+    }
+    
+    auto& metrics = MetricsRegistry::global();
+    std::string labels = metric_label("route", describe());
+    m_packets_out = metrics.counter("rist_packets_sent_total", "Datagrams written to librist", labels);
+    m_bytes_out = metrics.counter("rist_bytes_sent_total", "Bytes written to librist", labels);
+    m_write_errors = metrics.counter("rist_write_errors_total", "Failed rist_sender_data_write calls", labels);
+    m_queue_drops = metrics.counter("rist_queue_dropped_total", "Packets dropped on send queue overflow", labels);
+    m_queue_depth = metrics.gauge("rist_queue_depth", "Packets waiting in the send queue", labels);
+}
+
+std::string RistOutput::describe() const {
+    std::string result;
+    for (const auto& peer : m_peers) {
+        if (!result.empty()) {
+            result += ", ";
+        }
+        result += peer.stats.address;
+    }
+    return result;
 }
 
 RistOutput::~RistOutput() {
-    // Stop event thread
+    // Stop event and sender threads
     m_running = false;
+    {
+        std::lock_guard<std::mutex> lock(m_wait_mutex);
+        m_wait_cv.notify_all();
+    }
+    if (m_sender_thread.joinable()) {
+        m_sender_thread.join();
+    }
     if (m_event_thread.joinable()) {
         m_event_thread.join();
     }
     
+    // Send the whole TS packets still held for a partial datagram
+    if (m_packetizer && m_ctx) {
+        m_packetizer->flush();
+    }
+    
+    if (m_group) {
+        auto path = get_path_stats();
+        std::cout << "RIST path " << path.address << ": sent " << path.sent
+                  << ", dropped " << path.dropped << ", delay avg " << path.delay_avg_ms
+                  << " ms max " << path.delay_max_ms << " ms" << std::endl;
+    }
+    
+    auto stats = get_queue_stats();
+    if (stats.dropped > 0) {
+        std::cout << "RIST output " << describe() << " dropped "
+                  << stats.dropped << " packets on queue overflow (high-water "
+                  << stats.high_water << "/" << stats.capacity << ")" << std::endl;
+    }
+    
     // Clean up RIST resources
     if (m_ctx) {
-        if (m_peer) {
-            rist_peer_destroy(m_peer);
-            m_peer = nullptr;
+        for (auto& peer : m_peers) {
+            if (peer.peer) {
+                rist_peer_destroy(peer.peer);
+                peer.peer = nullptr;
+            }
         }
         
         rist_destroy(m_ctx);
@@ -39,31 +113,47 @@ bool RistOutput::init() {
         return false;
     }
     
+    // Redundant paths must carry one flow for the receiver to merge them
+    if (m_group) {
+        ret = rist_sender_flow_id_set(m_ctx, m_group->flow_id());
+        if (ret != 0) {
+            std::cerr << "Failed to set RIST flow id " << m_group->flow_id() << ": " << ret << std::endl;
+            rist_destroy(m_ctx);
+            m_ctx = nullptr;
+            return false;
+        }
+    }
+    
     // Set stats callback
     struct rist_stats_callback_object stats_cb = {0};
     stats_cb.callback = &RistOutput::stats_callback;
     stats_cb.arg = this;
     rist_stats_callback_set(m_ctx, &stats_cb, 1000); // 1 second interval
     
-    // Setup peer connection
-    struct rist_peer_config peer_config = {0};
-    char url[512];
-    snprintf(url, sizeof(url), "rist://%s:%d", m_dst_ip.c_str(), m_dst_port);
-    peer_config.address = url;
-    
-    ret = rist_peer_create(m_ctx, &m_peer, &peer_config);
-    if (ret != 0 || !m_peer) {
-        std::cerr << "Failed to create RIST peer: " << ret << std::endl;
-        rist_destroy(m_ctx);
-        m_ctx = nullptr;
-        return false;
+    // Setup peer connections, all sharing the one sender context
+    for (auto& peer : m_peers) {
+        struct rist_peer_config peer_config = {0};
+        char url[512];
+        snprintf(url, sizeof(url), "rist://%s:%d", peer.config.dst_ip.c_str(), peer.config.dst_port);
+        peer_config.address = url;
+        peer_config.weight = peer.config.weight;
+        strncpy(peer_config.cname, peer.cname.c_str(), sizeof(peer_config.cname) - 1);
+        
+        ret = rist_peer_create(m_ctx, &peer.peer, &peer_config);
+        if (ret != 0 || !peer.peer) {
+            std::cerr << "Failed to create RIST peer " << url << ": " << ret << std::endl;
+            rist_destroy(m_ctx);
+            m_ctx = nullptr;
+            return false;
+        }
     }
     
-    // Start RIST event loop
+    // Start RIST event loop and sender thread
     m_running = true;
     m_event_thread = std::thread(&RistOutput::rist_event_loop, this);
+    m_sender_thread = std::thread(&RistOutput::sender_loop, this);
     
-    std::cout << "RIST output initialized to " << url << std::endl;
+    std::cout << "RIST output initialized to " << describe() << std::endl;
     return true;
 }
 
@@ -78,47 +168,261 @@ void RistOutput::rist_event_loop() {
     }
 }
 
-bool RistOutput::send_data(const char* data, size_t size) {
-    if (!m_ctx || !m_peer) {
+bool RistOutput::send_packet(const PacketRef& packet) {
+    if (!m_ctx) {
         return false;
     }
     
-    // Protect with mutex for thread safety
-    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_group) {
+        // Duplicate onto every path, this one included
+        m_group->send_packet(packet);
+        return true;
+    }
     
-    // Use first stream ID
-    uint16_t stream_id = 0;
+    return enqueue(packet);
+}
+
+bool RistOutput::enqueue(const PacketRef& packet) {
+    if (!m_ctx) {
+        return false;
+    }
     
-    // Send data over RIST
-    int ret = rist_sender_data_write(m_ctx, data, size, stream_id);
-    if (ret < 0) {
-        std::cerr << "Failed to send data over RIST: " << ret << std::endl;
+    QueuedPacket* slot = m_queue.write_slot();
+    if (!slot) {
+        // A slow peer must never back-pressure the ingest thread
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        m_queue_drops->inc();
         return false;
     }
     
+    // Share the buffer, only the reference count changes
+    slot->packet = packet;
+    if (m_trace) {
+        slot->enqueue_ns = LatencyTrace::now_ns();
+    }
+    m_queue.commit_write();
+    
+    size_t depth = m_queue.size();
+    m_queue_depth->set(depth);
+    if (depth > m_high_water.load(std::memory_order_relaxed)) {
+        m_high_water.store(depth, std::memory_order_relaxed);
+    }
+    
+    // Wake the sender only if it is parked on an empty queue; the fence
+    // orders the publish above against reading the waiting flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sender_waiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_wait_mutex);
+        m_wait_cv.notify_one();
+    }
+    
+    return true;
+}
+
+bool RistOutput::drain(int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (m_running && !m_queue.empty()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
     return true;
 }
 
+void RistOutput::set_packetizer(size_t packets_per_datagram, int flush_ms) {
+    if (packets_per_datagram == 0) {
+        m_packetizer.reset();
+        return;
+    }
+    
+    m_packetizer = std::make_unique<TsPacketizer>(
+        packets_per_datagram, std::chrono::milliseconds(flush_ms),
+        [this](const char* data, size_t size) { write_datagram(data, size); });
+}
+
+void RistOutput::write_datagram(const char* data, size_t size) {
+    // Send data over RIST on the first stream ID, librist numbers the packets
+    struct rist_data_block block = {0};
+    block.payload = data;
+    block.payload_len = size;
+    
+    int ret = rist_sender_data_write(m_ctx, &block);
+    if (ret < 0) {
+        m_write_errors->inc();
+        std::cerr << "Failed to send data over RIST: " << ret << std::endl;
+        return;
+    }
+    m_packets_out->inc();
+    m_bytes_out->inc(size);
+}
+
+struct rist_data_block RistOutput::stamped_block(const PacketRef& packet) const {
+    struct rist_data_block block = {0};
+    block.payload = packet.data();
+    block.payload_len = packet.size();
+    block.flow_id = m_group ? m_group->flow_id() : 0;
+    block.seq = packet.seq();
+    block.ts_ntp = packet.ts_ntp();
+    block.flags = RIST_DATA_FLAGS_USE_SEQ;
+    return block;
+}
+
+void RistOutput::write_stamped(const PacketRef& packet) {
+    struct rist_data_block block = stamped_block(packet);
+    
+    int ret = rist_sender_data_write(m_ctx, &block);
+    if (ret < 0) {
+        m_write_errors->inc();
+        std::cerr << "Failed to send data over RIST: " << ret << std::endl;
+        return;
+    }
+    m_packets_out->inc();
+    m_bytes_out->inc(packet.size());
+    
+    // Delay from stamping to hand-off to librist on this path
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t delay = now_ns - packet.stamp_ns();
+    m_sent.fetch_add(1, std::memory_order_relaxed);
+    m_delay_total_ns.fetch_add(delay, std::memory_order_relaxed);
+    if (delay > m_delay_max_ns.load(std::memory_order_relaxed)) {
+        m_delay_max_ns.store(delay, std::memory_order_relaxed);
+    }
+}
+
+void RistOutput::sender_loop() {
+    while (m_running) {
+        QueuedPacket* slot = m_queue.read_slot();
+        if (!slot) {
+            // Sleep until more data arrives, or until a coalesced partial
+            // datagram is due
+            auto timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+            if (m_packetizer && m_packetizer->pending()) {
+                timeout = std::min(timeout, m_packetizer->deadline());
+            }
+            
+            {
+                std::unique_lock<std::mutex> lock(m_wait_mutex);
+                m_sender_waiting.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                // Re-check after announcing the wait so a concurrent push is not missed
+                m_wait_cv.wait_until(lock, timeout, [this] {
+                    return !m_running || !m_queue.empty();
+                });
+                m_sender_waiting.store(false, std::memory_order_relaxed);
+            }
+            
+            if (m_packetizer) {
+                m_packetizer->poll(std::chrono::steady_clock::now());
+            }
+            continue;
+        }
+        
+        const PacketRef& packet = slot->packet;
+        int64_t dequeue_ns = m_trace ? LatencyTrace::now_ns() : 0;
+        
+        if (m_group) {
+            write_stamped(packet);
+        } else if (m_packetizer) {
+            m_packetizer->push(packet.data(), packet.size(), std::chrono::steady_clock::now());
+        } else {
+            write_datagram(packet.data(), packet.size());
+        }
+        
+        if (m_trace) {
+            // With a packetizer, send is when the packet entered it; any
+            // hold for a partial datagram is not included
+            LatencySample sample;
+            sample.rx_ns = packet.rx_ns();
+            sample.enqueue_ns = slot->enqueue_ns;
+            sample.dequeue_ns = dequeue_ns;
+            sample.send_ns = LatencyTrace::now_ns();
+            sample.size = static_cast<uint32_t>(packet.size());
+            sample.output = m_trace_index;
+            m_trace->record(sample);
+        }
+        
+        // Return the buffer to the pool once every output has sent it
+        slot->packet.reset();
+        m_queue.commit_read();
+        m_queue_depth->set(m_queue.size());
+    }
+}
+
+RistOutput::QueueStats RistOutput::get_queue_stats() const {
+    QueueStats stats;
+    stats.depth = m_queue.size();
+    stats.high_water = m_high_water.load(std::memory_order_relaxed);
+    stats.capacity = m_queue.capacity();
+    stats.dropped = m_dropped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void RistOutput::set_latency_trace(std::shared_ptr<LatencyTrace> trace, uint16_t index) {
+    m_trace = trace;
+    m_trace_index = index;
+}
+
+void RistOutput::set_redundancy_group(std::shared_ptr<RedundancyGroup> group) {
+    m_group = group;
+    m_group->add_path(this);
+}
+
+RistOutput::PathStats RistOutput::get_path_stats() const {
+    PathStats stats;
+    stats.address = describe();
+    stats.sent = m_sent.load(std::memory_order_relaxed);
+    stats.dropped = m_dropped.load(std::memory_order_relaxed);
+    if (stats.sent > 0) {
+        stats.delay_avg_ms = m_delay_total_ns.load(std::memory_order_relaxed) / 1e6 / stats.sent;
+    }
+    stats.delay_max_ms = m_delay_max_ns.load(std::memory_order_relaxed) / 1e6;
+    
+    std::lock_guard<std::mutex> lock(m_peer_mutex);
+    if (!m_peers.empty() && m_peers[0].has_stats) {
+        stats.loss = 100.0 - m_peers[0].stats.quality;
+        stats.rtt = m_peers[0].stats.rtt;
+    }
+    return stats;
+}
+
 void RistOutput::set_feedback_callback(std::shared_ptr<Feedback> feedback) {
     m_feedback = feedback;
 }
 
 int RistOutput::stats_callback(void* arg, const struct rist_stats *stats) {
     RistOutput* output = static_cast<RistOutput*>(arg);
-    if (!output || !output->m_feedback) {
+    if (!output) {
         return 0;
     }
     
+    // Report queue overflow once per stats interval
+    auto queue = output->get_queue_stats();
+    if (queue.dropped != output->m_reported_dropped) {
+        std::cerr << "RIST send queue overflow: " << (queue.dropped - output->m_reported_dropped)
+                  << " packets dropped (depth " << queue.depth << ", high-water "
+                  << queue.high_water << "/" << queue.capacity << ")" << std::endl;
+        output->m_reported_dropped = queue.dropped;
+    }
+    
     // Process stats based on type
     switch (stats->stats_type) {
         case RIST_STATS_SENDER_PEER: {
-            // Extract relevant stats
+            std::string route = output->update_peer_stats(stats->stats.sender_peer);
+            if (!output->m_feedback) {
+                break;
+            }
+            
+            // Extract relevant stats; quality is the percentage of packets
+            // delivered without loss
             uint32_t bitrate_avg = stats->stats.sender_peer.bitrate_avg;
-            float packet_loss = stats->stats.sender_peer.quality;
+            float packet_loss = std::max(0.0, 100.0 - stats->stats.sender_peer.quality);
             uint32_t rtt = stats->stats.sender_peer.rtt;
             
-            // Report to feedback
-            output->m_feedback->process_stats(bitrate_avg, packet_loss, rtt);
+            // Report to feedback, keyed by route so peers do not overwrite
+            // each other
+            output->m_feedback->process_stats(route, bitrate_avg, packet_loss, rtt);
             break;
         }
         default:
@@ -128,3 +432,114 @@ int RistOutput::stats_callback(void* arg, const struct rist_stats *stats) {
     
     return 0;
 }
+
+std::string RistOutput::update_peer_stats(const struct rist_stats_sender_peer& stats) {
+    std::lock_guard<std::mutex> lock(m_peer_mutex);
+    
+    auto it = m_peer_index.find(stats.peer_id);
+    if (it == m_peer_index.end()) {
+        // Sender stats carry librist's peer id and the cname the remote
+        // receiver advertises, neither of which librist ties to the peer
+        // handle. A single peer owns every record; with several, a
+        // receiver echoing our routeN cname identifies the peer.
+        size_t index = m_peers.size();
+        if (m_peers.size() == 1) {
+            index = 0;
+        } else {
+            for (size_t i = 0; i < m_peers.size(); i++) {
+                if (m_peers[i].cname == stats.cname) {
+                    index = i;
+                    break;
+                }
+            }
+        }
+        if (index == m_peers.size()) {
+            if (m_unmatched_peers.insert(stats.peer_id).second) {
+                std::cerr << "RIST stats of peer " << stats.peer_id << " (cname '" << stats.cname
+                          << "') match no configured peer of " << describe()
+                          << ", adaptive weights skip it" << std::endl;
+            }
+            // Still a key of its own, so peers never overwrite each other
+            return describe() + "#" + std::to_string(stats.peer_id);
+        }
+        it = m_peer_index.emplace(stats.peer_id, index).first;
+    }
+    
+    // Smooth quality and RTT so a single bad interval does not swing weights
+    Peer& peer = m_peers[it->second];
+    if (!peer.has_stats) {
+        peer.stats.quality = stats.quality;
+        peer.stats.rtt = stats.rtt;
+        peer.has_stats = true;
+    } else {
+        peer.stats.quality += PEER_STATS_ALPHA * (stats.quality - peer.stats.quality);
+        peer.stats.rtt += PEER_STATS_ALPHA * (stats.rtt - peer.stats.rtt);
+    }
+    peer.stats.bandwidth = stats.bandwidth;
+    peer.rtt_histogram->observe(stats.rtt);
+    peer.retry_ratio = stats.bandwidth > 0
+        ? static_cast<double>(stats.retry_bandwidth) / stats.bandwidth : 0.0;
+    
+    if (m_adaptive_weights && m_peers.size() > 1) {
+        rebalance_weights();
+    }
+    return peer.stats.address;
+}
+
+void RistOutput::rebalance_weights() {
+    // Fastest link sets the RTT reference
+    double min_rtt = 0.0;
+    for (const auto& peer : m_peers) {
+        if (peer.has_stats && peer.stats.rtt > 0.0 && (min_rtt == 0.0 || peer.stats.rtt < min_rtt)) {
+            min_rtt = peer.stats.rtt;
+        }
+    }
+    
+    // Score each link: configured weight scaled by delivery quality, RTT
+    // relative to the fastest link and the share of bandwidth spent on
+    // retransmissions
+    std::vector<double> scores(m_peers.size(), 0.0);
+    double best = 0.0;
+    for (size_t i = 0; i < m_peers.size(); i++) {
+        const Peer& peer = m_peers[i];
+        if (!peer.has_stats) {
+            return;
+        }
+        double base = peer.config.weight > 0 ? peer.config.weight : 1.0;
+        double quality = std::max(0.0, std::min(peer.stats.quality, 100.0)) / 100.0;
+        double rtt_factor = (min_rtt > 0.0 && peer.stats.rtt > 0.0) ? min_rtt / peer.stats.rtt : 1.0;
+        double efficiency = 1.0 / (1.0 + peer.retry_ratio);
+        scores[i] = base * quality * quality * rtt_factor * efficiency;
+        best = std::max(best, scores[i]);
+    }
+    if (best <= 0.0) {
+        return;
+    }
+    
+    for (size_t i = 0; i < m_peers.size(); i++) {
+        Peer& peer = m_peers[i];
+        uint32_t weight = std::max<uint32_t>(1, std::lround(PEER_WEIGHT_SCALE * scores[i] / best));
+        
+        // Skip small changes to avoid churning librist's scheduler
+        uint32_t current = peer.stats.weight;
+        uint32_t delta = weight > current ? weight - current : current - weight;
+        if (delta == 0 || delta < std::max<uint32_t>(1, current / 10)) {
+            continue;
+        }
+        
+        if (rist_peer_weight_set(m_ctx, peer.peer, weight) == 0) {
+            std::cout << "RIST peer " << peer.stats.address << " weight " << current
+                      << " -> " << weight << std::endl;
+            peer.stats.weight = weight;
+        }
+    }
+}
+
+std::vector<RistOutput::PeerStats> RistOutput::get_peer_stats() const {
+    std::lock_guard<std::mutex> lock(m_peer_mutex);
+    std::vector<PeerStats> result;
+    for (const auto& peer : m_peers) {
+        result.push_back(peer.stats);
+    }
+    return result;
+}
@@ -3,46 +3,207 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <librist/librist.h>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include "spsc_ring.h"
+#include "packet_pool.h"
+#include "ts_packetizer.h"
+#include "metrics.h"
+#include "latency_trace.h"
+#include "output_sink.h"
 
 class Feedback;
+class RedundancyGroup;
 
-class RistOutput {
+class RistOutput : public OutputSink {
 public:
-    RistOutput(const std::string& dst_ip, int dst_port);
-    ~RistOutput();
+    // Send queue occupancy and overflow counters
+    struct QueueStats {
+        size_t depth = 0;        // Packets currently queued
+        size_t high_water = 0;   // Deepest the queue has been
+        size_t capacity = 0;     // Number of slots in the queue
+        uint64_t dropped = 0;    // Packets dropped because the queue was full
+    };
+    
+    // One peer of the sender context
+    struct PeerConfig {
+        std::string dst_ip;
+        int dst_port = 0;
+        uint32_t weight = 0;     // Load-balancing weight, 0 for librist's default
+    };
+    
+    // Per-peer link state as last reported by librist
+    struct PeerStats {
+        std::string address;
+        uint32_t weight = 0;     // Weight currently applied
+        double quality = 0.0;    // Smoothed delivery quality, percent
+        double rtt = 0.0;        // Smoothed round trip time, ms
+        size_t bandwidth = 0;    // Last reported bandwidth, bits per second
+    };
+    
+    // Delivery counters for one path of a redundancy group
+    struct PathStats {
+        std::string address;
+        uint64_t sent = 0;           // Copies written to librist
+        uint64_t dropped = 0;        // Copies lost to queue overflow
+        double loss = 0.0;           // Loss reported by RIST, percent
+        double delay_avg_ms = 0.0;   // Mean stamp-to-send delay
+        double delay_max_ms = 0.0;   // Worst stamp-to-send delay
+        double rtt = 0.0;            // Smoothed round trip time, ms
+    };
+    
+    RistOutput(const std::string& dst_ip, int dst_port, size_t queue_depth = 1024);
+    
+    // Bonded output: every peer shares one librist sender context and
+    // packets are striped across them by weight
+    RistOutput(const std::vector<PeerConfig>& peers, size_t queue_depth = 1024);
+    
+    ~RistOutput() override;
     
     // Initialize RIST output
     bool init();
     
-    // Send data to RIST destination
-    bool send_data(const char* data, size_t size);
+    // Queue a pooled packet for the sender thread without copying it. Must
+    // only be called from a single ingest thread; never blocks, drops the
+    // packet when the queue is full.
+    bool send_packet(const PacketRef& packet) override;
+    
+    // Describe the destination(s) for log messages
+    std::string describe() const override;
+    bool drain(int timeout_ms) override;
+    
+    // Re-chunk queued data into datagrams of packets_per_datagram TS
+    // packets, flushing partial datagrams after flush_ms; 0 sends every
+    // queued packet as-is. Must be called before init().
+    void set_packetizer(size_t packets_per_datagram, int flush_ms);
     
     // Set feedback callback
     void set_feedback_callback(std::shared_ptr<Feedback> feedback);
     
+    // Current send queue statistics
+    QueueStats get_queue_stats() const;
+    
+    // Rebalance peer weights from their RIST stats (RTT, loss, bandwidth);
+    // only meaningful with more than one peer. Must be called before init().
+    void set_adaptive_weights(bool enabled) { m_adaptive_weights = enabled; }
+    
+    // Current per-peer link state
+    std::vector<PeerStats> get_peer_stats() const;
+    
+    // Join a redundancy group: packets sent to this output are duplicated
+    // onto every member with a shared sequence number, and written with
+    // that sequence instead of being re-packetized. Must be called before
+    // init().
+    void set_redundancy_group(std::shared_ptr<RedundancyGroup> group);
+    
+    // Delivery counters for this output as a redundancy path
+    PathStats get_path_stats() const;
+    
+    // Data block written to librist for a packet stamped by the
+    // redundancy group; the flow id and sequence match on every path
+    struct rist_data_block stamped_block(const PacketRef& packet) const;
+    
+    // Record enqueue, dequeue and send times of every packet into trace,
+    // tagged with index. Must be called before init().
+    void set_latency_trace(std::shared_ptr<LatencyTrace> trace, uint16_t index);
+    
 private:
+    friend class RedundancyGroup;
+    
+    // Queue one packet for the sender thread; ingest thread only
+    bool enqueue(const PacketRef& packet);
+    
+    // Hand one stamped packet to librist with its group sequence number
+    void write_stamped(const PacketRef& packet);
+    
+    // Send queue entry; the enqueue time is only taken while tracing
+    struct QueuedPacket {
+        PacketRef packet;
+        int64_t enqueue_ns = 0;
+    };
+    
+    struct Peer {
+        PeerConfig config;
+        std::string cname;           // Name advertised to the receiver
+        struct rist_peer* peer = nullptr;
+        PeerStats stats;
+        std::shared_ptr<Histogram> rtt_histogram;
+        double retry_ratio = 0.0;    // Retransmit share of the peer's bandwidth
+        bool has_stats = false;
+    };
+    
+    // Fold one peer's stats into its smoothed state and return the peer's
+    // address. Stats of a peer that cannot be told apart get a key of
+    // their own from the librist peer id. Stats thread only.
+    std::string update_peer_stats(const struct rist_stats_sender_peer& stats);
+    
+    // Recompute peer weights after new stats arrived; m_peer_mutex held
+    void rebalance_weights();
+    
     // RIST stats callback
     static int stats_callback(void* arg, const struct rist_stats *stats);
     
     // Thread function to run RIST event loop
     void rist_event_loop();
     
-    std::string m_dst_ip;
-    int m_dst_port;
+    // Thread function draining the send queue into librist
+    void sender_loop();
+    
+    // Hand one datagram to librist
+    void write_datagram(const char* data, size_t size);
     
     struct rist_ctx *m_ctx = nullptr;
-    struct rist_peer *m_peer = nullptr;
+    
+    // Peers of the sender context; stats guarded by m_peer_mutex
+    std::vector<Peer> m_peers;
+    mutable std::mutex m_peer_mutex;
+    // Index into m_peers of each librist peer id seen in stats, learned
+    // as records arrive; ids matching no peer are logged once
+    std::unordered_map<uint32_t, size_t> m_peer_index;
+    std::unordered_set<uint32_t> m_unmatched_peers;
+    bool m_adaptive_weights = false;
     
     std::shared_ptr<Feedback> m_feedback;
     std::thread m_event_thread;
+    std::thread m_sender_thread;
     std::atomic<bool> m_running{false};
     
-    // Mutex for thread safety
-    std::mutex m_mutex;
+    // Send queue between the ingest thread and the sender thread
+    SpscRing<QueuedPacket> m_queue;
+    std::atomic<size_t> m_high_water{0};
+    std::atomic<uint64_t> m_dropped{0};
+    uint64_t m_reported_dropped = 0;
+    
+    // Optional TS alignment stage, only touched by the sender thread
+    std::unique_ptr<TsPacketizer> m_packetizer;
+    
+    // Redundancy group and this path's delivery counters
+    std::shared_ptr<RedundancyGroup> m_group;
+    std::atomic<uint64_t> m_sent{0};
+    std::atomic<int64_t> m_delay_total_ns{0};
+    std::atomic<int64_t> m_delay_max_ns{0};
+    
+    // Optional per-packet latency trace shared across the pipeline
+    std::shared_ptr<LatencyTrace> m_trace;
+    uint16_t m_trace_index = 0;
+    
+    // Metrics, labelled by destination
+    std::shared_ptr<Counter> m_packets_out;
+    std::shared_ptr<Counter> m_bytes_out;
+    std::shared_ptr<Counter> m_write_errors;
+    std::shared_ptr<Counter> m_queue_drops;
+    std::shared_ptr<Gauge> m_queue_depth;
+    
+    // Parks the sender thread while the queue is empty
+    std::mutex m_wait_mutex;
+    std::condition_variable m_wait_cv;
+    std::atomic<bool> m_sender_waiting{false};
 };
 
 #endif // RIST_OUTPUT_H
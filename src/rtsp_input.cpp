@@ -1,13 +1,24 @@
 #include "rtsp_input.h"
 #include <iostream>
+#include <string>
+#include <algorithm>
 
-RTSPInput::RTSPInput(const std::string& rtsp_url, std::shared_ptr<RistOutput> output)
-    : m_rtsp_url(rtsp_url) {
+// AVIO buffer size, one 7 x 188 byte TS datagram per write callback
+#define RTSP_AVIO_BUFFER_SIZE 1316
+
+// Reconnect backoff bounds
+#define RTSP_RECONNECT_MIN_MS 250
+#define RTSP_RECONNECT_MAX_MS 5000
+
+RTSPInput::RTSPInput(const std::string& rtsp_url, std::shared_ptr<OutputSink> output,
+                     const RtspConfig& options)
+    : m_rtsp_url(rtsp_url), m_options(options) {
     m_outputs.push_back(output);
 }
 
 RTSPInput::~RTSPInput() {
     stop();
+    clear_stream_info_cache();
 }
 
 bool RTSPInput::init_ffmpeg() {
@@ -37,10 +48,24 @@ bool RTSPInput::open_rtsp_stream() {
         return false;
     }
     
+    // Let stop() or the I/O deadline interrupt blocking open/read calls
+    m_format_ctx->interrupt_callback.callback = &RTSPInput::interrupt_callback;
+    m_format_ctx->interrupt_callback.opaque = this;
+    arm_deadline();
+    
     // Set options
     AVDictionary* options = nullptr;
-    av_dict_set(&options, "rtsp_transport", "tcp", 0); // Use TCP for RTSP
-    av_dict_set(&options, "stimeout", "5000000", 0);   // 5 second timeout
+    av_dict_set(&options, "rtsp_transport", m_options.transport.c_str(), 0);
+    av_dict_set_int(&options, "stimeout", int64_t(m_options.io_timeout_ms) * 1000, 0);
+    if (m_options.probesize > 0) {
+        av_dict_set_int(&options, "probesize", m_options.probesize, 0);
+    }
+    if (m_options.analyzeduration_ms >= 0) {
+        av_dict_set_int(&options, "analyzeduration", int64_t(m_options.analyzeduration_ms) * 1000, 0);
+    }
+    if (m_options.nobuffer) {
+        av_dict_set(&options, "fflags", "nobuffer", 0);
+    }
     
     // Open input
     int ret = avformat_open_input(&m_format_ctx, m_rtsp_url.c_str(), nullptr, &options);
@@ -56,14 +81,23 @@ bool RTSPInput::open_rtsp_stream() {
     // Free options dictionary
     av_dict_free(&options);
     
-    // Get stream information
-    ret = avformat_find_stream_info(m_format_ctx, nullptr);
-    if (ret < 0) {
-        char errbuf[AV_ERROR_MAX_STRING_SIZE];
-        av_strerror(ret, errbuf, sizeof(errbuf));
-        std::cerr << "Failed to find stream info: " << errbuf << std::endl;
-        avformat_close_input(&m_format_ctx);
-        return false;
+    // Get stream information, reusing the last probe on reconnect
+    if (m_options.cache_stream_info && apply_cached_stream_info()) {
+        std::cout << "Using cached RTSP stream info, skipping probe" << std::endl;
+    } else {
+        arm_deadline();
+        ret = avformat_find_stream_info(m_format_ctx, nullptr);
+        if (ret < 0) {
+            char errbuf[AV_ERROR_MAX_STRING_SIZE];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            std::cerr << "Failed to find stream info: " << errbuf << std::endl;
+            avformat_close_input(&m_format_ctx);
+            return false;
+        }
+        
+        if (m_options.cache_stream_info) {
+            cache_stream_info();
+        }
     }
     
     // Find video stream
@@ -84,60 +118,284 @@ bool RTSPInput::open_rtsp_stream() {
     // Print stream info
     av_dump_format(m_format_ctx, 0, m_rtsp_url.c_str(), 0);
     
+    if (!open_muxer()) {
+        avformat_close_input(&m_format_ctx);
+        return false;
+    }
+    
     std::cout << "RTSP stream opened successfully" << std::endl;
     return true;
 }
 
+bool RTSPInput::apply_cached_stream_info() {
+    if (m_cached_params.empty() || m_cached_params.size() != m_format_ctx->nb_streams) {
+        return false;
+    }
+    
+    // The SDP must still describe the same codecs in the same order
+    for (unsigned int i = 0; i < m_format_ctx->nb_streams; i++) {
+        const AVCodecParameters* par = m_format_ctx->streams[i]->codecpar;
+        if (par->codec_type != m_cached_params[i]->codec_type ||
+            par->codec_id != m_cached_params[i]->codec_id) {
+            return false;
+        }
+    }
+    
+    for (unsigned int i = 0; i < m_format_ctx->nb_streams; i++) {
+        if (avcodec_parameters_copy(m_format_ctx->streams[i]->codecpar, m_cached_params[i]) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RTSPInput::cache_stream_info() {
+    clear_stream_info_cache();
+    for (unsigned int i = 0; i < m_format_ctx->nb_streams; i++) {
+        AVCodecParameters* par = avcodec_parameters_alloc();
+        if (!par || avcodec_parameters_copy(par, m_format_ctx->streams[i]->codecpar) < 0) {
+            avcodec_parameters_free(&par);
+            clear_stream_info_cache();
+            return;
+        }
+        m_cached_params.push_back(par);
+    }
+}
+
+void RTSPInput::clear_stream_info_cache() {
+    for (auto& par : m_cached_params) {
+        avcodec_parameters_free(&par);
+    }
+    m_cached_params.clear();
+}
+
+bool RTSPInput::open_muxer() {
+    int ret = avformat_alloc_output_context2(&m_mux_ctx, nullptr, "mpegts", nullptr);
+    if (ret < 0 || !m_mux_ctx) {
+        std::cerr << "Failed to allocate MPEG-TS muxer" << std::endl;
+        return false;
+    }
+    
+    // Remux every audio and video stream, drop the rest
+    m_stream_map.assign(m_format_ctx->nb_streams, -1);
+    for (unsigned int i = 0; i < m_format_ctx->nb_streams; i++) {
+        AVStream* in = m_format_ctx->streams[i];
+        AVMediaType type = in->codecpar->codec_type;
+        if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO) {
+            continue;
+        }
+        
+        AVStream* out = avformat_new_stream(m_mux_ctx, nullptr);
+        if (!out || avcodec_parameters_copy(out->codecpar, in->codecpar) < 0) {
+            std::cerr << "Failed to add stream " << i << " to MPEG-TS muxer" << std::endl;
+            close_muxer();
+            return false;
+        }
+        out->codecpar->codec_tag = 0;
+        out->time_base = in->time_base;
+        m_stream_map[i] = out->index;
+    }
+    
+    // The muxer writes straight into the pooled outputs
+    unsigned char* buffer = static_cast<unsigned char*>(av_malloc(RTSP_AVIO_BUFFER_SIZE));
+    if (!buffer) {
+        std::cerr << "Failed to allocate AVIO buffer" << std::endl;
+        close_muxer();
+        return false;
+    }
+    m_avio = avio_alloc_context(buffer, RTSP_AVIO_BUFFER_SIZE, 1, this,
+                                nullptr, &RTSPInput::write_callback, nullptr);
+    if (!m_avio) {
+        av_free(buffer);
+        std::cerr << "Failed to allocate AVIO context" << std::endl;
+        close_muxer();
+        return false;
+    }
+    m_mux_ctx->pb = m_avio;
+    
+    // Latency settings: max_delay is how far the mpegts timestamps lead
+    // the PCR. The interleave bound must stay non-zero, as 0 makes the
+    // muxer buffer until every stream has a packet.
+    int interleave_ms = m_options.mux_interleave_ms >= 0 ? m_options.mux_interleave_ms : m_options.mux_delay_ms;
+    m_mux_ctx->max_delay = m_options.mux_delay_ms * 1000;
+    m_mux_ctx->max_interleave_delta = std::max<int64_t>(int64_t(interleave_ms) * 1000, 1);
+    AVDictionary* options = nullptr;
+    if (m_options.mux_flush_packets) {
+        av_dict_set(&options, "flush_packets", "1", 0);
+    }
+    
+    ret = avformat_write_header(m_mux_ctx, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        char errbuf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        std::cerr << "Failed to write MPEG-TS header: " << errbuf << std::endl;
+        close_muxer();
+        return false;
+    }
+    m_header_written = true;
+    
+    return true;
+}
+
+void RTSPInput::close_muxer() {
+    if (m_mux_ctx && m_header_written) {
+        av_write_trailer(m_mux_ctx);
+    }
+    m_header_written = false;
+    
+    if (m_avio) {
+        // The muxer may have replaced the buffer, free the current one
+        av_freep(&m_avio->buffer);
+        avio_context_free(&m_avio);
+        m_avio = nullptr;
+    }
+    
+    if (m_mux_ctx) {
+        avformat_free_context(m_mux_ctx);
+        m_mux_ctx = nullptr;
+    }
+    
+    m_stream_map.clear();
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+int RTSPInput::write_callback(void* opaque, const uint8_t* buf, int size) {
+#else
+int RTSPInput::write_callback(void* opaque, uint8_t* buf, int size) {
+#endif
+    auto* input = static_cast<RTSPInput*>(opaque);
+    if (!input->dispatch_data(reinterpret_cast<const char*>(buf), size)) {
+        std::cerr << "Packet pool exhausted, dropping RTSP data" << std::endl;
+    }
+    // Report success so the muxer keeps going after a drop
+    return size;
+}
+
 bool RTSPInput::start() {
-    if (!init_ffmpeg()) {
+    if (!m_pool) {
+        std::cerr << "No packet pool set for RTSP input" << std::endl;
         return false;
     }
     
-    if (!open_rtsp_stream()) {
+    if (m_demux_thread.joinable()) {
+        return true;
+    }
+    
+    if (!init_ffmpeg()) {
         return false;
     }
     
-    m_running = true;
+    // Opening, demuxing and reconnecting all happen on the demux thread
+    m_stop = false;
+    m_demux_thread = std::thread(&RTSPInput::demux_loop, this);
     return true;
 }
 
-void RTSPInput::process() {
-    if (!m_running) {
-        return;
+int RTSPInput::interrupt_callback(void* opaque) {
+    auto* input = static_cast<RTSPInput*>(opaque);
+    if (input->m_stop.load(std::memory_order_relaxed)) {
+        return 1;
     }
+    return std::chrono::steady_clock::now() > input->m_io_deadline ? 1 : 0;
+}
+
+void RTSPInput::arm_deadline() {
+    m_io_deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(m_options.io_timeout_ms);
+}
+
+bool RTSPInput::wait_for_stop(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(m_stop_mutex);
+    return m_stop_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                              [this] { return m_stop.load(); });
+}
+
+void RTSPInput::demux_loop() {
+    int backoff_ms = RTSP_RECONNECT_MIN_MS;
     
-    read_packet();
+    while (!m_stop) {
+        m_open_time = std::chrono::steady_clock::now();
+        m_first_packet_seen = false;
+        
+        if (!open_rtsp_stream()) {
+            close_rtsp_stream();
+            if (m_stop || wait_for_stop(backoff_ms)) {
+                break;
+            }
+            backoff_ms = std::min(backoff_ms * 2, RTSP_RECONNECT_MAX_MS);
+            std::cout << "Retrying RTSP connection to " << m_rtsp_url << std::endl;
+            continue;
+        }
+        backoff_ms = RTSP_RECONNECT_MIN_MS;
+        
+        // Read until the stream fails or stop() is called
+        while (!m_stop && read_packet()) {
+        }
+        
+        close_rtsp_stream();
+        if (m_stop) {
+            break;
+        }
+        
+        // Reconnect in the background; latency runs until the next packet
+        std::cout << "Attempting to reconnect to RTSP stream..." << std::endl;
+        m_reconnecting = true;
+        m_failure_time = std::chrono::steady_clock::now();
+    }
+}
+
+void RTSPInput::process() {
+    // Packets reach the outputs' send queues from the demux thread, so
+    // this thread only has to wait for shutdown
+    wait_for_wakeup(-1);
 }
 
 bool RTSPInput::read_packet() {
+    arm_deadline();
     int ret = av_read_frame(m_format_ctx, m_packet);
     if (ret < 0) {
+        if (ret == AVERROR(EAGAIN)) {
+            // Resource temporarily unavailable, try again
+            return true;
+        }
+        
         if (ret == AVERROR_EOF) {
             std::cout << "End of RTSP stream" << std::endl;
-            m_running = false;
-        } else if (ret == AVERROR(EAGAIN)) {
-            // Resource temporarily unavailable, try again later
-            return false;
+        } else if (ret == AVERROR_EXIT) {
+            if (!m_stop) {
+                std::cerr << "RTSP read timed out after " << m_options.io_timeout_ms
+                          << " ms" << std::endl;
+            }
         } else {
             char errbuf[AV_ERROR_MAX_STRING_SIZE];
             av_strerror(ret, errbuf, sizeof(errbuf));
             std::cerr << "Error reading frame: " << errbuf << std::endl;
-            
-            // Attempt to reconnect for certain errors
-            if (ret == AVERROR(EIO) || ret == AVERROR(ETIMEDOUT)) {
-                std::cout << "Attempting to reconnect to RTSP stream..." << std::endl;
-                stop();
-                m_running = start();
-            }
         }
         return false;
     }
     
-    // Check if packet is from video stream
-    if (m_packet->stream_index == m_video_stream_idx) {
-        // Forward packet to RIST output
-        for (auto& output : m_outputs) {
-            output->send_data(reinterpret_cast<char*>(m_packet->data), m_packet->size);
+    // Remux selected streams; the muxer writes TS out through write_callback
+    int in_index = m_packet->stream_index;
+    if (in_index >= 0 && in_index < static_cast<int>(m_stream_map.size()) &&
+        m_stream_map[in_index] >= 0 &&
+        (m_packet->pts != AV_NOPTS_VALUE || m_packet->dts != AV_NOPTS_VALUE)) {
+        if (!m_first_packet_seen) {
+            record_first_packet();
+        }
+        
+        AVStream* in = m_format_ctx->streams[in_index];
+        AVStream* out = m_mux_ctx->streams[m_stream_map[in_index]];
+        m_packet->stream_index = out->index;
+        av_packet_rescale_ts(m_packet, in->time_base, out->time_base);
+        m_packet->pos = -1;
+        
+        // Takes ownership of the packet data and unreferences it
+        ret = av_interleaved_write_frame(m_mux_ctx, m_packet);
+        if (ret < 0) {
+            char errbuf[AV_ERROR_MAX_STRING_SIZE];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            std::cerr << "Failed to mux RTSP packet: " << errbuf << std::endl;
         }
     }
     
@@ -146,15 +404,39 @@ bool RTSPInput::read_packet() {
     return true;
 }
 
-void RTSPInput::stop() {
-    m_running = false;
+void RTSPInput::record_first_packet() {
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_open_time);
+    std::cout << "RTSP time to first packet (" << (m_reconnecting ? "reconnect" : "startup")
+              << "): " << elapsed.count() << " ms" << std::endl;
     
-    // Clean up FFmpeg resources
-    if (m_packet) {
-        av_packet_free(&m_packet);
-        m_packet = nullptr;
+    if (m_reconnecting) {
+        // Outage as seen by the outputs: from the failure to the next packet
+        uint64_t outage = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - m_failure_time).count();
+        m_reconnect_count.fetch_add(1, std::memory_order_relaxed);
+        m_last_reconnect_ms.store(outage, std::memory_order_relaxed);
+        if (outage > m_max_reconnect_ms.load(std::memory_order_relaxed)) {
+            m_max_reconnect_ms.store(outage, std::memory_order_relaxed);
+        }
+        std::cout << "RTSP reconnected after " << outage << " ms" << std::endl;
     }
     
+    m_first_packet_seen = true;
+    m_reconnecting = false;
+}
+
+RTSPInput::ReconnectStats RTSPInput::get_reconnect_stats() const {
+    ReconnectStats stats;
+    stats.reconnects = m_reconnect_count.load(std::memory_order_relaxed);
+    stats.last_ms = m_last_reconnect_ms.load(std::memory_order_relaxed);
+    stats.max_ms = m_max_reconnect_ms.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void RTSPInput::close_rtsp_stream() {
+    close_muxer();
+    
     if (m_format_ctx) {
         avformat_close_input(&m_format_ctx);
         m_format_ctx = nullptr;
@@ -162,3 +444,24 @@ void RTSPInput::stop() {
     
     m_video_stream_idx = -1;
 }
+
+void RTSPInput::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_stop_mutex);
+        m_stop = true;
+    }
+    m_stop_cv.notify_all();
+    
+    // The interrupt callback aborts any blocking FFmpeg call
+    if (m_demux_thread.joinable()) {
+        m_demux_thread.join();
+    }
+    
+    // Clean up FFmpeg resources
+    if (m_packet) {
+        av_packet_free(&m_packet);
+        m_packet = nullptr;
+    }
+    
+    close_rtsp_stream();
+}
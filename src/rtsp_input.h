@@ -3,16 +3,35 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "input_base.h"
+#include "config.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 }
 
+// RTSP input demuxed on its own thread. Blocking FFmpeg calls are bounded
+// by an I/O deadline and aborted by stop(); a failed stream reconnects in
+// the background while packets keep flowing to the outputs' send queues.
 class RTSPInput : public InputBase {
 public:
-    RTSPInput(const std::string& rtsp_url, std::shared_ptr<RistOutput> output);
+    // Reconnect counters; latency runs from detecting the failure to the
+    // first packet after the stream reopened
+    struct ReconnectStats {
+        uint64_t reconnects = 0;
+        uint64_t last_ms = 0;
+        uint64_t max_ms = 0;
+    };
+    
+    RTSPInput(const std::string& rtsp_url, std::shared_ptr<OutputSink> output,
+              const RtspConfig& options = RtspConfig());
     ~RTSPInput();
     
     // Virtual functions from InputBase
@@ -20,6 +39,8 @@ public:
     void process() override;
     void stop() override;
     
+    ReconnectStats get_reconnect_stats() const;
+    
 private:
     // Initialize FFmpeg
     bool init_ffmpeg();
@@ -27,16 +48,85 @@ private:
     // Open RTSP stream
     bool open_rtsp_stream();
     
-    // Read packet from RTSP stream
+    // Close the demuxer and muxer of the current connection
+    void close_rtsp_stream();
+    
+    // Demux thread: open, read until failure, reconnect with backoff
+    void demux_loop();
+    
+    // Wait up to timeout_ms for stop(); true if stopping
+    bool wait_for_stop(int timeout_ms);
+    
+    // Restart the deadline for the next blocking FFmpeg call
+    void arm_deadline();
+    
+    // Log time to first packet and update reconnect statistics
+    void record_first_packet();
+    
+    // Apply stream parameters cached from the last successful open; false
+    // if the stream layout changed and a full probe is needed
+    bool apply_cached_stream_info();
+    
+    // Remember stream parameters for the next reconnect
+    void cache_stream_info();
+    
+    // Free cached stream parameters
+    void clear_stream_info_cache();
+    
+    // Create the MPEG-TS muxer writing through a custom AVIOContext
+    bool open_muxer();
+    
+    // Finish and free the muxer
+    void close_muxer();
+    
+    // Read and remux one packet; false when the stream has failed
     bool read_packet();
     
+    // FFmpeg interrupt callback, aborts blocking I/O on stop or deadline
+    static int interrupt_callback(void* opaque);
+    
+    // AVIOContext write callback feeding muxed TS to the outputs
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    static int write_callback(void* opaque, const uint8_t* buf, int size);
+#else
+    static int write_callback(void* opaque, uint8_t* buf, int size);
+#endif
+    
     std::string m_rtsp_url;
-    bool m_running = false;
+    RtspConfig m_options;
+    
+    // Demux thread and its stop signal
+    std::thread m_demux_thread;
+    std::atomic<bool> m_stop{false};
+    std::mutex m_stop_mutex;
+    std::condition_variable m_stop_cv;
+    
+    // Deadline checked by the interrupt callback, demux thread only
+    std::chrono::steady_clock::time_point m_io_deadline;
     
     // FFmpeg structures
     AVFormatContext* m_format_ctx = nullptr;
     AVPacket* m_packet = nullptr;
     int m_video_stream_idx = -1;
+    
+    // MPEG-TS remux; input stream index to muxer stream index, -1 if unused
+    AVFormatContext* m_mux_ctx = nullptr;
+    AVIOContext* m_avio = nullptr;
+    std::vector<int> m_stream_map;
+    bool m_header_written = false;
+    
+    // Codec parameters from the last successful probe
+    std::vector<AVCodecParameters*> m_cached_params;
+    
+    // Time-to-first-packet measurement for each (re)open
+    std::chrono::steady_clock::time_point m_open_time;
+    std::chrono::steady_clock::time_point m_failure_time;
+    bool m_first_packet_seen = false;
+    bool m_reconnecting = false;
+    
+    std::atomic<uint64_t> m_reconnect_count{0};
+    std::atomic<uint64_t> m_last_reconnect_ms{0};
+    std::atomic<uint64_t> m_max_reconnect_ms{0};
 };
 
 #endif // RTSP_INPUT_H
@@ -10,15 +10,46 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-// Buffer size for SRT data
-#define SRT_BUFFER_SIZE 1456 * 100  // Should be multiple of SRT packet size
+// Links polled per socket group
+#define SRT_GROUP_MAX_MEMBERS 8
+// Interval between polls of a group's member states and link stats
+#define SRT_GROUP_POLL_NS 1000000000LL
+// Longest a disconnected stream's output may take to send its queue
+#define SRT_ROUTE_DRAIN_MS 1000
+
+#ifdef SRT_HAS_GROUPS
+static const char* member_state_name(int state) {
+    switch (state) {
+        case SRT_GST_PENDING: return "pending";
+        case SRT_GST_IDLE: return "idle";
+        case SRT_GST_RUNNING: return "running";
+        case SRT_GST_BROKEN: return "broken";
+        default: return "unknown";
+    }
+}
+
+static std::string format_peer(const sockaddr_storage& addr) {
+    char ipstr[INET6_ADDRSTRLEN] = "";
+    int port = 0;
+    if (addr.ss_family == AF_INET) {
+        const sockaddr_in* sin = reinterpret_cast<const sockaddr_in*>(&addr);
+        inet_ntop(AF_INET, &sin->sin_addr, ipstr, sizeof(ipstr));
+        port = ntohs(sin->sin_port);
+    } else if (addr.ss_family == AF_INET6) {
+        const sockaddr_in6* sin6 = reinterpret_cast<const sockaddr_in6*>(&addr);
+        inet_ntop(AF_INET6, &sin6->sin6_addr, ipstr, sizeof(ipstr));
+        port = ntohs(sin6->sin6_port);
+    }
+    return std::string(ipstr) + ":" + std::to_string(port);
+}
+#endif
 
-SRTInput::SRTInput(const std::string& srt_url, std::shared_ptr<RistOutput> output)
+SRTInput::SRTInput(const std::string& srt_url, std::shared_ptr<OutputSink> output)
     : m_mode(Mode::CALLER), m_srt_url(srt_url), m_listen_port(0) {
     m_outputs.push_back(output);
 }
 
-SRTInput::SRTInput(int listen_port, std::shared_ptr<RistOutput> output)
+SRTInput::SRTInput(int listen_port, std::shared_ptr<OutputSink> output)
     : m_mode(Mode::LISTENER), m_listen_port(listen_port) {
     m_outputs.push_back(output);
 }
@@ -27,11 +58,22 @@ SRTInput::SRTInput(int listen_port)
     : m_mode(Mode::MULTI), m_listen_port(listen_port) {
 }
 
+SRTInput::SRTInput(int listen_port, const std::vector<std::string>& stream_ids, OutputFactory factory)
+    : m_mode(Mode::ROUTED), m_listen_port(listen_port), m_output_factory(factory) {
+    for (const auto& id : stream_ids) {
+        m_routes[id] = StreamRoute();
+    }
+}
+
 SRTInput::~SRTInput() {
     stop();
 }
 
-void SRTInput::add_binding(const std::string& interface_ip, std::shared_ptr<RistOutput> output) {
+void SRTInput::set_recv_budget(int budget) {
+    m_recv_budget = budget > 0 ? budget : 1;
+}
+
+void SRTInput::add_binding(const std::string& interface_ip, std::shared_ptr<OutputSink> output) {
     if (m_mode == Mode::MULTI) {
         m_ip_to_output[interface_ip] = output;
         m_outputs.push_back(output);
@@ -58,6 +100,18 @@ bool SRTInput::start() {
         return false;
     }
     
+    if (!m_pool) {
+        std::cerr << "No packet pool set for SRT input" << std::endl;
+        return false;
+    }
+    
+#ifndef SRT_HAS_GROUPS
+    if (m_group_connect) {
+        std::cerr << "SRT socket groups need libsrt 1.5 or later built with bonding" << std::endl;
+        return false;
+    }
+#endif
+    
     // Setup based on mode
     bool success = false;
     switch (m_mode) {
@@ -65,6 +119,7 @@ bool SRTInput::start() {
             success = setup_caller();
             break;
         case Mode::LISTENER:
+        case Mode::ROUTED:
             success = setup_listener();
             break;
         case Mode::MULTI:
@@ -73,11 +128,13 @@ bool SRTInput::start() {
     }
     
     if (success) {
-        // Create epoll instance
-        m_epoll_id = srt_epoll_create();
-        if (m_epoll_id < 0) {
-            report_srt_error("Failed to create SRT epoll");
-            return false;
+        // Create epoll instance unless sharing one owned by a worker
+        if (!m_shared_epoll) {
+            m_epoll_id = srt_epoll_create();
+            if (m_epoll_id < 0) {
+                report_srt_error("Failed to create SRT epoll");
+                return false;
+            }
         }
 
         int events = SRT_EPOLL_IN;
@@ -87,7 +144,18 @@ bool SRTInput::start() {
             }
         }
 
+        // Wait on the wakeup descriptor in the same epoll set
+        if (m_wakeup_fd >= 0) {
+            if (srt_epoll_add_ssock(m_epoll_id, m_wakeup_fd, &events) < 0) {
+                report_srt_error("Failed to add wakeup descriptor to epoll");
+            }
+        }
+
         m_running = true;
+        if (m_mode == Mode::ROUTED) {
+            m_route_stop = false;
+            m_route_thread = std::thread(&SRTInput::route_worker_loop, this);
+        }
         std::cout << "SRT input started successfully" << std::endl;
     } else {
         std::cerr << "Failed to start SRT input" << std::endl;
@@ -176,47 +244,103 @@ bool SRTInput::setup_caller() {
         return false;
     }
 
-    m_poll_sockets.push_back(m_caller_socket);
+    // Non-blocking reads so the drain loop stops at SRT_EASYNCRCV
+    int rcvsyn = 0;
+    srt_setsockopt(m_caller_socket, 0, SRTO_RCVSYN, &rcvsyn, sizeof(rcvsyn));
+
+    m_poll_sockets.insert(m_caller_socket);
+    add_socket_metrics(m_caller_socket, host + ":" + port_str);
     return true;
 }
 
-bool SRTInput::setup_listener() {
+void SRTInput::add_socket_metrics(SRTSOCKET s, const std::string& peer, const std::string& extra_labels) {
+    auto& metrics = MetricsRegistry::global();
+    std::string labels = m_mode == Mode::CALLER
+        ? metric_label("peer", peer)
+        : metric_label("port", std::to_string(m_listen_port)) + "," + metric_label("peer", peer);
+    if (!extra_labels.empty()) {
+        labels += "," + extra_labels;
+    }
+    
+    SocketMetrics socket_metrics;
+    socket_metrics.packets = metrics.counter("srt_packets_received_total", "Messages received from SRT", labels);
+    socket_metrics.bytes = metrics.counter("srt_bytes_received_total", "Bytes received from SRT", labels);
+    socket_metrics.errors = metrics.counter("srt_receive_errors_total", "SRT receive errors", labels);
+    socket_metrics.pool_exhausted = metrics.counter(
+        "srt_pool_exhausted_total", "Messages discarded because the packet pool was empty", labels);
+    m_socket_metrics[s] = socket_metrics;
+}
+
+SRTSOCKET SRTInput::open_listener(const std::string& bind_ip) {
+    // Bind to local address, any address when bind_ip is empty
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(m_listen_port);
+    sa.sin_addr.s_addr = INADDR_ANY;
+    if (!bind_ip.empty() && inet_pton(AF_INET, bind_ip.c_str(), &sa.sin_addr) != 1) {
+        std::cerr << "Invalid SRT listen address: " << bind_ip << std::endl;
+        return SRT_INVALID_SOCK;
+    }
+    
     // Create socket
-    m_listen_socket = srt_create_socket();
-    if (m_listen_socket == SRT_INVALID_SOCK) {
+    SRTSOCKET s = srt_create_socket();
+    if (s == SRT_INVALID_SOCK) {
         report_srt_error("Failed to create SRT socket");
-        return false;
+        return SRT_INVALID_SOCK;
     }
     
     // Set SRT options
     int latency = 200;  // ms
-    srt_setsockopt(m_listen_socket, 0, SRTO_LATENCY, &latency, sizeof(latency));
+    srt_setsockopt(s, 0, SRTO_LATENCY, &latency, sizeof(latency));
     
     int reuse = 1;
-    srt_setsockopt(m_listen_socket, 0, SRTO_REUSEADDR, &reuse, sizeof(reuse));
+    srt_setsockopt(s, 0, SRTO_REUSEADDR, &reuse, sizeof(reuse));
     
-    // Bind to local address
-    sockaddr_in sa;
-    sa.sin_family = AF_INET;
-    sa.sin_port = htons(m_listen_port);
-    sa.sin_addr.s_addr = INADDR_ANY;
+    // Accepted sockets inherit non-blocking reads from the listener
+    int rcvsyn = 0;
+    srt_setsockopt(s, 0, SRTO_RCVSYN, &rcvsyn, sizeof(rcvsyn));
     
-    if (srt_bind(m_listen_socket, (sockaddr*)&sa, sizeof(sa)) < 0) {
+#ifdef SRT_HAS_GROUPS
+    if (m_group_connect) {
+        // Callers may then connect several links as one group
+        int group_connect = 1;
+        if (srt_setsockopt(s, 0, SRTO_GROUPCONNECT, &group_connect, sizeof(group_connect)) < 0) {
+            report_srt_error("SRT socket groups need libsrt built with bonding");
+            srt_close(s);
+            return SRT_INVALID_SOCK;
+        }
+    }
+#endif
+    
+    if (srt_bind(s, (sockaddr*)&sa, sizeof(sa)) < 0) {
         report_srt_error("Failed to bind SRT socket");
-        srt_close(m_listen_socket);
-        m_listen_socket = SRT_INVALID_SOCK;
-        return false;
+        srt_close(s);
+        return SRT_INVALID_SOCK;
     }
     
     // Start listening
-    if (srt_listen(m_listen_socket, 5) < 0) {
+    if (srt_listen(s, 5) < 0) {
         report_srt_error("Failed to listen on SRT socket");
-        srt_close(m_listen_socket);
-        m_listen_socket = SRT_INVALID_SOCK;
+        srt_close(s);
+        return SRT_INVALID_SOCK;
+    }
+    
+    return s;
+}
+
+bool SRTInput::setup_listener() {
+    m_listen_socket = open_listener("");
+    if (m_listen_socket == SRT_INVALID_SOCK) {
         return false;
     }
     
-    m_poll_sockets.push_back(m_listen_socket);
+    if (m_mode == Mode::ROUTED) {
+        // Unknown stream IDs are turned away before a socket is created
+        srt_listen_callback(m_listen_socket, &SRTInput::listen_callback, this);
+    }
+    
+    m_poll_sockets.insert(m_listen_socket);
     return true;
 }
 
@@ -227,20 +351,43 @@ bool SRTInput::setup_multi_listener() {
         return false;
     }
     
-    // Create listener socket
-    return setup_listener();
+    // One listener per interface address, so a connection's route follows
+    // the WAN link it arrived on. An interface that is down only loses
+    // its own route.
+    for (const auto& binding : m_ip_to_output) {
+        SRTSOCKET s = open_listener(binding.first);
+        if (s == SRT_INVALID_SOCK) {
+            std::cerr << "No SRT listener on " << binding.first << ":" << m_listen_port << std::endl;
+            continue;
+        }
+        
+        std::cout << "SRT listening on " << binding.first << ":" << m_listen_port << std::endl;
+        m_listener_to_output[s] = binding.second;
+        m_listener_to_ip[s] = binding.first;
+        m_poll_sockets.insert(s);
+    }
+    
+    return !m_listener_to_output.empty();
 }
 
 void SRTInput::process() {
     if (!m_running) {
+        // Nothing to read, park until shutdown instead of spinning
+        wait_for_wakeup(-1);
         return;
     }
     
-    // Poll for events
-    std::vector<SRTSOCKET> readfds = m_poll_sockets;
+    // Poll for events, blocking until data or a wakeup arrives. Without a
+    // wakeup descriptor fall back to a bounded wait so stop() is noticed.
+    std::vector<SRTSOCKET> readfds(m_poll_sockets.size());
     int rlen = readfds.size();
+    SYSSOCKET wakeup_fd = SRT_INVALID_SOCK;
+    int wlen = 1;
+    int64_t timeout = m_wakeup_fd >= 0 ? -1 : 100;
     
-    int ret = srt_epoll_wait(m_epoll_id, &readfds[0], &rlen, nullptr, nullptr, 10, nullptr, nullptr, nullptr, nullptr);
+    int ret = srt_epoll_wait(m_epoll_id, readfds.data(), &rlen, nullptr, nullptr, timeout,
+                             m_wakeup_fd >= 0 ? &wakeup_fd : nullptr,
+                             m_wakeup_fd >= 0 ? &wlen : nullptr, nullptr, nullptr);
     
     if (ret < 0) {
         if (srt_getlasterror(nullptr) == SRT_ETIMEOUT) {
@@ -251,16 +398,41 @@ void SRTInput::process() {
         return;
     }
     
+    if (m_wakeup_fd >= 0 && wlen > 0 && wakeup_fd == m_wakeup_fd) {
+        // Shutdown requested, leave the descriptor set for the caller
+        return;
+    }
+    
+    handle_ready(readfds.data(), rlen);
+}
+
+void SRTInput::attach_epoll(int epoll_id) {
+    m_epoll_id = epoll_id;
+    m_shared_epoll = true;
+}
+
+void SRTInput::handle_ready(const SRTSOCKET* ready, int count) {
+    if (!m_running) {
+        return;
+    }
+    
+    apply_ready_routes();
+    
     // Process ready sockets
-    for (int i = 0; i < rlen; i++) {
-        SRTSOCKET s = readfds[i];
+    for (int i = 0; i < count; i++) {
+        SRTSOCKET s = ready[i];
+        
+        // A shared epoll set reports sockets of other inputs too
+        if (m_shared_epoll && !m_poll_sockets.count(s)) {
+            continue;
+        }
         
-        if (s == m_listen_socket) {
+        if (s == m_listen_socket || m_listener_to_output.count(s)) {
             // Handle new connections
-            handle_connections();
+            handle_connections(s);
         } else {
             // Handle data from existing connection
-            if (m_mode == Mode::MULTI) {
+            if (m_mode == Mode::MULTI || m_mode == Mode::ROUTED) {
                 auto it = m_socket_to_output.find(s);
                 if (it != m_socket_to_output.end()) {
                     process_socket(s, it->second);
@@ -272,11 +444,11 @@ void SRTInput::process() {
     }
 }
 
-void SRTInput::handle_connections() {
+void SRTInput::handle_connections(SRTSOCKET listener) {
     sockaddr_in client_addr;
     int addrlen = sizeof(client_addr);
     
-    SRTSOCKET client_sock = srt_accept(m_listen_socket,
+    SRTSOCKET client_sock = srt_accept(listener,
                                        reinterpret_cast<sockaddr*>(&client_addr),
                                        &addrlen);
     if (client_sock == SRT_INVALID_SOCK) {
@@ -289,98 +461,410 @@ void SRTInput::handle_connections() {
     inet_ntop(AF_INET, &client_addr.sin_addr, ipstr, INET_ADDRSTRLEN);
     std::string client_ip(ipstr);
     
-    std::cout << "New SRT connection from " << client_ip << ":" << ntohs(client_addr.sin_port) << std::endl;
+    // In multi mode the listener tells which interface, and so which
+    // route, the connection came in on
+    std::string local_ip;
+    auto local_it = m_listener_to_ip.find(listener);
+    if (local_it != m_listener_to_ip.end()) {
+        local_ip = local_it->second;
+    }
+    
+    // A caller bonding several links is accepted as one group, read like
+    // a single socket; its members are polled for link stats
+    bool group = false;
+#ifdef SRT_HAS_GROUPS
+    group = (client_sock & SRTGROUP_MASK) != 0;
+    if (group) {
+        int rcvsyn = 0;
+        srt_setsockopt(client_sock, 0, SRTO_RCVSYN, &rcvsyn, sizeof(rcvsyn));
+        m_groups[client_sock].peer = client_ip;
+    }
+#endif
+    
+    std::cout << "New SRT " << (group ? "group " : "") << "connection from " << client_ip << ":"
+              << ntohs(client_addr.sin_port) << (local_ip.empty() ? "" : " on " + local_ip) << std::endl;
     
     // Add to poll list
-    m_poll_sockets.push_back(client_sock);
+    m_poll_sockets.insert(client_sock);
+    if (m_mode != Mode::ROUTED) {
+        add_socket_metrics(client_sock, client_ip, local_ip.empty() ? "" : metric_label("local", local_ip));
+    }
 
+    // A routed socket is polled once the route thread created its output
     int events = SRT_EPOLL_IN;
-    if (m_epoll_id >= 0) {
+    if (m_epoll_id >= 0 && m_mode != Mode::ROUTED) {
         if (srt_epoll_add_usock(m_epoll_id, client_sock, &events) < 0) {
             report_srt_error("Failed to add client socket to epoll");
         }
     }
     
-    // For multi mode, map to appropriate output
+    // For multi mode, route to the output bound to the listener
     if (m_mode == Mode::MULTI) {
-        std::shared_ptr<RistOutput> output = nullptr;
-        
-        // Find the output for this IP
-        auto it = m_ip_to_output.find(client_ip);
-        if (it != m_ip_to_output.end()) {
-            output = it->second;
+        auto it = m_listener_to_output.find(listener);
+        if (it != m_listener_to_output.end() && it->second) {
+            m_socket_to_output[client_sock] = it->second;
         } else {
-            // If no exact match, use the first output
-            if (!m_outputs.empty()) {
-                output = m_outputs[0];
+            std::cerr << "No output found for SRT listener on " << local_ip << std::endl;
+            close_socket(client_sock);
+        }
+    } else if (m_mode == Mode::ROUTED) {
+        if (route_stream(client_sock)) {
+            add_socket_metrics(client_sock, client_ip,
+                               metric_label("stream", m_socket_stream[client_sock]));
+        } else {
+            close_socket(client_sock);
+        }
+    }
+}
+
+int SRTInput::listen_callback(void* opaque, SRTSOCKET, int, const struct sockaddr*, const char* stream_id) {
+    // Runs on SRT's receive thread: only the routing table's keys, which
+    // never change after construction, may be read here
+    SRTInput* self = static_cast<SRTInput*>(opaque);
+    if (!stream_id || !self->m_routes.count(stream_id)) {
+        std::cerr << "Rejecting SRT caller with unknown stream ID '" << (stream_id ? stream_id : "")
+                  << "'" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+bool SRTInput::route_stream(SRTSOCKET s) {
+    char stream_id[512];
+    int len = sizeof(stream_id) - 1;
+    if (srt_getsockflag(s, SRTO_STREAMID, stream_id, &len) < 0) {
+        len = 0;
+    }
+    stream_id[len] = '\0';
+    
+    auto it = m_routes.find(stream_id);
+    if (it == m_routes.end()) {
+        std::cerr << "No route for SRT stream ID '" << stream_id << "'" << std::endl;
+        return false;
+    }
+    
+    // A second caller would interleave its TS into the same output
+    StreamRoute& route = it->second;
+    if (route.socket != SRT_INVALID_SOCK) {
+        std::cerr << "SRT stream '" << stream_id << "' is already connected, rejecting caller" << std::endl;
+        return false;
+    }
+    
+    // Outputs exist only while their caller is connected; the route
+    // thread creates this one and then adds the socket to the epoll set
+    route.socket = s;
+    m_socket_stream[s] = it->first;
+    {
+        std::lock_guard<std::mutex> lock(m_route_mutex);
+        RouteJob job;
+        job.stream_id = it->first;
+        job.socket = s;
+        m_route_jobs.push_back(std::move(job));
+    }
+    m_route_cv.notify_one();
+    return true;
+}
+
+void SRTInput::route_worker_loop() {
+    std::unique_lock<std::mutex> lock(m_route_mutex);
+    while (true) {
+        m_route_cv.wait(lock, [this] { return m_route_stop || !m_route_jobs.empty(); });
+        if (m_route_jobs.empty()) {
+            return;
+        }
+        RouteJob job = std::move(m_route_jobs.front());
+        m_route_jobs.pop_front();
+        bool stopping = m_route_stop;
+        lock.unlock();
+        
+        if (job.retire) {
+            // Send what the caller left queued, then the destructor flushes
+            // the partial datagram and closes the RIST session
+            std::string name = job.retire->describe();
+            if (!job.retire->drain(SRT_ROUTE_DRAIN_MS)) {
+                std::cerr << "Output " << name << " still had packets queued when released" << std::endl;
+            }
+            job.retire.reset();
+        } else if (!stopping) {
+            RouteReady ready;
+            ready.socket = job.socket;
+            ready.output = m_output_factory(job.stream_id);
+            if (!ready.output) {
+                std::cerr << "Failed to create output for SRT stream '" << job.stream_id << "'" << std::endl;
             }
+            
+            // Data on the socket wakes the ingest thread, which picks the
+            // output up before reading; a failed stream is polled too so
+            // its caller gets dropped
+            int events = SRT_EPOLL_IN;
+            ready.polled = srt_epoll_add_usock(m_epoll_id, job.socket, &events) == 0;
+            
+            std::lock_guard<std::mutex> ready_lock(m_route_mutex);
+            m_route_ready.push_back(std::move(ready));
+            m_routes_ready.store(true, std::memory_order_release);
         }
         
-        if (output) {
-            m_socket_to_output[client_sock] = output;
-        } else {
-            std::cerr << "No output found for client IP " << client_ip << std::endl;
-            srt_close(client_sock);
-            // Remove from poll list
-            auto poll_it = std::find(m_poll_sockets.begin(), m_poll_sockets.end(), client_sock);
-            if (poll_it != m_poll_sockets.end()) {
-                m_poll_sockets.erase(poll_it);
+        lock.lock();
+    }
+}
+
+void SRTInput::apply_ready_routes() {
+    if (!m_routes_ready.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::vector<RouteReady> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_route_mutex);
+        ready.swap(m_route_ready);
+        m_routes_ready.store(false, std::memory_order_relaxed);
+    }
+    
+    for (auto& entry : ready) {
+        auto stream_it = m_socket_stream.find(entry.socket);
+        if (stream_it == m_socket_stream.end()) {
+            // The caller went away meanwhile
+            if (entry.output) {
+                retire_output(std::move(entry.output));
             }
-            if (m_epoll_id >= 0) {
-                srt_epoll_remove_usock(m_epoll_id, client_sock);
+            continue;
+        }
+        
+        StreamRoute& route = m_routes.at(stream_it->second);
+        route.output = entry.output;
+        if (!entry.output || !entry.polled) {
+            close_socket(entry.socket);
+            continue;
+        }
+        m_socket_to_output[entry.socket] = entry.output;
+        std::cout << "SRT stream '" << stream_it->second << "' routed to "
+                  << entry.output->describe() << std::endl;
+    }
+}
+
+void SRTInput::retire_output(std::shared_ptr<OutputSink> output) {
+    {
+        std::lock_guard<std::mutex> lock(m_route_mutex);
+        RouteJob job;
+        job.retire = std::move(output);
+        m_route_jobs.push_back(std::move(job));
+    }
+    m_route_cv.notify_one();
+}
+
+void SRTInput::close_socket(SRTSOCKET s) {
+    m_poll_sockets.erase(s);
+    if (m_epoll_id >= 0) {
+        srt_epoll_remove_usock(m_epoll_id, s);
+    }
+    
+    m_socket_to_output.erase(s);
+    m_socket_metrics.erase(s);
+    m_groups.erase(s);
+    
+    // The route thread drains the stream's output and tears it down
+    auto stream_it = m_socket_stream.find(s);
+    if (stream_it != m_socket_stream.end()) {
+        StreamRoute& route = m_routes.at(stream_it->second);
+        if (route.socket == s) {
+            std::cout << "SRT stream '" << stream_it->second << "' disconnected" << std::endl;
+            if (route.output) {
+                retire_output(std::move(route.output));
             }
+            route.socket = SRT_INVALID_SOCK;
         }
+        m_socket_stream.erase(stream_it);
     }
+    
+    srt_close(s);
 }
 
-void SRTInput::process_socket(SRTSOCKET s, std::shared_ptr<RistOutput> output) {
-    std::vector<char> buffer(SRT_BUFFER_SIZE);
+void SRTInput::process_socket(SRTSOCKET s, std::shared_ptr<OutputSink> output) {
+    int drained = 0;
     
-    // Receive data
-    int ret = srt_recvmsg(s, buffer.data(), buffer.size());
-    if (ret < 0) {
-        if (srt_getlasterror(nullptr) == SRT_ECONNLOST) {
-            std::cout << "SRT connection lost" << std::endl;
+    // Looked up once per wakeup, updated per message
+    const SocketMetrics* metrics = nullptr;
+    auto metrics_it = m_socket_metrics.find(s);
+    if (metrics_it != m_socket_metrics.end()) {
+        metrics = &metrics_it->second;
+    }
+    
+    // Read until the socket runs dry or the budget is used up, so a busy
+    // link cannot starve the other sockets in the poll set
+    while (drained < m_recv_budget) {
+        // Receive straight into a pooled buffer; when the pool is exhausted
+        // keep draining into scratch space so SRT does not back up
+        PacketRef packet = m_pool->acquire();
+        char* buffer = packet ? packet.data() : m_scratch;
+        int ret = srt_recvmsg(s, buffer, PACKET_SLOT_SIZE);
+        if (ret > 0 && packet && m_trace_latency) {
+            packet.set_rx_ns(LatencyTrace::now_ns());
+        }
+        if (ret < 0) {
+            int err = srt_getlasterror(nullptr);
+            if (err == SRT_EASYNCRCV) {
+                // No more data queued on this socket
+                break;
+            }
             
-            // Remove from poll list
-            auto poll_it =
-                std::find(m_poll_sockets.begin(), m_poll_sockets.end(), s);
-            if (poll_it != m_poll_sockets.end()) {
-                m_poll_sockets.erase(poll_it);
+            if (err == SRT_ECONNLOST) {
+                std::cout << "SRT connection lost" << std::endl;
+                if (metrics) {
+                    metrics->errors->inc();
+                }
+                close_socket(s);
+            } else {
+                report_srt_error("SRT receive error");
+                if (metrics) {
+                    metrics->errors->inc();
+                }
             }
-            if (m_epoll_id >= 0) {
-                srt_epoll_remove_usock(m_epoll_id, s);
+            break;
+        }
+        
+        ++drained;
+        if (metrics) {
+            metrics->packets->inc();
+            metrics->bytes->inc(ret);
+            if (!packet) {
+                metrics->pool_exhausted->inc();
             }
-            
-            // Remove from mapping
-            if (m_mode == Mode::MULTI) {
-                m_socket_to_output.erase(s);
+        }
+        if (ret > 0 && packet) {
+            // Forward data to the routed output and every fan-out sink
+            packet.set_size(ret);
+            if (output) {
+                output->send_packet(packet);
             }
-            
-            srt_close(s);
-        } else {
-            report_srt_error("SRT receive error");
+            fan_out(packet);
         }
+    }
+    
+#ifdef SRT_HAS_GROUPS
+    auto group_it = m_groups.find(s);
+    if (group_it != m_groups.end()) {
+        update_group(s, group_it->second);
+    }
+#endif
+    
+    // Record how much this wakeup delivered
+    m_drain_stats.last_drained = drained;
+    if (drained > 0) {
+        ++m_drain_stats.wakeups;
+        m_drain_stats.messages += drained;
+        m_drain_stats.max_drained = std::max(m_drain_stats.max_drained, drained);
+        if (drained == m_recv_budget) {
+            ++m_drain_stats.budget_hits;
+        }
+    }
+}
+
+#ifdef SRT_HAS_GROUPS
+void SRTInput::update_group(SRTSOCKET group, GroupState& state) {
+    int64_t now = LatencyTrace::now_ns();
+    if (now - state.polled_ns < SRT_GROUP_POLL_NS) {
         return;
     }
+    state.polled_ns = now;
     
-    if (ret > 0 && output) {
-        // Forward data to RIST output
-        output->send_data(buffer.data(), ret);
+    SRT_SOCKGROUPDATA data[SRT_GROUP_MAX_MEMBERS];
+    size_t count = SRT_GROUP_MAX_MEMBERS;
+    if (srt_group_data(group, data, &count) < 0) {
+        return;
+    }
+    count = std::min<size_t>(count, SRT_GROUP_MAX_MEMBERS);
+    
+    // Broken links are dropped from the group; the others carry on
+    for (auto it = state.members.begin(); it != state.members.end();) {
+        bool present = false;
+        for (size_t i = 0; i < count; i++) {
+            present |= data[i].id == it->first;
+        }
+        if (present) {
+            ++it;
+            continue;
+        }
+        std::cout << "SRT group " << state.peer << ": link " << it->second.peer << " left" << std::endl;
+        it->second.state_gauge->set(SRT_GST_BROKEN);
+        it = state.members.erase(it);
+    }
+    
+    auto& metrics = MetricsRegistry::global();
+    for (size_t i = 0; i < count; i++) {
+        GroupMember& member = state.members[data[i].id];
+        if (member.peer.empty()) {
+            member.peer = format_peer(data[i].peeraddr);
+            std::string labels = metric_label("group", state.peer) + "," + metric_label("link", member.peer);
+            member.state_gauge = metrics.gauge(
+                "srt_group_link_state", "Group link state: 0 pending, 1 idle, 2 running, 3 broken", labels);
+            member.rtt_ms = metrics.gauge("srt_group_link_rtt_ms", "Smoothed RTT of a group link", labels);
+            member.recv_kbps = metrics.gauge("srt_group_link_recv_kbps", "Receive rate of a group link", labels);
+            member.lost = metrics.gauge(
+                "srt_group_link_lost_packets", "Packets lost on a group link, before group recovery", labels);
+        }
+        
+        if (member.state != data[i].memberstate) {
+            std::cout << "SRT group " << state.peer << ": link " << member.peer << " "
+                      << member_state_name(data[i].memberstate) << std::endl;
+            member.state = data[i].memberstate;
+            member.state_gauge->set(member.state);
+        }
+        
+        SRT_TRACEBSTATS perf;
+        if (srt_bstats(data[i].id, &perf, 0) == 0) {
+            member.rtt_ms->set(static_cast<int64_t>(perf.msRTT));
+            member.recv_kbps->set(static_cast<int64_t>(perf.mbpsRecvRate * 1000));
+            member.lost->set(perf.pktRcvLossTotal);
+        }
     }
 }
+#endif
 
 void SRTInput::stop() {
+    if (m_running && m_drain_stats.wakeups > 0) {
+        std::cout << "SRT drain stats: " << m_drain_stats.messages << " messages in "
+                  << m_drain_stats.wakeups << " wakeups (max " << m_drain_stats.max_drained
+                  << " per wakeup, budget reached " << m_drain_stats.budget_hits
+                  << " times)" << std::endl;
+    }
+    
     m_running = false;
     
     // Close all sockets
     for (auto s : m_poll_sockets) {
+        if (m_shared_epoll && m_epoll_id >= 0) {
+            srt_epoll_remove_usock(m_epoll_id, s);
+        }
         srt_close(s);
     }
     m_poll_sockets.clear();
     m_socket_to_output.clear();
+    m_listener_to_output.clear();
+    m_listener_to_ip.clear();
+    m_socket_metrics.clear();
+    m_groups.clear();
+    
+    // Stream outputs go with their callers; the table's keys stay. The
+    // route thread drains them before it exits.
+    for (auto& route : m_routes) {
+        if (route.second.output && m_route_thread.joinable()) {
+            retire_output(std::move(route.second.output));
+        }
+        route.second.output.reset();
+        route.second.socket = SRT_INVALID_SOCK;
+    }
+    m_socket_stream.clear();
+    if (m_route_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_route_mutex);
+            m_route_stop = true;
+        }
+        m_route_cv.notify_all();
+        m_route_thread.join();
+    }
+    m_route_ready.clear();
+    m_routes_ready = false;
 
-    if (m_epoll_id >= 0) {
+    if (m_epoll_id >= 0 && !m_shared_epoll) {
         srt_epoll_release(m_epoll_id);
         m_epoll_id = -1;
     }
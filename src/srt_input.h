@@ -3,22 +3,78 @@
 
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 #include <srt/srt.h>
+#include <srt/version.h>
 #include "input_base.h"
+#include "metrics.h"
+
+// Socket groups (connection bonding) need libsrt 1.5; SRTGROUP_MASK is a
+// constant, not a macro, so the version decides. A library built without
+// bonding rejects SRTO_GROUPCONNECT when the listener is opened.
+#if SRT_VERSION_VALUE >= SRT_MAKE_VERSION_VALUE(1, 5, 0)
+#define SRT_HAS_GROUPS 1
+#endif
 
 class SRTInput : public InputBase {
 public:
     // Constructor for caller mode
-    SRTInput(const std::string& srt_url, std::shared_ptr<RistOutput> output);
+    SRTInput(const std::string& srt_url, std::shared_ptr<OutputSink> output);
     
     // Constructor for listener mode
-    SRTInput(int listen_port, std::shared_ptr<RistOutput> output);
+    SRTInput(int listen_port, std::shared_ptr<OutputSink> output);
     
     // Constructor for multi-interface mode
     SRTInput(int listen_port);
     
+    // Creates the output for a stream ID when its caller connects; the
+    // output is drained and released again when the caller disconnects.
+    // Both run on a route thread of the input, never the ingest thread.
+    using OutputFactory = std::function<std::shared_ptr<OutputSink>(const std::string& stream_id)>;
+    
+    // Constructor for listener mode routing each caller by SRTO_STREAMID.
+    // Callers with an ID not in stream_ids are rejected in the handshake,
+    // and each ID may be connected once at a time.
+    SRTInput(int listen_port, const std::vector<std::string>& stream_ids, OutputFactory factory);
+    
     // Add a binding for multi-interface mode
-    void add_binding(const std::string& interface_ip, std::shared_ptr<RistOutput> output);
+    void add_binding(const std::string& interface_ip, std::shared_ptr<OutputSink> output);
+    
+    // Maximum number of messages read from one socket per wakeup
+    void set_recv_budget(int budget);
+    
+    // Let callers connect a socket group (SRTO_GROUPCONNECT), bonding
+    // several links in broadcast or main/backup mode. The group is read
+    // like one socket and delivers each message once, whichever link
+    // carried it. Must be called before start().
+    void set_group_connect(bool enabled) { m_group_connect = enabled; }
+    
+    // Receive statistics for the drain loop
+    struct DrainStats {
+        uint64_t wakeups = 0;        // Socket wakeups that delivered data
+        uint64_t messages = 0;       // Total messages received
+        uint64_t budget_hits = 0;    // Wakeups that stopped at the budget
+        int last_drained = 0;        // Messages read on the latest wakeup
+        int max_drained = 0;         // Largest number read on one wakeup
+    };
+    
+    const DrainStats& get_drain_stats() const { return m_drain_stats; }
+    
+    // Register sockets with an epoll set owned by a worker thread instead
+    // of creating one; must be called before start()
+    void attach_epoll(int epoll_id);
+    
+    // Handle sockets reported ready by a shared epoll set, ignoring
+    // sockets that belong to other inputs
+    void handle_ready(const SRTSOCKET* ready, int count);
     
     // Virtual functions from InputBase
     bool start() override;
@@ -31,31 +87,103 @@ private:
     enum class Mode {
         CALLER,
         LISTENER,
-        MULTI
+        MULTI,
+        ROUTED
     };
     
-    struct ConnectionInfo {
+    // Routing table entry of one stream ID
+    struct StreamRoute {
+        std::shared_ptr<OutputSink> output;  // Only while a caller is connected
+        SRTSOCKET socket = SRT_INVALID_SOCK;
+    };
+    
+    // Work for the route thread: create the output of a newly routed
+    // socket, or drain and release the output of a closed one
+    struct RouteJob {
+        std::string stream_id;
+        SRTSOCKET socket = SRT_INVALID_SOCK;
+        std::shared_ptr<OutputSink> retire;
+    };
+    
+    // Output created by the route thread, picked up by the ingest thread
+    struct RouteReady {
         SRTSOCKET socket;
-        std::shared_ptr<RistOutput> output;
+        std::shared_ptr<OutputSink> output;  // nullptr if creation failed
+        bool polled;                         // Socket was added to the epoll set
     };
     
+    // Receive counters for one connection, labelled by peer address
+    struct SocketMetrics {
+        std::shared_ptr<Counter> packets;
+        std::shared_ptr<Counter> bytes;
+        std::shared_ptr<Counter> errors;
+        std::shared_ptr<Counter> pool_exhausted;
+    };
+    
+    // Link state and counters of one member of an accepted group
+    struct GroupMember {
+        std::string peer;
+        int state = -1;              // SRT_MEMBERSTATUS, -1 before the first poll
+        std::shared_ptr<Gauge> state_gauge;
+        std::shared_ptr<Gauge> rtt_ms;
+        std::shared_ptr<Gauge> recv_kbps;
+        std::shared_ptr<Gauge> lost;
+    };
+    
+    // Members of one accepted group and when they were last polled
+    struct GroupState {
+        std::string peer;
+        std::map<SRTSOCKET, GroupMember> members;
+        int64_t polled_ns = 0;
+    };
+    
+    // Refresh a group's member states and link stats, at most once a second
+    void update_group(SRTSOCKET group, GroupState& state);
+    
+    // Register the counters for a newly connected socket; extra_labels
+    // tells connections on one port apart (local address, stream ID)
+    void add_socket_metrics(SRTSOCKET s, const std::string& peer, const std::string& extra_labels = "");
+    
     // Initialize SRT library
     bool init_srt();
     
     // Setup caller connection
     bool setup_caller();
     
+    // Create a listening socket bound to bind_ip (any address if empty)
+    // and the listen port; SRT_INVALID_SOCK on failure
+    SRTSOCKET open_listener(const std::string& bind_ip);
+    
     // Setup listener connection
     bool setup_listener();
     
-    // Setup multi-interface listener
+    // Setup one listener per interface binding
     bool setup_multi_listener();
     
-    // Process data from a specific socket
-    void process_socket(SRTSOCKET s, std::shared_ptr<RistOutput> output);
+    // Drain data from a specific socket up to the receive budget
+    void process_socket(SRTSOCKET s, std::shared_ptr<OutputSink> output);
+    
+    // Accept a new connection on one of the listening sockets
+    void handle_connections(SRTSOCKET listener);
     
-    // Handle new connections
-    void handle_connections();
+    // Route a newly accepted socket by its stream ID; false if it was rejected
+    bool route_stream(SRTSOCKET s);
+    
+    // Forget an accepted socket, releasing its stream route, and close it
+    void close_socket(SRTSOCKET s);
+    
+    // Create and retire stream outputs until stop()
+    void route_worker_loop();
+    
+    // Install the outputs the route thread finished; ingest thread only
+    void apply_ready_routes();
+    
+    // Hand an output to the route thread to drain and release
+    void retire_output(std::shared_ptr<OutputSink> output);
+    
+    // Handshake check rejecting stream IDs without a route
+    static int listen_callback(void* opaque, SRTSOCKET ns, int hsversion,
+                               const struct sockaddr* peeraddr, const char* stream_id);
     
     // SRT error reporting
     void report_srt_error(const std::string& context);
@@ -68,18 +196,55 @@ private:
     SRTSOCKET m_caller_socket = SRT_INVALID_SOCK;
     SRTSOCKET m_listen_socket = SRT_INVALID_SOCK;
     
-    // Multi-interface mode mappings
-    std::map<std::string, std::shared_ptr<RistOutput>> m_ip_to_output;
-    std::map<SRTSOCKET, std::shared_ptr<RistOutput>> m_socket_to_output;
+    // Multi-interface mode mappings: configured bindings and the
+    // listener opened for each
+    std::map<std::string, std::shared_ptr<OutputSink>> m_ip_to_output;
+    std::map<SRTSOCKET, std::shared_ptr<OutputSink>> m_listener_to_output;
+    std::map<SRTSOCKET, std::string> m_listener_to_ip;
+    // Output of every accepted socket in multi and routed mode, looked up
+    // once per wakeup
+    std::unordered_map<SRTSOCKET, std::shared_ptr<OutputSink>> m_socket_to_output;
+    
+    // Stream-ID routing table; its keys are fixed at construction, as the
+    // handshake callback reads them from SRT's receive thread
+    std::unordered_map<std::string, StreamRoute> m_routes;
+    std::unordered_map<SRTSOCKET, std::string> m_socket_stream;
+    OutputFactory m_output_factory;
+    
+    // Route thread, so output setup and teardown do not stall the ingest
+    // thread and every other input sharing its epoll set
+    std::thread m_route_thread;
+    std::mutex m_route_mutex;
+    std::condition_variable m_route_cv;
+    std::deque<RouteJob> m_route_jobs;
+    std::vector<RouteReady> m_route_ready;
+    bool m_route_stop = false;
+    std::atomic<bool> m_routes_ready{false};
+    
+    // Receive counters of every connected socket
+    std::unordered_map<SRTSOCKET, SocketMetrics> m_socket_metrics;
+    
+    // Accepted socket groups
+    bool m_group_connect = false;
+    std::map<SRTSOCKET, GroupState> m_groups;
+    
+    // Per-socket receive budget and drain statistics
+    int m_recv_budget = 64;
+    DrainStats m_drain_stats;
     
     bool m_initialized = false;
     bool m_running = false;
 
     // Epoll ID for socket events
     int m_epoll_id = -1;
+    bool m_shared_epoll = false;
 
-    // Polling structures
-    std::vector<SRTSOCKET> m_poll_sockets;
+    // Every socket this input polls, for O(1) ownership checks on a
+    // shared epoll set
+    std::unordered_set<SRTSOCKET> m_poll_sockets;
+    
+    // Receive target used only while the packet pool is exhausted
+    char m_scratch[PACKET_SLOT_SIZE];
 };
 
 #endif // SRT_INPUT_H
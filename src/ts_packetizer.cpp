@@ -0,0 +1,89 @@
+#include "ts_packetizer.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+TsPacketizer::TsPacketizer(size_t packets_per_datagram, std::chrono::milliseconds flush_timeout,
+                           Sink sink)
+    : m_datagram_size(packets_per_datagram * TS_PACKET_SIZE),
+      m_flush_timeout(flush_timeout),
+      m_sink(std::move(sink)),
+      m_buffer(packets_per_datagram * TS_PACKET_SIZE) {
+}
+
+void TsPacketizer::push(const char* data, size_t size, Clock::time_point now) {
+    // Fast path: aligned input with nothing buffered goes straight out
+    if (m_fill == 0) {
+        while (size >= m_datagram_size && static_cast<uint8_t>(data[0]) == TS_SYNC_BYTE) {
+            emit(data, m_datagram_size);
+            data += m_datagram_size;
+            size -= m_datagram_size;
+        }
+    }
+
+    while (size > 0) {
+        if (m_fill == 0) {
+            m_first_byte = now;
+        }
+
+        size_t chunk = std::min(size, m_datagram_size - m_fill);
+        append(data, chunk);
+        data += chunk;
+        size -= chunk;
+
+        if (m_fill == m_datagram_size) {
+            emit(m_buffer.data(), m_fill);
+            m_fill = 0;
+        }
+    }
+}
+
+void TsPacketizer::append(const char* data, size_t size) {
+    while (size > 0) {
+        // At a packet boundary, skip ahead to the next sync byte
+        if (m_fill % TS_PACKET_SIZE == 0 && static_cast<uint8_t>(data[0]) != TS_SYNC_BYTE) {
+            const void* sync = memchr(data, TS_SYNC_BYTE, size);
+            size_t skip = sync ? static_cast<const char*>(sync) - data : size;
+            m_resync_bytes += skip;
+            data += skip;
+            size -= skip;
+            continue;
+        }
+
+        // Copy up to the end of the current TS packet
+        size_t room = TS_PACKET_SIZE - m_fill % TS_PACKET_SIZE;
+        size_t chunk = std::min(size, room);
+        memcpy(m_buffer.data() + m_fill, data, chunk);
+        m_fill += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void TsPacketizer::poll(Clock::time_point now) {
+    if (pending() && now >= deadline()) {
+        flush();
+    }
+}
+
+void TsPacketizer::flush() {
+    size_t whole = m_fill - m_fill % TS_PACKET_SIZE;
+    if (whole == 0) {
+        return;
+    }
+
+    emit(m_buffer.data(), whole);
+
+    // Keep the partial trailing packet for the next datagram
+    size_t rest = m_fill - whole;
+    if (rest > 0) {
+        memmove(m_buffer.data(), m_buffer.data() + whole, rest);
+        m_first_byte = Clock::now();
+    }
+    m_fill = rest;
+}
+
+void TsPacketizer::emit(const char* data, size_t size) {
+    ++m_datagrams;
+    m_sink(data, size);
+}
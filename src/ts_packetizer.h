@@ -0,0 +1,65 @@
+#ifndef TS_PACKETIZER_H
+#define TS_PACKETIZER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// MPEG-TS packet size and sync byte
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
+
+// Re-chunks a TS byte stream into datagrams of a fixed number of whole TS
+// packets. Input that already arrives as full datagrams is passed through
+// without copying; smaller writes are coalesced until the datagram is full
+// or the flush deadline passes.
+class TsPacketizer {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Sink = std::function<void(const char* data, size_t size)>;
+
+    TsPacketizer(size_t packets_per_datagram, std::chrono::milliseconds flush_timeout, Sink sink);
+
+    // Append data, emitting every datagram that becomes complete
+    void push(const char* data, size_t size, Clock::time_point now);
+
+    // Emit the buffered whole packets if the flush deadline has passed
+    void poll(Clock::time_point now);
+
+    // Emit all buffered whole packets now
+    void flush();
+
+    // Whether a partial datagram is waiting for more data
+    bool pending() const { return m_fill >= TS_PACKET_SIZE; }
+
+    // When the buffered partial datagram must be sent
+    Clock::time_point deadline() const { return m_first_byte + m_flush_timeout; }
+
+    size_t datagram_size() const { return m_datagram_size; }
+    uint64_t datagrams() const { return m_datagrams; }
+
+    // Bytes discarded while searching for the TS sync byte
+    uint64_t resync_bytes() const { return m_resync_bytes; }
+
+private:
+    // Copy data into the datagram buffer, dropping bytes until a sync byte
+    // starts each TS packet
+    void append(const char* data, size_t size);
+
+    void emit(const char* data, size_t size);
+
+    size_t m_datagram_size;
+    std::chrono::milliseconds m_flush_timeout;
+    Sink m_sink;
+
+    std::vector<char> m_buffer;
+    size_t m_fill = 0;
+    Clock::time_point m_first_byte;
+
+    uint64_t m_datagrams = 0;
+    uint64_t m_resync_bytes = 0;
+};
+
+#endif // TS_PACKETIZER_H
@@ -0,0 +1,298 @@
+#include "udp_input.h"
+#include "ts_packetizer.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Fixed part of an RTP header
+#define RTP_HEADER_SIZE 12
+// Backward sequence step still treated as reordering rather than a restart
+#define RTP_MAX_MISORDER 100
+
+UdpInput::UdpInput(const UdpInputConfig& config, std::shared_ptr<OutputSink> output)
+    : m_config(config) {
+    m_outputs.push_back(output);
+
+    auto& metrics = MetricsRegistry::global();
+    std::string labels = metric_label("source", m_config.address + ":" + std::to_string(m_config.port));
+    m_packets_in = metrics.counter("udp_input_packets_received_total", "Datagrams received by UDP inputs", labels);
+    m_bytes_in = metrics.counter("udp_input_bytes_received_total", "Payload bytes received by UDP inputs", labels);
+    m_recv_calls = metrics.counter("udp_input_recv_calls_total", "recvmmsg calls made by UDP inputs", labels);
+    m_dropped = metrics.counter("udp_input_dropped_total", "Datagrams dropped as truncated or malformed", labels);
+    m_pool_exhausted = metrics.counter(
+        "udp_input_pool_exhausted_total", "Datagrams discarded because the packet pool was empty", labels);
+    m_rtp_lost = metrics.counter("udp_input_rtp_lost_total", "Gaps in the RTP sequence numbers", labels);
+}
+
+UdpInput::~UdpInput() {
+    stop();
+}
+
+bool UdpInput::open_socket() {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(m_config.port);
+    if (inet_pton(AF_INET, m_config.address.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "Invalid UDP input address: " << m_config.address << std::endl;
+        return false;
+    }
+
+    m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (m_fd < 0) {
+        std::cerr << "Failed to create UDP input socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Several gateways or decoders may listen to the same group
+    int reuse = 1;
+    setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Bursts from high-bitrate encoders must fit while the thread is busy
+    int rcvbuf = m_config.rcvbuf;
+    setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    // Binding to the group address keeps other groups on the port out
+    if (bind(m_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        std::cerr << "Failed to bind UDP input to " << m_config.address << ":" << m_config.port
+                  << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr))) {
+        struct in_addr interface_addr;
+        interface_addr.s_addr = htonl(INADDR_ANY);
+        if (!m_config.interface_ip.empty() &&
+            inet_pton(AF_INET, m_config.interface_ip.c_str(), &interface_addr) != 1) {
+            std::cerr << "Invalid UDP input interface: " << m_config.interface_ip << std::endl;
+            return false;
+        }
+
+        int ret;
+        if (!m_config.source_ip.empty()) {
+            struct ip_mreq_source mreq;
+            memset(&mreq, 0, sizeof(mreq));
+            mreq.imr_multiaddr = addr.sin_addr;
+            mreq.imr_interface = interface_addr;
+            if (inet_pton(AF_INET, m_config.source_ip.c_str(), &mreq.imr_sourceaddr) != 1) {
+                std::cerr << "Invalid UDP input source: " << m_config.source_ip << std::endl;
+                return false;
+            }
+            ret = setsockopt(m_fd, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP, &mreq, sizeof(mreq));
+        } else {
+            struct ip_mreq mreq;
+            mreq.imr_multiaddr = addr.sin_addr;
+            mreq.imr_interface = interface_addr;
+            ret = setsockopt(m_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+        }
+        if (ret != 0) {
+            std::cerr << "Failed to join multicast group " << m_config.address << ": "
+                      << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "UDP input listening on " << m_config.address << ":" << m_config.port
+              << (m_config.source_ip.empty() ? "" : " from " + m_config.source_ip) << std::endl;
+    return true;
+}
+
+bool UdpInput::start() {
+    if (!m_pool) {
+        std::cerr << "No packet pool set for UDP input" << std::endl;
+        return false;
+    }
+
+    if (m_thread.joinable()) {
+        return true;
+    }
+
+    m_stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_stop_fd < 0 || !open_socket()) {
+        stop();
+        return false;
+    }
+
+    m_running = true;
+    m_thread = std::thread(&UdpInput::receive_loop, this);
+    return true;
+}
+
+void UdpInput::process() {
+    // Datagrams reach the outputs from the receive thread, so this
+    // thread only has to wait for shutdown
+    wait_for_wakeup(-1);
+}
+
+void UdpInput::stop() {
+    m_running = false;
+    if (m_stop_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t ret = write(m_stop_fd, &one, sizeof(one));
+        (void)ret;
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    for (auto& slot : m_slots) {
+        slot.reset();
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    if (m_stop_fd >= 0) {
+        close(m_stop_fd);
+        m_stop_fd = -1;
+    }
+}
+
+void UdpInput::receive_loop() {
+    struct pollfd fds[2] = {{m_fd, POLLIN, 0}, {m_stop_fd, POLLIN, 0}};
+
+    while (m_running) {
+        int ret = poll(fds, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "UDP input poll error: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+
+        // Drain everything queued before waiting again
+        while (m_running && receive_batch()) {
+        }
+    }
+}
+
+bool UdpInput::receive_batch() {
+    struct mmsghdr msgs[UDP_RECV_BATCH];
+    struct iovec iovs[UDP_RECV_BATCH];
+    int slot_of[UDP_RECV_BATCH];    // Slot receiving each message, -1 for scratch
+    memset(msgs, 0, sizeof(msgs));
+
+    // Post every buffer we have; slots used by the last batch are refilled
+    int posted = 0;
+    for (int i = 0; i < UDP_RECV_BATCH; i++) {
+        if (!m_slots[i]) {
+            m_slots[i] = m_pool->acquire();
+            if (!m_slots[i]) {
+                continue;
+            }
+        }
+        iovs[posted].iov_base = m_slots[i].data();
+        iovs[posted].iov_len = m_slots[i].capacity();
+        slot_of[posted++] = i;
+    }
+
+    // With the pool exhausted keep draining into scratch space so the
+    // socket buffer does not overflow into kernel drops
+    if (posted == 0) {
+        iovs[0].iov_base = m_scratch;
+        iovs[0].iov_len = sizeof(m_scratch);
+        slot_of[0] = -1;
+        posted = 1;
+    }
+    for (int i = 0; i < posted; i++) {
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int ret = recvmmsg(m_fd, msgs, posted, MSG_DONTWAIT, nullptr);
+    m_recv_calls->inc();
+    if (ret < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            std::cerr << "UDP input receive error: " << strerror(errno) << std::endl;
+        }
+        return false;
+    }
+
+    int64_t rx_ns = m_trace_latency ? LatencyTrace::now_ns() : 0;
+    for (int m = 0; m < ret; m++) {
+        if (slot_of[m] < 0) {
+            m_pool_exhausted->inc();
+            continue;
+        }
+        if (msgs[m].msg_hdr.msg_flags & MSG_TRUNC) {
+            // Larger than a pool slot; the buffer is reused as-is
+            m_dropped->inc();
+            continue;
+        }
+
+        PacketRef packet = std::move(m_slots[slot_of[m]]);
+        packet.set_size(msgs[m].msg_len);
+        if (!strip_rtp(packet)) {
+            m_dropped->inc();
+            continue;
+        }
+        packet.set_rx_ns(rx_ns);
+
+        m_packets_in->inc();
+        m_bytes_in->inc(packet.size());
+        dispatch(packet);
+    }
+
+    // A full batch means more may be waiting
+    return ret == posted;
+}
+
+bool UdpInput::strip_rtp(PacketRef& packet) {
+    if (m_config.rtp == RtpMode::OFF) {
+        return true;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(packet.data());
+    size_t size = packet.size();
+    bool rtp = size >= RTP_HEADER_SIZE && (data[0] >> 6) == 2;
+    if (m_config.rtp == RtpMode::AUTO && (!rtp || data[0] == TS_SYNC_BYTE)) {
+        // Raw TS, or nothing we know how to unwrap
+        return true;
+    }
+    if (!rtp) {
+        return false;
+    }
+
+    // Fixed header, CSRC list, then an optional extension
+    size_t header = RTP_HEADER_SIZE + 4 * (data[0] & 0x0f);
+    if ((data[0] & 0x10) && header + 4 <= size) {
+        header += 4 + 4 * ((data[header + 2] << 8) | data[header + 3]);
+    }
+    size_t padding = (data[0] & 0x20) ? data[size - 1] : 0;
+    if (header + padding >= size) {
+        return false;
+    }
+
+    // Count sequence gaps. Only a forward step advances: a late or
+    // duplicate packet leaves the highest sequence seen in place, so the
+    // packets after it are not counted again. A step far behind means the
+    // sender restarted, so follow it without counting.
+    uint16_t seq = static_cast<uint16_t>((data[2] << 8) | data[3]);
+    uint16_t step = static_cast<uint16_t>(seq - m_rtp_seq);
+    if (!m_rtp_seen || (step != 0 && step < 0x8000)) {
+        if (m_rtp_seen && step > 1) {
+            m_rtp_lost->inc(step - 1);
+        }
+        m_rtp_seen = true;
+        m_rtp_seq = seq;
+    } else if (static_cast<uint16_t>(m_rtp_seq - seq) > RTP_MAX_MISORDER) {
+        m_rtp_seq = seq;
+    }
+
+    packet.trim_front(header);
+    packet.set_size(size - header - padding);
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef UDP_INPUT_H
+#define UDP_INPUT_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "config.h"
+#include "input_base.h"
+#include "metrics.h"
+
+// Datagrams received per recvmmsg() call
+#define UDP_RECV_BATCH 32
+
+// Plain UDP or RTP/UDP MPEG-TS input, unicast or multicast. A receive
+// thread drains the socket with recvmmsg() straight into pooled buffers,
+// so a burst of datagrams costs one syscall and no copies; RTP headers
+// are skipped in place.
+class UdpInput : public InputBase {
+public:
+    UdpInput(const UdpInputConfig& config, std::shared_ptr<OutputSink> output);
+    ~UdpInput();
+
+    // Virtual functions from InputBase
+    bool start() override;
+    void process() override;
+    void stop() override;
+
+private:
+    // Open, bind and (for multicast) join; false on failure
+    bool open_socket();
+
+    // Receive thread: wait for data and drain the socket
+    void receive_loop();
+
+    // Read every queued datagram, one batch per call; false once empty
+    bool receive_batch();
+
+    // Skip the RTP header of a datagram; false if it is not usable
+    bool strip_rtp(PacketRef& packet);
+
+    UdpInputConfig m_config;
+    int m_fd = -1;
+    int m_stop_fd = -1;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+
+    // Buffers posted to the next recvmmsg(), refilled as they are used
+    PacketRef m_slots[UDP_RECV_BATCH];
+
+    // RTP sequence tracking for loss accounting
+    bool m_rtp_seen = false;
+    uint16_t m_rtp_seq = 0;
+
+    // Receive target used only while the packet pool is exhausted
+    char m_scratch[PACKET_SLOT_SIZE];
+
+    std::shared_ptr<Counter> m_packets_in;
+    std::shared_ptr<Counter> m_bytes_in;
+    std::shared_ptr<Counter> m_recv_calls;
+    std::shared_ptr<Counter> m_dropped;
+    std::shared_ptr<Counter> m_pool_exhausted;
+    std::shared_ptr<Counter> m_rtp_lost;
+};
+
+#endif // UDP_INPUT_H
@@ -0,0 +1,278 @@
+#include "udp_output.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+// Largest payload of one GSO send, below the 64 KiB IP datagram limit
+#define UDP_GSO_MAX_BYTES 63000
+
+UdpOutput::UdpOutput(const UdpOutputConfig& config, size_t queue_depth)
+    : m_config(config), m_queue(queue_depth) {
+    auto& metrics = MetricsRegistry::global();
+    std::string labels = metric_label("dest", describe());
+    m_packets_out = metrics.counter("udp_packets_sent_total", "Datagrams sent by UDP outputs", labels);
+    m_bytes_out = metrics.counter("udp_bytes_sent_total", "Bytes sent by UDP outputs", labels);
+    m_send_calls = metrics.counter("udp_send_calls_total", "sendmmsg calls made by UDP outputs", labels);
+    m_send_errors = metrics.counter("udp_send_errors_total", "Datagrams UDP outputs failed to send", labels);
+    m_queue_drops = metrics.counter("udp_queue_dropped_total", "Packets dropped on send queue overflow", labels);
+}
+
+UdpOutput::~UdpOutput() {
+    m_running = false;
+    {
+        std::lock_guard<std::mutex> lock(m_wait_mutex);
+        m_wait_cv.notify_all();
+    }
+    if (m_sender_thread.joinable()) {
+        m_sender_thread.join();
+    }
+
+    uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped > 0) {
+        std::cout << "UDP output " << describe() << " dropped " << dropped
+                  << " packets on queue overflow" << std::endl;
+    }
+
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+std::string UdpOutput::describe() const {
+    return m_config.dst + ":" + std::to_string(m_config.port);
+}
+
+bool UdpOutput::init() {
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(m_config.port);
+    if (inet_pton(AF_INET, m_config.dst.c_str(), &dest.sin_addr) != 1) {
+        std::cerr << "Invalid UDP output address: " << m_config.dst << std::endl;
+        return false;
+    }
+
+    m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+        std::cerr << "Failed to create UDP output socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    bool multicast = IN_MULTICAST(ntohl(dest.sin_addr.s_addr));
+    struct in_addr interface_addr;
+    interface_addr.s_addr = htonl(INADDR_ANY);
+    if (!m_config.interface_ip.empty()) {
+        if (inet_pton(AF_INET, m_config.interface_ip.c_str(), &interface_addr) != 1) {
+            std::cerr << "Invalid UDP output interface: " << m_config.interface_ip << std::endl;
+            close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+
+        // Send from the interface's address
+        struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr = interface_addr;
+        if (bind(m_fd, (struct sockaddr*)&local, sizeof(local)) != 0) {
+            std::cerr << "Failed to bind UDP output to " << m_config.interface_ip << ": "
+                      << strerror(errno) << std::endl;
+            close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+    }
+
+    if (multicast) {
+        if (!m_config.interface_ip.empty()) {
+            setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_IF, &interface_addr, sizeof(interface_addr));
+        }
+        if (m_config.ttl > 0) {
+            unsigned char ttl = static_cast<unsigned char>(m_config.ttl);
+            setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        }
+    } else if (m_config.ttl > 0) {
+        int ttl = m_config.ttl;
+        setsockopt(m_fd, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl));
+    }
+
+    // Connected, so the batch needs no per-message address
+    if (connect(m_fd, (struct sockaddr*)&dest, sizeof(dest)) != 0) {
+        std::cerr << "Failed to connect UDP output to " << describe() << ": "
+                  << strerror(errno) << std::endl;
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    // Kernels without UDP GSO (before 4.18) reject the option
+    int segment = 0;
+    m_gso = setsockopt(m_fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) == 0;
+
+    m_running = true;
+    m_sender_thread = std::thread(&UdpOutput::sender_loop, this);
+
+    std::cout << "UDP output initialized to " << describe()
+              << (multicast ? " (multicast)" : "") << (m_gso ? " with GSO" : "") << std::endl;
+    return true;
+}
+
+bool UdpOutput::send_packet(const PacketRef& packet) {
+    if (m_fd < 0) {
+        return false;
+    }
+
+    PacketRef* slot = m_queue.write_slot();
+    if (!slot) {
+        // A stalled decoder must never back-pressure the ingest thread
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        m_queue_drops->inc();
+        return false;
+    }
+
+    *slot = packet;
+    m_queue.commit_write();
+
+    // Wake the sender only if it is parked on an empty queue; the fence
+    // orders the publish above against reading the waiting flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sender_waiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_wait_mutex);
+        m_wait_cv.notify_one();
+    }
+    return true;
+}
+
+void UdpOutput::sender_loop() {
+    PacketRef batch[UDP_SEND_BATCH];
+
+    while (m_running) {
+        // Take everything queued, up to one batch
+        size_t count = 0;
+        while (count < UDP_SEND_BATCH) {
+            PacketRef* slot = m_queue.read_slot();
+            if (!slot) {
+                break;
+            }
+            batch[count++] = std::move(*slot);
+            m_queue.commit_read();
+        }
+
+        if (count == 0) {
+            std::unique_lock<std::mutex> lock(m_wait_mutex);
+            m_sender_waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // Re-check after announcing the wait so a concurrent push is not missed
+            m_wait_cv.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return !m_running || !m_queue.empty();
+            });
+            m_sender_waiting.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        size_t done = send_batch(batch, count);
+        if (done < count) {
+            // Segmentation offload is advertised but not usable on this
+            // route (e.g. no checksum offload); send the rest without it
+            std::cerr << "UDP GSO failed on " << describe() << ", sending datagrams individually"
+                      << std::endl;
+            m_gso = false;
+            send_batch(batch + done, count - done);
+        }
+
+        // Return the buffers to the pool
+        for (size_t i = 0; i < count; i++) {
+            batch[i].reset();
+        }
+    }
+}
+
+size_t UdpOutput::send_batch(PacketRef* packets, size_t count) {
+    struct mmsghdr msgs[UDP_SEND_BATCH];
+    struct iovec iovs[UDP_SEND_BATCH];
+    char control[UDP_SEND_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+    size_t first[UDP_SEND_BATCH];       // First packet of each message
+    size_t segments[UDP_SEND_BATCH];    // Packets in each message
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+
+    // One message per packet, or per run of equal-sized packets with GSO;
+    // a shorter packet may end a run as its last segment
+    size_t msg_count = 0;
+    for (size_t i = 0; i < count;) {
+        size_t segment_size = packets[i].size();
+        size_t n = 1;
+        size_t bytes = segment_size;
+        if (m_gso) {
+            while (i + n < count && n < UDP_GSO_MAX_SEGMENTS &&
+                   packets[i + n].size() <= segment_size &&
+                   bytes + packets[i + n].size() <= UDP_GSO_MAX_BYTES) {
+                bytes += packets[i + n].size();
+                if (packets[i + n++].size() < segment_size) {
+                    break;
+                }
+            }
+        }
+
+        for (size_t k = 0; k < n; k++) {
+            iovs[i + k].iov_base = packets[i + k].data();
+            iovs[i + k].iov_len = packets[i + k].size();
+        }
+
+        struct msghdr& hdr = msgs[msg_count].msg_hdr;
+        hdr.msg_iov = &iovs[i];
+        hdr.msg_iovlen = n;
+        if (n > 1) {
+            hdr.msg_control = control[msg_count];
+            hdr.msg_controllen = sizeof(control[msg_count]);
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = static_cast<uint16_t>(segment_size);
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+
+        first[msg_count] = i;
+        segments[msg_count] = n;
+        ++msg_count;
+        i += n;
+    }
+
+    size_t sent = 0;
+    while (sent < msg_count) {
+        int ret = sendmmsg(m_fd, msgs + sent, msg_count - sent, 0);
+        m_send_calls->inc();
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (segments[sent] > 1 && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP)) {
+                // GSO rejected; the caller resends from here without it
+                return first[sent];
+            }
+
+            // Nobody listening (ICMP unreachable), or the socket buffer is
+            // full: the message is lost, carry on with the rest
+            m_send_errors->inc(segments[sent]);
+            ++sent;
+            continue;
+        }
+
+        for (int m = 0; m < ret; m++) {
+            m_packets_out->inc(segments[sent + m]);
+            m_bytes_out->inc(msgs[sent + m].msg_len);
+        }
+        sent += ret;
+    }
+    return count;
+}
@@ -0,0 +1,71 @@
+#ifndef UDP_OUTPUT_H
+#define UDP_OUTPUT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "config.h"
+#include "metrics.h"
+#include "output_sink.h"
+#include "packet_pool.h"
+#include "spsc_ring.h"
+
+// Packets handed to the kernel per sendmmsg() call
+#define UDP_SEND_BATCH 64
+// Most datagrams merged into one UDP GSO send
+#define UDP_GSO_MAX_SEGMENTS 32
+
+// Plain UDP or multicast output for local decoders. Packets are queued
+// like on a RIST output and a sender thread hands everything queued to
+// the kernel in batches: one sendmmsg() per batch and, where the kernel
+// supports UDP GSO, runs of equal-sized datagrams merged into a single
+// segmented send.
+class UdpOutput : public OutputSink {
+public:
+    UdpOutput(const UdpOutputConfig& config, size_t queue_depth = 1024);
+    ~UdpOutput() override;
+
+    // Open and connect the socket and start the sender thread
+    bool init();
+
+    bool send_packet(const PacketRef& packet) override;
+
+    std::string describe() const override;
+
+private:
+    // Thread function draining the send queue in batches
+    void sender_loop();
+
+    // Send count packets in as few calls as possible. Returns how many
+    // were handled (sent or lost), fewer than count only if GSO was
+    // rejected part way through.
+    size_t send_batch(PacketRef* packets, size_t count);
+
+    UdpOutputConfig m_config;
+    int m_fd = -1;
+    bool m_gso = false;           // Sender thread only once started
+
+    std::thread m_sender_thread;
+    std::atomic<bool> m_running{false};
+
+    // Send queue between the ingest thread and the sender thread
+    SpscRing<PacketRef> m_queue;
+    std::atomic<uint64_t> m_dropped{0};
+
+    // Parks the sender thread while the queue is empty
+    std::mutex m_wait_mutex;
+    std::condition_variable m_wait_cv;
+    std::atomic<bool> m_sender_waiting{false};
+
+    // Metrics, labelled by destination
+    std::shared_ptr<Counter> m_packets_out;
+    std::shared_ptr<Counter> m_bytes_out;
+    std::shared_ptr<Counter> m_send_calls;
+    std::shared_ptr<Counter> m_send_errors;
+    std::shared_ptr<Counter> m_queue_drops;
+};
+
+#endif // UDP_OUTPUT_H
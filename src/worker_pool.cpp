@@ -0,0 +1,110 @@
+#include "worker_pool.h"
+#include "srt_input.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+
+// Ready sockets fetched per epoll wait; more are reported on the next wait
+#define WORKER_MAX_READY 256
+
+WorkerPool::WorkerPool(size_t thread_count, int wakeup_fd)
+    : m_thread_count(thread_count), m_wakeup_fd(wakeup_fd) {
+    if (m_thread_count == 0) {
+        m_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+WorkerPool::~WorkerPool() = default;
+
+void WorkerPool::add(std::shared_ptr<Pipeline> pipeline) {
+    m_pipelines.push_back(pipeline);
+}
+
+void WorkerPool::run() {
+    std::vector<std::shared_ptr<Pipeline>> srt_pipelines;
+    std::vector<std::shared_ptr<Pipeline>> threaded;
+    
+    for (auto& pipeline : m_pipelines) {
+        if (pipeline->srt_input()) {
+            srt_pipelines.push_back(pipeline);
+        } else {
+            // Demuxes on its own thread, nothing to schedule
+            pipeline->start(m_wakeup_fd);
+            threaded.push_back(pipeline);
+        }
+    }
+    
+    // Spread SRT pipelines round-robin over the workers
+    size_t worker_count = std::min(m_thread_count, srt_pipelines.size());
+    std::vector<Worker> workers(worker_count);
+    for (size_t i = 0; i < srt_pipelines.size(); i++) {
+        workers[i % worker_count].pipelines.push_back(srt_pipelines[i]);
+    }
+    
+    std::cout << "Running " << m_pipelines.size() << " streams on " << worker_count
+              << " SRT workers, " << threaded.size() << " with their own demux thread" << std::endl;
+    
+    for (auto& worker : workers) {
+        worker.thread = std::thread(&WorkerPool::run_shared, this, std::ref(worker));
+    }
+    
+    // Workers exit on the wakeup descriptor; wait for it here as well in
+    // case there are none
+    struct pollfd pfd = {m_wakeup_fd, POLLIN, 0};
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+    }
+    
+    for (auto& worker : workers) {
+        worker.thread.join();
+    }
+    for (auto& pipeline : threaded) {
+        pipeline->stop();
+    }
+}
+
+void WorkerPool::run_shared(Worker& worker) {
+    int epoll_id = srt_epoll_create();
+    if (epoll_id < 0) {
+        std::cerr << "Failed to create worker SRT epoll: " << srt_getlasterror_str() << std::endl;
+        return;
+    }
+    
+    // The wakeup descriptor ends the worker
+    int events = SRT_EPOLL_IN;
+    srt_epoll_add_ssock(epoll_id, m_wakeup_fd, &events);
+    
+    for (auto& pipeline : worker.pipelines) {
+        pipeline->srt_input()->attach_epoll(epoll_id);
+        pipeline->start(-1);
+    }
+    
+    std::vector<SRTSOCKET> ready(WORKER_MAX_READY);
+    while (true) {
+        int rlen = ready.size();
+        SYSSOCKET wakeup_fd = SRT_INVALID_SOCK;
+        int wlen = 1;
+        
+        int ret = srt_epoll_wait(epoll_id, ready.data(), &rlen, nullptr, nullptr, -1,
+                                 &wakeup_fd, &wlen, nullptr, nullptr);
+        if (ret < 0) {
+            if (srt_getlasterror(nullptr) != SRT_ETIMEOUT) {
+                std::cerr << "Worker SRT poll error: " << srt_getlasterror_str() << std::endl;
+            }
+            continue;
+        }
+        
+        if (wlen > 0 && wakeup_fd == m_wakeup_fd) {
+            break;
+        }
+        
+        for (auto& pipeline : worker.pipelines) {
+            pipeline->srt_input()->handle_ready(ready.data(), rlen);
+        }
+    }
+    
+    for (auto& pipeline : worker.pipelines) {
+        pipeline->stop();
+    }
+    srt_epoll_release(epoll_id);
+}
@@ -0,0 +1,40 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include "pipeline.h"
+
+// Schedules many pipelines over a small set of threads. SRT pipelines are
+// spread round-robin over workers that each wait on one shared SRT epoll
+// set; inputs that run their own demux thread (RTSP) are only started and
+// stopped here.
+class WorkerPool {
+public:
+    // thread_count 0 sizes the pool to the number of cores
+    WorkerPool(size_t thread_count, int wakeup_fd);
+    ~WorkerPool();
+    
+    // Add a pipeline before run()
+    void add(std::shared_ptr<Pipeline> pipeline);
+    
+    // Start every pipeline and block until the wakeup descriptor fires
+    // and all threads have stopped
+    void run();
+    
+private:
+    struct Worker {
+        std::vector<std::shared_ptr<Pipeline>> pipelines;
+        std::thread thread;
+    };
+    
+    // Worker loop multiplexing SRT pipelines over one epoll set
+    void run_shared(Worker& worker);
+    
+    size_t m_thread_count;
+    int m_wakeup_fd;
+    std::vector<std::shared_ptr<Pipeline>> m_pipelines;
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,193 @@
+#include "encoder_control.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using Clock = EncoderControl::Clock;
+
+// Loopback socket bound to an ephemeral port
+static int listen_loopback(int type, int* port) {
+    int fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        (type == SOCK_STREAM && listen(fd, 4) != 0) ||
+        getsockname(fd, (struct sockaddr*)&addr, &len) != 0) {
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// Wait up to timeout_ms for fd to become readable and read what is there
+static std::string receive(int fd, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return "";
+    }
+    char buf[1024];
+    ssize_t got = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    return got > 0 ? std::string(buf, got) : "";
+}
+
+// Run the control's poll loop for a while of real time, at the given clock
+static void pump(EncoderControl& control, Clock::time_point now, int ms) {
+    for (int i = 0; i < ms / 10; i++) {
+        std::vector<struct pollfd> fds;
+        control.add_poll_fds(fds);
+        if (!fds.empty() && poll(fds.data(), fds.size(), 10) > 0) {
+            control.handle_events(fds.data(), fds.size(), now);
+        } else if (fds.empty()) {
+            usleep(10000);
+        }
+        control.service(now);
+    }
+}
+
+static bool check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+static bool test_udp() {
+    bool ok = true;
+    int port = 0;
+    int fd = listen_loopback(SOCK_DGRAM, &port);
+    if (fd < 0) {
+        return check(false, "UDP listener");
+    }
+
+    // The default keeps the request line earlier releases sent
+    {
+        EncoderControl control("127.0.0.1", port, EncoderConfig());
+        control.set_bitrate(4000);
+        control.service(Clock::now());
+        std::string message = receive(fd, 500);
+        ok &= check(message == "GET /ctrl/stream_setting?index=stream1&width=1920&height=1080"
+                               "&bitrate=4000000 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n",
+                    "udp_http request line");
+    }
+
+    EncoderConfig config;
+    config.protocol = "udp";
+    config.min_interval_ms = 200;
+    EncoderControl control("127.0.0.1", port, config);
+    Clock::time_point now = Clock::now();
+    control.set_bitrate(3000);
+    control.service(now);
+    ok &= check(receive(fd, 500) == "index: stream1\nbitrate_hint: 3000 kbps\n", "udp text datagram");
+
+    // Changes inside the rate limit are coalesced into the latest one
+    control.set_bitrate(2500);
+    control.service(now + std::chrono::milliseconds(50));
+    control.set_bitrate(2000);
+    control.service(now + std::chrono::milliseconds(100));
+    ok &= check(receive(fd, 50).empty(), "nothing sent inside the rate limit");
+    ok &= check(control.timeout_ms(now + std::chrono::milliseconds(100)) > 0, "wakeup for the rate limit");
+    control.service(now + std::chrono::milliseconds(200));
+    ok &= check(receive(fd, 500) == "index: stream1\nbitrate_hint: 2000 kbps\n", "only the latest sent");
+    ok &= check(receive(fd, 50).empty(), "coalesced bitrate never sent");
+
+    // A delivered bitrate is not repeated
+    control.service(now + std::chrono::milliseconds(500));
+    ok &= check(receive(fd, 50).empty(), "no resend of a delivered bitrate");
+    ok &= check(control.failure_count() == 0, "no UDP failures");
+
+    close(fd);
+    return ok;
+}
+
+static bool test_http() {
+    bool ok = true;
+    int port = 0;
+    int listener = listen_loopback(SOCK_STREAM, &port);
+    if (listener < 0) {
+        return check(false, "HTTP listener");
+    }
+
+    EncoderConfig config;
+    config.protocol = "http";
+    config.min_interval_ms = 0;
+    EncoderControl control("127.0.0.1", port, config);
+    Clock::time_point now = Clock::now();
+
+    control.set_bitrate(5000);
+    control.service(now);
+    pump(control, now, 50);
+    int conn = accept(listener, nullptr, nullptr);
+    std::string request = receive(conn, 500);
+    ok &= check(request.find("GET /ctrl/stream_setting?index=stream1&width=1920&height=1080"
+                             "&bitrate=5000000 HTTP/1.1\r\n") == 0, "HTTP request line");
+
+    // Newer bitrates wait for the request in flight and coalesce
+    control.set_bitrate(4500);
+    control.service(now);
+    control.set_bitrate(4000);
+    control.service(now);
+    ok &= check(receive(conn, 50).empty(), "one request in flight");
+
+    const char* response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    send(conn, response, strlen(response), MSG_NOSIGNAL);
+    pump(control, now, 100);
+    request = receive(conn, 500);
+    ok &= check(request.find("&bitrate=4000000 ") != std::string::npos, "latest sent on the same connection");
+    ok &= check(control.failure_count() == 0, "no failures after 200");
+
+    // An error status counts as a failure and backs off
+    response = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+    send(conn, response, strlen(response), MSG_NOSIGNAL);
+    pump(control, now, 100);
+    ok &= check(control.failure_count() == 1, "failure counted for 500");
+    ok &= check(receive(conn, 50).empty(), "retry waits for the backoff");
+
+    // The retry gets no answer and times out
+    now += std::chrono::milliseconds(1000);
+    control.service(now);
+    pump(control, now, 50);
+    request = receive(conn, 500);
+    ok &= check(request.find("&bitrate=4000000 ") != std::string::npos, "retry after backoff");
+    ok &= check(control.timeout_ms(now) > 0, "wakeup for the request deadline");
+    control.service(now + std::chrono::milliseconds(2000));
+    ok &= check(control.failure_count() == 2, "failure counted for timeout");
+
+    // Success resets the count; the timed out connection was dropped, so
+    // the retry reconnects
+    now += std::chrono::milliseconds(3000);
+    control.service(now);
+    pump(control, now, 50);
+    close(conn);
+    conn = accept(listener, nullptr, nullptr);
+    request = receive(conn, 500);
+    ok &= check(request.find("&bitrate=4000000 ") != std::string::npos, "retry on a new connection");
+    response = "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n";
+    send(conn, response, strlen(response), MSG_NOSIGNAL);
+    pump(control, now, 100);
+    ok &= check(control.failure_count() == 0, "success resets failures");
+
+    close(conn);
+    close(listener);
+
+    // Nobody listening: the refused connection is a failure
+    EncoderControl refused("127.0.0.1", port, config);
+    refused.set_bitrate(1000);
+    refused.service(Clock::now());
+    pump(refused, Clock::now(), 100);
+    ok &= check(refused.failure_count() == 1, "failure counted for refused connection");
+    return ok;
+}
+
+int main() {
+    bool ok = test_udp();
+    ok &= test_http();
+    std::cout << (ok ? "encoder control ok" : "encoder control failed") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+#include "latency_trace.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main() {
+    // Percentiles of a known distribution: stage delays of 1..1000 us
+    {
+        LatencyTrace trace(1000);
+        for (int i = 1; i <= 1000; i++) {
+            LatencySample sample;
+            sample.rx_ns = 1000000;
+            sample.enqueue_ns = sample.rx_ns + 1000;
+            sample.dequeue_ns = sample.enqueue_ns + i * 1000;
+            sample.send_ns = sample.dequeue_ns + 2000;
+            sample.size = 1316;
+            trace.record(sample);
+        }
+
+        auto summary = LatencyTrace::summarize(trace.snapshot());
+        if (summary.queue.count != 1000 || summary.queue.p50 != 500.0 ||
+            summary.queue.p99 != 990.0 || summary.queue.p999 != 999.0 ||
+            summary.queue.max != 1000.0) {
+            std::cerr << "Wrong queue percentiles: p50 " << summary.queue.p50 << " p99 "
+                      << summary.queue.p99 << " p999 " << summary.queue.p999 << std::endl;
+            return 1;
+        }
+        if (summary.ingest.p99 != 1.0 || summary.send.p50 != 2.0 ||
+            summary.total.max != 1003.0) {
+            std::cerr << "Wrong stage percentiles" << std::endl;
+            return 1;
+        }
+
+        const char* path = "/tmp/latency_trace_test.csv";
+        if (!trace.dump(path)) {
+            return 1;
+        }
+        std::ifstream file(path);
+        std::string line;
+        size_t rows = 0;
+        bool header = false;
+        while (std::getline(file, line)) {
+            if (line.compare(0, 6, "output") == 0) {
+                header = true;
+            } else if (header) {
+                ++rows;
+            }
+        }
+        remove(path);
+        if (rows != 1000) {
+            std::cerr << "Dump has " << rows << " rows" << std::endl;
+            return 1;
+        }
+    }
+
+    // The ring keeps the newest samples once it wraps
+    {
+        LatencyTrace trace(16);
+        for (int i = 1; i <= 100; i++) {
+            LatencySample sample;
+            sample.rx_ns = i;
+            trace.record(sample);
+        }
+        auto samples = trace.snapshot();
+        if (samples.size() != 16 || samples.front().rx_ns != 85 || samples.back().rx_ns != 100) {
+            std::cerr << "Ring did not keep the newest samples" << std::endl;
+            return 1;
+        }
+    }
+
+    // Concurrent writers and a reader never see a torn sample
+    {
+        LatencyTrace trace(256);
+        std::vector<std::thread> writers;
+        for (uint16_t output = 0; output < 3; output++) {
+            writers.emplace_back([&trace, output] {
+                for (int64_t i = 1; i <= 200000; i++) {
+                    LatencySample sample;
+                    sample.rx_ns = i;
+                    sample.enqueue_ns = i;
+                    sample.dequeue_ns = i;
+                    sample.send_ns = i;
+                    sample.size = static_cast<uint32_t>(i);
+                    sample.output = output;
+                    trace.record(sample);
+                }
+            });
+        }
+
+        bool torn = false;
+        for (int round = 0; round < 200; round++) {
+            for (const auto& sample : trace.snapshot()) {
+                if (sample.enqueue_ns != sample.rx_ns || sample.send_ns != sample.rx_ns ||
+                    sample.size != static_cast<uint32_t>(sample.rx_ns)) {
+                    torn = true;
+                }
+            }
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        if (torn) {
+            std::cerr << "Snapshot returned a torn sample" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Latency trace passed" << std::endl;
+    return 0;
+}
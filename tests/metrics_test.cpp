@@ -0,0 +1,117 @@
+#include "metrics.h"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+static bool contains(const std::string& text, const std::string& line) {
+    if (text.find(line) == std::string::npos) {
+        std::cerr << "Missing from output: " << line << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Fetch a path from the server with a plain blocking socket
+static std::string fetch(int port, const char* path) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::string response;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        send(fd, request.data(), request.size(), 0);
+        char buffer[4096];
+        ssize_t got;
+        while ((got = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, got);
+        }
+    }
+    close(fd);
+    return response;
+}
+
+int main() {
+    MetricsRegistry registry;
+
+    // Same name and labels share one counter
+    auto a = registry.counter("test_packets_total", "Packets", metric_label("route", "r1"));
+    auto b = registry.counter("test_packets_total", "Packets", metric_label("route", "r1"));
+    auto c = registry.counter("test_packets_total", "Packets", metric_label("route", "r2"));
+    if (a != b || a == c) {
+        std::cerr << "Counter registration not keyed by labels" << std::endl;
+        return 1;
+    }
+
+    // Concurrent relaxed increments are all counted
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&a] {
+            for (int i = 0; i < 100000; i++) {
+                a->inc();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    c->inc(5);
+
+    auto depth = registry.gauge("test_depth", "Depth");
+    depth->set(7);
+    depth->add(-2);
+
+    auto latency = registry.histogram("test_latency_ms", "Latency", metric_label("route", "r1"), {1, 10, 100});
+    for (double value : {0.5, 1.0, 5.0, 50.0, 500.0}) {
+        latency->observe(value);
+    }
+
+    std::string text = registry.render();
+    bool ok = contains(text, "# TYPE test_packets_total counter") &&
+              contains(text, "test_packets_total{route=\"r1\"} 400000") &&
+              contains(text, "test_packets_total{route=\"r2\"} 5") &&
+              contains(text, "test_depth 5") &&
+              contains(text, "test_latency_ms_bucket{route=\"r1\",le=\"1\"} 2") &&
+              contains(text, "test_latency_ms_bucket{route=\"r1\",le=\"10\"} 3") &&
+              contains(text, "test_latency_ms_bucket{route=\"r1\",le=\"100\"} 4") &&
+              contains(text, "test_latency_ms_bucket{route=\"r1\",le=\"+Inf\"} 5") &&
+              contains(text, "test_latency_ms_count{route=\"r1\"} 5") &&
+              contains(text, "test_latency_ms_sum{route=\"r1\"} 556.5");
+    if (!ok) {
+        return 1;
+    }
+
+    if (metric_label("peer", "a\"b\\c") != "peer=\"a\\\"b\\\\c\"") {
+        std::cerr << "Label value not escaped" << std::endl;
+        return 1;
+    }
+
+    // The endpoint serves the same text
+    const int port = 19321;
+    MetricsServer server(registry, port);
+    if (!server.start()) {
+        std::cerr << "Metrics server did not start" << std::endl;
+        return 1;
+    }
+    std::string response = fetch(port, "/metrics");
+    if (response.compare(0, 15, "HTTP/1.1 200 OK") != 0 ||
+        !contains(response, "test_packets_total{route=\"r2\"} 5")) {
+        return 1;
+    }
+    if (fetch(port, "/other").compare(0, 12, "HTTP/1.1 404") != 0) {
+        std::cerr << "Unknown path not rejected" << std::endl;
+        return 1;
+    }
+    server.stop();
+
+    std::cout << "Metrics passed" << std::endl;
+    return 0;
+}
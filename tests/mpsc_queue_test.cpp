@@ -0,0 +1,73 @@
+#include "mpsc_queue.h"
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int main() {
+    MpscQueue<int> queue(3);
+    if (queue.capacity() != 4) {
+        std::cerr << "Capacity not rounded to power of two" << std::endl;
+        return 1;
+    }
+
+    // Fill to capacity, the next push must be refused
+    for (int i = 0; i < 4; i++) {
+        if (!queue.push(i)) {
+            std::cerr << "Queue full too early" << std::endl;
+            return 1;
+        }
+    }
+    if (queue.push(4)) {
+        std::cerr << "Push accepted on full queue" << std::endl;
+        return 1;
+    }
+    for (int i = 0; i < 4; i++) {
+        int value = -1;
+        if (!queue.pop(value) || value != i) {
+            std::cerr << "Wrong value popped" << std::endl;
+            return 1;
+        }
+    }
+    int value;
+    if (queue.pop(value)) {
+        std::cerr << "Pop succeeded on empty queue" << std::endl;
+        return 1;
+    }
+
+    // Several producers: every value arrives once, in order per producer
+    const int producers = 4;
+    const int count = 200000;
+    MpscQueue<int> shared(64);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&shared, p] {
+            for (int i = 0; i < count; i++) {
+                while (!shared.push(p * count + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<int> next(producers, 0);
+    for (int received = 0; received < producers * count;) {
+        if (!shared.pop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        int p = value / count;
+        if (value % count != next[p]) {
+            std::cerr << "Producer " << p << " out of order" << std::endl;
+            return 1;
+        }
+        ++next[p];
+        ++received;
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::cout << "MPSC queue passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "network_utils.h"
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Every non-loopback IPv4 address getifaddrs() reports
+static std::set<std::string> scan_addresses() {
+    std::set<std::string> ips;
+    struct ifaddrs *ifaddr, *ifa;
+    if (getifaddrs(&ifaddr) == -1) {
+        return ips;
+    }
+    for (ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == nullptr || ifa->ifa_addr->sa_family != AF_INET) {
+            continue;
+        }
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &((struct sockaddr_in*)ifa->ifa_addr)->sin_addr, ip, INET_ADDRSTRLEN);
+        if (std::string(ifa->ifa_name) != "lo") {
+            ips.insert(ip);
+        }
+    }
+    freeifaddrs(ifaddr);
+    return ips;
+}
+
+int main() {
+    bool ok = true;
+
+    // Old and new style wan sections; LAN devices and references are skipped
+    std::istringstream config(
+        "config interface 'loopback'\n"
+        "\toption device 'lo'\n"
+        "\n"
+        "config interface 'lan'\n"
+        "\toption device 'br-lan'\n"
+        "\n"
+        "config interface 'wan'\n"
+        "\toption ifname 'eth0.2 eth3'\n"
+        "\toption proto 'dhcp'\n"
+        "\n"
+        "config interface \"wanb\"\n"
+        "\tlist device \"usb0\"\n"
+        "\n"
+        "config interface 'wan6'\n"
+        "\toption device '@wan'\n");
+    std::set<std::string> devices = NetworkUtils::parse_uci_wan_devices(config);
+    std::set<std::string> expected = {"eth0.2", "eth3", "usb0"};
+    if (devices != expected) {
+        std::cerr << "Parsed " << devices.size() << " wan devices, expected 3" << std::endl;
+        ok = false;
+    }
+
+    if (NetworkUtils::is_wan_interface("docker0") || NetworkUtils::is_wan_interface("virbr0") ||
+        NetworkUtils::is_wan_interface("lo") || !NetworkUtils::is_wan_interface("wan1")) {
+        std::cerr << "Wrong WAN classification" << std::endl;
+        ok = false;
+    }
+
+    // The cache agrees with a fresh scan
+    std::vector<std::string> cached = NetworkUtils::get_interface_ips();
+    std::set<std::string> scanned = scan_addresses();
+    if (std::set<std::string>(cached.begin(), cached.end()) != scanned) {
+        std::cerr << "Cache holds " << cached.size() << " addresses, scan found " << scanned.size() << std::endl;
+        ok = false;
+    }
+
+    std::cout << "cached " << cached.size() << " addresses, "
+              << (InterfaceCache::global().live() ? "live" : "static") << std::endl;
+    return ok ? 0 : 1;
+}
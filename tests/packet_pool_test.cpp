@@ -0,0 +1,41 @@
+#include "packet_pool.h"
+#include <iostream>
+
+int main() {
+    PacketPool pool(2);
+
+    PacketRef a = pool.acquire();
+    PacketRef b = pool.acquire();
+    if (!a || !b || a.data() == b.data()) {
+        std::cerr << "Failed to acquire distinct buffers" << std::endl;
+        return 1;
+    }
+    if (pool.acquire() || pool.exhausted() != 1) {
+        std::cerr << "Exhaustion not reported" << std::endl;
+        return 1;
+    }
+
+    // Sharing a buffer must keep it out of the pool until every handle is gone
+    a.set_size(188);
+    char* shared_data = a.data();
+    PacketRef copy = a;
+    a.reset();
+    if (pool.acquire()) {
+        std::cerr << "Buffer returned while still referenced" << std::endl;
+        return 1;
+    }
+    if (copy.data() != shared_data || copy.size() != 188) {
+        std::cerr << "Shared handle lost its buffer" << std::endl;
+        return 1;
+    }
+    copy.reset();
+
+    PacketRef again = pool.acquire();
+    if (!again || again.data() != shared_data || again.size() != 0) {
+        std::cerr << "Released buffer not reused" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Packet pool passed" << std::endl;
+    return 0;
+}
@@ -8,6 +8,37 @@ int main() {
             std::cerr << "Wrong mode" << std::endl;
             return 1;
         }
+
+        Config multi = parse_config("tests/streams_config.json");
+        if (multi.streams.size() != 4 || multi.workers != 2) {
+            std::cerr << "Wrong stream count" << std::endl;
+            return 1;
+        }
+        const Config& cam = multi.streams[0];
+        const Config& rtsp = multi.streams[1];
+        if (cam.name != "cam1" || cam.mode != InputMode::SRT || cam.listen_port != 9001 ||
+            cam.rist_dst != "192.168.1.200" || cam.max_bitrate != 2000) {
+            std::cerr << "Stream defaults not inherited" << std::endl;
+            return 1;
+        }
+        if (rtsp.name != "stream2" || rtsp.mode != InputMode::RTSP ||
+            rtsp.rist_port != 8002 || rtsp.max_bitrate != 4000) {
+            std::cerr << "Stream overrides not applied" << std::endl;
+            return 1;
+        }
+        const UdpInputConfig& udp = multi.streams[2].udp_input;
+        if (multi.streams[2].mode != InputMode::UDP || udp.address != "239.1.1.1" ||
+            udp.port != 5000 || udp.rtp != RtpMode::STRIP || udp.source_ip != "10.0.0.1") {
+            std::cerr << "UDP input not parsed" << std::endl;
+            return 1;
+        }
+        const auto& routes = multi.streams[3].stream_routes;
+        if (routes.size() != 2 || routes[0].stream_id != "reporter1" ||
+            routes[0].rist_dst != "192.168.1.200" || routes[1].rist_dst != "192.168.1.201" ||
+            routes[1].rist_port != 8012) {
+            std::cerr << "Stream routes not parsed" << std::endl;
+            return 1;
+        }
         std::cout << "Parsed successfully" << std::endl;
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
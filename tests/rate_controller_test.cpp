@@ -0,0 +1,182 @@
+#include "rate_controller.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+using Clock = RateController::Clock;
+
+// Simulated bottleneck: traffic above capacity is lost and queueing
+// inflates the RTT as the link approaches saturation
+struct Link {
+    double capacity;   // kbps
+    double base_rtt;   // ms
+
+    double loss(double rate) const {
+        return rate > capacity ? (rate - capacity) / rate * 100.0 : 0.0;
+    }
+
+    double rtt(double rate) const {
+        double knee = 0.9 * capacity;
+        if (rate <= knee) {
+            return base_rtt;
+        }
+        return base_rtt + std::min(rate - knee, 0.2 * capacity) / (0.1 * capacity) * 50.0;
+    }
+};
+
+struct Score {
+    double utilization = 0.0;  // Mean delivered / capacity
+    double loss = 0.0;         // Mean loss, percent
+    uint32_t final_rate = 0;
+};
+
+static RateController::Params make_params() {
+    RateController::Params params;
+    params.min_bitrate = 500;
+    params.max_bitrate = 8000;
+    return params;
+}
+
+// Replay one stats sample per second per link, with the encoder following
+// the controller's target from the previous second. Routes split the
+// traffic evenly, as a bonded output would with equal weights; in MIN
+// mode every route carries the whole stream. Scores cover [from, end).
+static Score simulate(RateController& controller, std::vector<Link> links,
+                      RateController::Aggregation aggregation, int seconds, int from,
+                      double start_rate, int change_at = -1, double new_capacity = 0) {
+    Score score;
+    auto t = Clock::time_point();
+    double rate = start_rate;
+    int scored = 0;
+
+    for (int s = 0; s < seconds; s++) {
+        if (s == change_at) {
+            links[0].capacity = new_capacity;
+        }
+
+        double capacity = 0.0;
+        double delivered = 0.0;
+        double lost = 0.0;
+        for (size_t i = 0; i < links.size(); i++) {
+            const Link& link = links[i];
+            double share = aggregation == RateController::Aggregation::SUM
+                ? rate / links.size() : rate;
+            double loss = link.loss(share);
+            controller.update("route" + std::to_string(i), loss, link.rtt(share), share, t);
+
+            delivered += std::min(share, link.capacity);
+            lost += share * loss / 100.0;
+            capacity = aggregation == RateController::Aggregation::SUM
+                ? capacity + link.capacity
+                : (i == 0 ? link.capacity : std::min(capacity, link.capacity));
+        }
+        if (aggregation == RateController::Aggregation::MIN) {
+            delivered = std::min(rate, capacity);
+            lost = rate - delivered;
+        }
+
+        if (s >= from) {
+            score.utilization += std::min(delivered, capacity) / capacity;
+            score.loss += rate > 0 ? lost / (aggregation == RateController::Aggregation::SUM
+                                             ? rate : rate * links.size()) * 100.0 : 0.0;
+            ++scored;
+        }
+
+        t += std::chrono::seconds(1);
+        rate = controller.target_bitrate(t);
+    }
+
+    score.utilization /= scored;
+    score.loss /= scored;
+    score.final_rate = static_cast<uint32_t>(rate);
+    return score;
+}
+
+static bool check(const char* name, const Score& score, double min_utilization, double max_loss) {
+    printf("%-24s utilization %5.1f%%  loss %5.2f%%  final %u kbps\n", name,
+           score.utilization * 100.0, score.loss, score.final_rate);
+    if (score.utilization < min_utilization || score.loss > max_loss) {
+        std::cerr << name << ": outside bounds (utilization >= " << min_utilization * 100.0
+                  << "%, loss <= " << max_loss << "%)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool ok = true;
+
+    // Steady 4 Mbps link, starting at the minimum bitrate
+    {
+        RateController controller(make_params());
+        auto score = simulate(controller, {{4000, 30}}, RateController::Aggregation::SUM,
+                              300, 60, 500);
+        ok &= check("steady link", score, 0.85, 1.0);
+    }
+
+    // Capacity falls to 1.5 Mbps: the rate must follow within a few seconds
+    {
+        RateController controller(make_params());
+        auto score = simulate(controller, {{4000, 30}}, RateController::Aggregation::SUM,
+                              220, 130, 3000, 120, 1500);
+        ok &= check("capacity drop", score, 0.80, 1.5);
+    }
+
+    // Two bonded links: the target climbs towards their combined capacity.
+    // An even split saturates the smaller link first, capping this at 80%.
+    {
+        RateController controller(make_params());
+        auto score = simulate(controller, {{2000, 20}, {3000, 60}},
+                              RateController::Aggregation::SUM, 300, 60, 1000);
+        ok &= check("bonded pair", score, 0.70, 1.5);
+        if (controller.route_count() != 2) {
+            std::cerr << "Routes not tracked separately" << std::endl;
+            ok = false;
+        }
+    }
+
+    // Redundant paths: the weaker link bounds the target
+    {
+        RateController controller(make_params(), RateController::Aggregation::MIN);
+        auto score = simulate(controller, {{5000, 20}, {2500, 40}},
+                              RateController::Aggregation::MIN, 300, 60, 1000);
+        ok &= check("redundant pair", score, 0.80, 1.5);
+        if (score.final_rate > 2500 * 1.1) {
+            std::cerr << "Redundant target exceeds the weaker path" << std::endl;
+            ok = false;
+        }
+    }
+
+    // A cut is followed by a hold-down before the rate grows again
+    {
+        auto params = make_params();
+        RateController controller(params);
+        auto t = Clock::time_point();
+        controller.update("route0", 0.0, 30.0, 3000, t);
+        t += std::chrono::seconds(1);
+        controller.update("route0", 10.0, 30.0, 3000, t);
+        double after_cut = controller.route("route0")->rate;
+        for (int s = 2; s * 1000 < params.hold_down_ms; s++) {
+            t += std::chrono::seconds(1);
+            controller.update("route0", 0.0, 30.0, after_cut, t);
+        }
+        if (after_cut >= 3000 || controller.route("route0")->rate > after_cut) {
+            std::cerr << "Hold-down not respected" << std::endl;
+            ok = false;
+        }
+
+        // Silent routes stop counting towards the target
+        t += std::chrono::milliseconds(params.stale_ms + 1000);
+        if (controller.target_bitrate(t) != params.min_bitrate) {
+            std::cerr << "Stale route still counted" << std::endl;
+            ok = false;
+        }
+    }
+
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "Rate controller passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include "redundancy_group.h"
+#include <iostream>
+#include <memory>
+
+int main() {
+    auto group = std::make_shared<RedundancyGroup>();
+    bool ok = true;
+    if (group->flow_id() & 1) {
+        std::cerr << "Flow id " << group->flow_id() << " is odd" << std::endl;
+        ok = false;
+    }
+
+    // Paths are not initialized, so nothing is queued; the stamp still
+    // lands on the shared buffer
+    RistOutput first("127.0.0.1", 19500, 16);
+    RistOutput second("127.0.0.1", 19502, 16);
+    first.set_redundancy_group(group);
+    second.set_redundancy_group(group);
+
+    PacketPool pool(4);
+    for (uint64_t expected = 0; expected < 3; expected++) {
+        PacketRef packet = pool.acquire();
+        packet.set_size(188);
+        group->send_packet(packet);
+
+        // Both copies leave as the same (flow id, sequence)
+        struct rist_data_block a = first.stamped_block(packet);
+        struct rist_data_block b = second.stamped_block(packet);
+        if (a.flow_id != group->flow_id() || b.flow_id != a.flow_id ||
+            a.seq != expected || b.seq != a.seq || b.ts_ntp != a.ts_ntp ||
+            !(a.flags & RIST_DATA_FLAGS_USE_SEQ)) {
+            std::cerr << "Copies of packet " << expected << " differ: flow " << a.flow_id << "/"
+                      << b.flow_id << ", seq " << a.seq << "/" << b.seq << std::endl;
+            ok = false;
+        }
+    }
+
+    std::cout << "redundant copies share flow " << group->flow_id() << std::endl;
+    return ok ? 0 : 1;
+}
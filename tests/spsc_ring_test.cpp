@@ -0,0 +1,68 @@
+#include "spsc_ring.h"
+#include <iostream>
+#include <thread>
+
+int main() {
+    SpscRing<int> ring(3);
+    if (ring.capacity() != 4) {
+        std::cerr << "Capacity not rounded to power of two" << std::endl;
+        return 1;
+    }
+
+    // Fill to capacity, the next write must be refused
+    for (int i = 0; i < 4; i++) {
+        int* slot = ring.write_slot();
+        if (!slot) {
+            std::cerr << "Ring full too early" << std::endl;
+            return 1;
+        }
+        *slot = i;
+        ring.commit_write();
+    }
+    if (ring.write_slot() != nullptr) {
+        std::cerr << "Write accepted on full ring" << std::endl;
+        return 1;
+    }
+    for (int i = 0; i < 4; i++) {
+        int* slot = ring.read_slot();
+        if (!slot || *slot != i) {
+            std::cerr << "Wrong value read back" << std::endl;
+            return 1;
+        }
+        ring.commit_read();
+    }
+
+    // Stream values across threads and check ordering
+    const int count = 1000000;
+    SpscRing<int> shared(256);
+    std::thread producer([&shared] {
+        for (int i = 0; i < count; i++) {
+            int* slot;
+            while (!(slot = shared.write_slot())) {
+                std::this_thread::yield();
+            }
+            *slot = i;
+            shared.commit_write();
+        }
+    });
+
+    int expected = 0;
+    while (expected < count) {
+        int* slot = shared.read_slot();
+        if (!slot) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (*slot != expected) {
+            std::cerr << "Out of order: got " << *slot << " expected " << expected << std::endl;
+            producer.join();
+            return 1;
+        }
+        shared.commit_read();
+        expected++;
+    }
+    producer.join();
+
+    std::cout << "SPSC ring passed" << std::endl;
+    return 0;
+}
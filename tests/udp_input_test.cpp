@@ -0,0 +1,133 @@
+#include "udp_input.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define TEST_PORT 19411
+#define TS_DATAGRAM 1316
+
+// Output that records what the input handed it
+class CollectingSink : public OutputSink {
+public:
+    bool send_packet(const PacketRef& packet) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        const char* data = packet.data();
+        payloads.emplace_back(data, data + packet.size());
+        return true;
+    }
+
+    std::string describe() const override { return "collector"; }
+
+    std::mutex mutex;
+    std::vector<std::vector<char>> payloads;
+};
+
+// RTP header with one CSRC and a one-word extension in front of a TS payload
+static std::vector<char> rtp_datagram(uint16_t seq, int index) {
+    std::vector<char> datagram(12 + 4 + 8 + TS_DATAGRAM);
+    datagram[0] = static_cast<char>(0x80 | 0x10 | 0x01);
+    datagram[1] = 33;    // MP2T
+    datagram[2] = static_cast<char>(seq >> 8);
+    datagram[3] = static_cast<char>(seq & 0xff);
+    datagram[12 + 4 + 3] = 1;    // Extension length in words
+    char* ts = datagram.data() + 12 + 4 + 8;
+    ts[0] = 0x47;
+    memcpy(ts + 4, &index, sizeof(index));
+    return datagram;
+}
+
+int main() {
+    auto sink = std::make_shared<CollectingSink>();
+    auto pool = std::make_shared<PacketPool>(256);
+
+    UdpInputConfig config;
+    config.address = "127.0.0.1";
+    config.port = TEST_PORT;
+    UdpInput input(config, sink);
+    input.set_packet_pool(pool);
+    if (!input.start()) {
+        return 1;
+    }
+
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(TEST_PORT);
+    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // Raw TS, then RTP with one sequence number skipped and, later, two
+    // sequence numbers swapped. The swapped pair counts its gap once.
+    const int raw = 500;
+    const int rtp = 500;
+    for (int i = 0; i < raw + rtp; i++) {
+        std::vector<char> datagram;
+        if (i < raw) {
+            datagram.assign(TS_DATAGRAM, 0);
+            datagram[0] = 0x47;
+            memcpy(datagram.data() + 4, &i, sizeof(i));
+        } else {
+            int n = i - raw;
+            if (n == 300 || n == 301) {
+                n = 601 - n;
+            }
+            uint16_t seq = static_cast<uint16_t>(65000 + n + (n >= 100 ? 1 : 0));
+            datagram = rtp_datagram(seq, i);
+        }
+        sendto(tx, datagram.data(), datagram.size(), 0, (struct sockaddr*)&dest, sizeof(dest));
+        if (i % 32 == 0) {
+            // Stay within the loopback socket buffer
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    for (int waited = 0; waited < 2000; waited += 10) {
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            if (sink->payloads.size() >= raw + rtp) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    input.stop();
+    close(tx);
+
+    bool ok = sink->payloads.size() == raw + rtp;
+    for (size_t i = 0; ok && i < sink->payloads.size(); i++) {
+        const std::vector<char>& payload = sink->payloads[i];
+        int index = -1;
+        if (payload.size() == TS_DATAGRAM) {
+            memcpy(&index, payload.data() + 4, sizeof(index));
+        }
+        if (payload[0] != 0x47 || index != static_cast<int>(i)) {
+            std::cerr << "Payload " << i << " mangled (size " << payload.size() << ")" << std::endl;
+            ok = false;
+        }
+    }
+    // Every buffer, including those posted to recvmmsg, is back in the pool
+    std::vector<PacketRef> drained;
+    while (PacketRef packet = pool->acquire()) {
+        drained.push_back(std::move(packet));
+    }
+    if (drained.size() != pool->capacity()) {
+        std::cerr << "Pool buffers leaked" << std::endl;
+        ok = false;
+    }
+
+    std::string metrics = MetricsRegistry::global().render();
+    if (metrics.find("udp_input_rtp_lost_total{source=\"127.0.0.1:19411\"} 2") == std::string::npos) {
+        std::cerr << "RTP loss not counted" << std::endl;
+        ok = false;
+    }
+
+    std::cout << "received " << sink->payloads.size() << " of " << raw + rtp << std::endl;
+    return ok ? 0 : 1;
+}
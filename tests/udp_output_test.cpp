@@ -0,0 +1,100 @@
+#include "udp_output.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Loopback receiver standing in for a local decoder
+static int open_receiver(int& port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+int main() {
+    int port = 0;
+    int rx = open_receiver(port);
+
+    PacketPool pool(4096);
+    UdpOutputConfig config;
+    config.dst = "127.0.0.1";
+    config.port = port;
+    UdpOutput output(config, 1024);
+    if (!output.init()) {
+        return 1;
+    }
+
+    // Mostly full-size messages with a short one every so often, so GSO
+    // runs end early and every datagram boundary must survive batching
+    const int total = 3000;
+    std::vector<size_t> sizes(total);
+    for (int i = 0; i < total; i++) {
+        sizes[i] = i % 50 == 49 ? 188 : 1316;
+    }
+
+    int received = 0;
+    bool ok = true;
+    char buffer[65536];
+    auto receive_ready = [&](int timeout_ms) {
+        struct pollfd pfd = {rx, POLLIN, 0};
+        while (poll(&pfd, 1, timeout_ms) > 0) {
+            ssize_t got = recv(rx, buffer, sizeof(buffer), 0);
+            if (got <= 0) {
+                break;
+            }
+            uint32_t seq;
+            memcpy(&seq, buffer, sizeof(seq));
+            if (seq != static_cast<uint32_t>(received) || static_cast<size_t>(got) != sizes[seq]) {
+                std::cerr << "Datagram " << received << " arrived as seq " << seq
+                          << " with " << got << " bytes" << std::endl;
+                ok = false;
+            }
+            ++received;
+        }
+    };
+
+    for (int i = 0; i < total && ok; i++) {
+        PacketRef packet = pool.acquire();
+        memset(packet.data(), 0x47, sizes[i]);
+        uint32_t seq = i;
+        memcpy(packet.data(), &seq, sizeof(seq));
+        packet.set_size(sizes[i]);
+        while (!output.send_packet(packet)) {
+            // Queue full, let the sender catch up
+            receive_ready(1);
+        }
+        if (i % 256 == 255) {
+            receive_ready(0);
+        }
+    }
+    while (ok && received < total) {
+        int before = received;
+        receive_ready(500);
+        if (received == before) {
+            break;
+        }
+    }
+    close(rx);
+
+    if (!ok || received != total) {
+        std::cerr << "Received " << received << " of " << total << " datagrams" << std::endl;
+        return 1;
+    }
+    std::cout << "UDP output passed" << std::endl;
+    return 0;
+}